@@ -0,0 +1,1219 @@
+// Benchmark driver for the lab kernels.
+//
+//    LabBenchmark [--benchmarks=reduction,matmul,batched-gemm,scan,segmented,compaction,sort,convolution,filter-chain,histogram]
+//                 [--vector-sizes=1048576,16777216]
+//                 [--matrix-sizes=256,512,1024x512x256]
+//                 [--batch-sizes=8,16,32,64]
+//                 [--image-sizes=640x480,1920x1080]
+//                 [--mask-sizes=3,5,7,9,11,13,15]
+//                 [--warmup=1] [--repetitions=5] [--format=csv|json]
+//
+// The inputs are synthetic (uniform random values from a fixed seed), so no
+// dataset is needed. Every variant of a lab runs on the same input: warmup
+// runs first, then the timed repetitions, each followed by
+// cudaDeviceSynchronize. Only the device work is timed; the inputs are copied
+// once before and the results once after, to verify them against a host
+// reference.
+//
+// One line is printed per variant and size, as CSV with a header line or as
+// one JSON object per line, so runs of two versions can be diffed or loaded
+// into a spreadsheet. The throughput is in GB/s for the memory-bound labs
+// (bytes read and written by the algorithm, not the traffic of a particular
+// kernel), in GFLOP/s for the matrix and image labs and in Gkeys/s for sort.
+//
+// The kernels are the lab sources themselves, each included in a namespace
+// of its own, with the BLOCK_SIZE the lab sets; their main functions are
+// compiled but never called.
+//
+// reduction      The three lab kernels (the first two finish on the host)
+//                and the reduction engine, plain and reproducible.
+//
+// matmul         The simple and tiled labs, the register-tiled kernels and
+//                the blocked host sgemm.
+//
+// batched-gemm   As many square matrices of each batch size as make up
+//                BATCHED_GEMM_ELEMENTS elements per operand, strided, through
+//                pointer arrays and with the generic kernel.
+//
+// scan           The three lab scans, the hierarchical and the single-pass
+//                scan. The Simple and Abit-improved scans only handle inputs
+//                their single fix-up block can cover, and are skipped on
+//                larger ones.
+//
+// segmented      Scans and reduction of segments of random lengths averaging
+//                SEGMENT_MEAN_LENGTH elements, by head flags and by offsets.
+//
+// compaction     Keeps the values below 0.5 of a uniform [0, 1) vector;
+//                std-copy-if is the serial host loop the others replace.
+//
+// sort           Every run starts from a copy of the unsorted keys, which is
+//                part of its time; std-sort is the serial host sort.
+//
+// convolution    The masks are separable (outer products of random vectors).
+//                The direct row is the path convolution2D takes (tiled or
+//                generic, host without nvcc) and is the reference; the CPU
+//                build also runs the kernels through the executor
+//                (tiled-emulated, generic-emulated). separable runs on the
+//                same mask and is credited with its own 2 x 2K flops per
+//                output; fft is credited with the 2 x K^2 of the direct
+//                convolution, so its throughput shows where it overtakes it
+//                (FFT_CONVOLUTION_CROSSOVER).
+//
+// filter-chain   Blurs (5 x 5), clamps, sharpens (3 x 3), scales and clamps
+//                again, as one FilterChain per step (stages: an image in
+//                global memory between steps) and as one fused chain,
+//                verified against the stages; both are credited with the
+//                flops of the two convolutions.
+//
+// histogram      The fused histogram equalization.
+
+#include <wb.h>
+#include "../CpuExecutor/CpuExecutor.h"
+#include "../BinaryDataset/BinaryDataset.h"
+#include "../PrefixSums(Scan)/HierarchicalScan.h"
+#include "../PrefixSums(Scan)/SinglePassScan.h"
+#include "../PrefixSums(Scan)/SegmentedScan.h"
+#include "../PrefixSums(Scan)/StreamCompaction.h"
+#include "../RadixSort/RadixSort.h"
+#include "../ListReduction/ReductionEngine.h"
+#include "../MatrixMultiplication/HostSgemm.h"
+#include "../MatrixMultiplication/RegisterTiledMatrixMultiply.h"
+#include "../MatrixMultiplication/BatchedSmallGemm.h"
+#include "../ImageConvolution/Convolution2D.h"
+#include "../ImageConvolution/SeparableConvolution.h"
+#include "../ImageConvolution/FftConvolution.h"
+#include "../ImageConvolution/FilterChain.h"
+#include "../Profiler/WbProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace simpleReduction {
+#include "../ListReduction/SimpleListReduction.cpp"
+const int blockSize = BLOCK_SIZE; // the lab's own, whatever it is set to
+}
+#undef BLOCK_SIZE
+#undef wbCheck
+
+namespace efficientReduction {
+#include "../ListReduction/EfficientListReduction.cpp"
+const int blockSize = BLOCK_SIZE; // the lab's own, whatever it is set to
+}
+#undef BLOCK_SIZE
+#undef wbCheck
+
+namespace multiLevelReduction {
+#include "../ListReduction/MultiLevelListReduction.cpp"
+}
+#undef BLOCK_SIZE
+#undef ELEMENTS_PER_BLOCK
+#undef wbCheck
+
+namespace simpleMatrixMultiplication {
+#include "../MatrixMultiplication/SimpleMatrixMultiplication.cpp"
+}
+#undef wbCheck
+
+namespace tiledMatrixMultiplication {
+#include "../MatrixMultiplication/TiledMatrixMultiplication.cpp"
+}
+#undef wbCheck
+
+namespace simpleScan {
+#include "../PrefixSums(Scan)/SimpleScan.cpp"
+const int blockSize = BLOCK_SIZE; // the lab's own, whatever it is set to
+}
+#undef BLOCK_SIZE
+#undef wbCheck
+
+namespace simpleScanAbitImproved {
+#include "../PrefixSums(Scan)/SimpleScanAbitImproved.cpp"
+const int blockSize = BLOCK_SIZE; // the lab's own, whatever it is set to
+}
+#undef BLOCK_SIZE
+#undef wbCheck
+
+namespace workEfficientScan {
+#include "../PrefixSums(Scan)/WorkEfficientScan.cpp"
+const int blockSize = BLOCK_SIZE; // the lab's own, whatever it is set to
+}
+#undef BLOCK_SIZE
+#undef wbCheck
+
+namespace fusedHistogramEqualization {
+#include "../Histogram equalization/FusedHistogramEqualization.cpp"
+}
+#undef wbCheck
+
+#define BATCHED_GEMM_ELEMENTS (1 << 22)
+#define SEGMENT_MEAN_LENGTH 1000
+
+#define wbCheck(stmt) do {                                                    \
+        cudaError_t err = stmt;                                               \
+        if (err != cudaSuccess) {                                             \
+            wbLog(ERROR, "Failed to run stmt ", #stmt);                       \
+            wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));    \
+            return -1;                                                        \
+        }                                                                     \
+    } while(0)
+
+struct Options
+{
+   std::vector<std::string> benchmarks;
+   std::vector<long> vectorSizes;
+   std::vector<std::vector<int> > matrixSizes; // rows x columns x depth
+   std::vector<int> batchSizes;                // of the square matrices of a batch
+   std::vector<std::vector<int> > imageSizes;  // width x height
+   std::vector<int> maskSizes;
+   int warmup;
+   int repetitions;
+   bool json;
+};
+
+struct Result
+{
+   std::string benchmark;
+   std::string variant;
+   std::string shape;
+   std::vector<double> times; // milliseconds, sorted
+   double work;               // bytes or floating-point operations per run
+   const char * unit;         // "GB/s" or "GFLOP/s"
+   const char * verified;     // "yes", "no" or "-"
+};
+
+// Integers separated by 'x', as in 1920x1080.
+std::vector<int> parseShape(const std::string& text)
+{
+   std::vector<int> shape;
+   std::stringstream stream(text);
+   std::string part;
+   while (std::getline(stream, part, 'x'))
+      shape.push_back(atoi(part.c_str()));
+   return shape;
+}
+
+std::vector<std::string> splitList(const std::string& text)
+{
+   std::vector<std::string> items;
+   std::stringstream stream(text);
+   std::string item;
+   while (std::getline(stream, item, ','))
+      if (!item.empty())
+         items.push_back(item);
+   return items;
+}
+
+bool parseOptions(int argc, char ** argv, Options& options)
+{
+   options.benchmarks = splitList("reduction,matmul,batched-gemm,scan,segmented,compaction,sort,convolution,filter-chain,histogram");
+   options.vectorSizes.push_back(1 << 20);
+   options.vectorSizes.push_back(1 << 24);
+   options.matrixSizes.push_back(parseShape("256"));
+   options.matrixSizes.push_back(parseShape("512"));
+   options.matrixSizes.push_back(parseShape("1024"));
+   for (int size = 8; size <= 64; size *= 2)
+      options.batchSizes.push_back(size);
+   options.imageSizes.push_back(parseShape("640x480"));
+   options.imageSizes.push_back(parseShape("1920x1080"));
+   for (int mask = 3; mask <= 15; mask += 2)
+      options.maskSizes.push_back(mask);
+   options.warmup = 1;
+   options.repetitions = 5;
+   options.json = false;
+
+   for (int i = 1; i < argc; ++i)
+   {
+      std::string argument = argv[i];
+      size_t equals = argument.find('=');
+      std::string name = argument.substr(0, equals);
+      std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+      if (name == "--benchmarks")
+         options.benchmarks = splitList(value);
+      else if (name == "--vector-sizes")
+      {
+         options.vectorSizes.clear();
+         for (const std::string& item : splitList(value))
+            options.vectorSizes.push_back(atol(item.c_str()));
+      }
+      else if (name == "--matrix-sizes")
+      {
+         options.matrixSizes.clear();
+         for (const std::string& item : splitList(value))
+            options.matrixSizes.push_back(parseShape(item));
+      }
+      else if (name == "--batch-sizes")
+      {
+         options.batchSizes.clear();
+         for (const std::string& item : splitList(value))
+            options.batchSizes.push_back(atoi(item.c_str()));
+      }
+      else if (name == "--image-sizes")
+      {
+         options.imageSizes.clear();
+         for (const std::string& item : splitList(value))
+            options.imageSizes.push_back(parseShape(item));
+      }
+      else if (name == "--mask-sizes")
+      {
+         options.maskSizes.clear();
+         for (const std::string& item : splitList(value))
+            options.maskSizes.push_back(atoi(item.c_str()));
+      }
+      else if (name == "--warmup")
+         options.warmup = atoi(value.c_str());
+      else if (name == "--repetitions")
+         options.repetitions = atoi(value.c_str());
+      else if (name == "--format")
+         options.json = value == "json";
+      else
+      {
+         fprintf(stderr, "Unknown option %s\n", argument.c_str());
+         return false;
+      }
+   }
+
+   // a single number is a square matrix or image; two matrix sizes are
+   // rows x columns with a square B
+   for (std::vector<int>& shape : options.matrixSizes)
+   {
+      while (shape.size() < 3)
+         shape.push_back(shape.size() == 1 ? shape[0] : shape[1]);
+   }
+   for (std::vector<int>& size : options.imageSizes)
+   {
+      if (size.size() == 1)
+         size.push_back(size[0]);
+   }
+   return options.repetitions > 0 && options.warmup >= 0;
+}
+
+bool selected(const Options& options, const char * benchmark)
+{
+   return std::find(options.benchmarks.begin(), options.benchmarks.end(), benchmark) != options.benchmarks.end();
+}
+
+std::vector<float> randomValues(size_t count, float low, float high, unsigned seed)
+{
+   std::mt19937 generator(seed);
+   std::uniform_real_distribution<float> distribution(low, high);
+   std::vector<float> values(count);
+   for (size_t i = 0; i < count; ++i)
+      values[i] = distribution(generator);
+   return values;
+}
+
+// Runs body (which launches device work and returns its error) warmup +
+// repetitions times and keeps the sorted times of the repetitions.
+template <typename Body>
+cudaError_t timeRuns(const Options& options, Body body, std::vector<double>& times)
+{
+   times.clear();
+   for (int run = 0; run < options.warmup + options.repetitions; ++run)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      cudaError_t err = body();
+      if (err == cudaSuccess)
+         err = cudaDeviceSynchronize();
+      if (err == cudaSuccess)
+         err = cudaGetLastError();
+      if (err != cudaSuccess)
+         return err;
+      double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      if (run >= options.warmup)
+         times.push_back(milliseconds);
+   }
+   std::sort(times.begin(), times.end());
+   return cudaSuccess;
+}
+
+bool closeTo(double expected, double actual, double tolerance)
+{
+   return std::fabs(expected - actual) <= tolerance * std::max(1.0, std::fabs(expected));
+}
+
+void printHeader(const Options& options)
+{
+   if (!options.json)
+      printf("benchmark,variant,shape,repetitions,min_ms,median_ms,mean_ms,throughput,unit,verified\n");
+}
+
+void printResult(const Options& options, const Result& result)
+{
+   double mean = 0.0;
+   for (double time : result.times)
+      mean += time;
+   mean /= result.times.size();
+   double median = result.times[result.times.size() / 2];
+   double throughput = result.work / (result.times.front() * 1e-3) / 1e9; // from the best run
+
+   if (options.json)
+   {
+      printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"shape\": \"%s\", \"repetitions\": %zu, "
+             "\"min_ms\": %.6f, \"median_ms\": %.6f, \"mean_ms\": %.6f, \"throughput\": %.3f, "
+             "\"unit\": \"%s\", \"verified\": \"%s\"}\n",
+             result.benchmark.c_str(), result.variant.c_str(), result.shape.c_str(), result.times.size(),
+             result.times.front(), median, mean, throughput, result.unit, result.verified);
+   }
+   else
+   {
+      printf("%s,%s,%s,%zu,%.6f,%.6f,%.6f,%.3f,%s,%s\n",
+             result.benchmark.c_str(), result.variant.c_str(), result.shape.c_str(), result.times.size(),
+             result.times.front(), median, mean, throughput, result.unit, result.verified);
+   }
+   fflush(stdout);
+}
+
+int benchmarkReduction(const Options& options, int len)
+{
+   std::vector<float> hostInput = randomValues(len, 0.0f, 1.0f, 1);
+   double expected = 0.0;
+   for (float value : hostInput)
+      expected += value;
+
+   // the two labs that finish on the host, each with its own BLOCK_SIZE
+   int labBlockSizes[2] = { simpleReduction::blockSize, efficientReduction::blockSize };
+   int maxBlocks = (len - 1) / (2 * std::min(labBlockSizes[0], labBlockSizes[1])) + 1;
+   int numScratch = multiLevelReduction::reduceScratchLength(len);
+   std::vector<float> hostPartial(maxBlocks);
+   float * deviceInput;
+   float * deviceOutput;
+   wbCheck(cudaMalloc((void **) &deviceInput, len * sizeof(float)));
+   long numOutput = std::max(std::max((long) maxBlocks, (long) numScratch),
+                             std::max((long) reductionScratchLength(), reproducibleScratchLength(len)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, numOutput * sizeof(float)));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], len * sizeof(float), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "simple", "efficient", "multilevel", "engine", "engine-reproducible" };
+
+   for (int variant = 0; variant < 5; ++variant)
+   {
+      Result result;
+      result.benchmark = "reduction";
+      result.variant = variants[variant];
+      result.shape = std::to_string(len);
+      result.work = (double) len * sizeof(float);
+      result.unit = "GB/s";
+
+      int numBlocks = variant < 2 ? (len - 1) / (2 * labBlockSizes[variant]) + 1 : 0;
+      dim3 DimGrid(numBlocks, 1, 1);
+      dim3 DimBlock(variant < 2 ? labBlockSizes[variant] : 1, 1, 1);
+      float sum = 0.0f;
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 2)
+            return multiLevelReduction::reduceOnDevice(deviceInput, len, deviceOutput, &sum);
+         if (variant == 3)
+            return reduce<SumOp<float> >(deviceInput, len, deviceOutput, &sum);
+         if (variant == 4)
+            return reduceReproducible<SumOp<float> >(deviceInput, len, deviceOutput, &sum);
+         if (variant == 0)
+            launchKernel(simpleReduction::total, DimGrid, DimBlock, deviceInput, deviceOutput, len);
+         else
+            launchKernel(efficientReduction::total, DimGrid, DimBlock, deviceInput, deviceOutput, len);
+         return cudaGetLastError();
+      }, result.times));
+
+      if (variant < 2)
+      {
+         // the first two labs finish the reduction on the host
+         wbCheck(cudaMemcpy(&hostPartial[0], deviceOutput, numBlocks * sizeof(float), cudaMemcpyDeviceToHost));
+         for (int i = 0; i < numBlocks; ++i)
+            sum += hostPartial[i];
+      }
+      result.verified = closeTo(expected, sum, 1e-4) ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   return 0;
+}
+
+int benchmarkMatrixMultiplication(const Options& options, int rows, int columns, int depth)
+{
+   std::vector<float> hostA = randomValues((size_t) rows * depth, -1.0f, 1.0f, 2);
+   std::vector<float> hostB = randomValues((size_t) depth * columns, -1.0f, 1.0f, 3);
+   std::vector<float> hostC((size_t) rows * columns);
+   std::vector<float> referenceC((size_t) rows * columns);
+   hostSgemm(rows, columns, depth, &hostA[0], depth, &hostB[0], columns, &referenceC[0], columns);
+
+   float * deviceA;
+   float * deviceB;
+   float * deviceC;
+   wbCheck(cudaMalloc((void **) &deviceA, hostA.size() * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceB, hostB.size() * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceC, hostC.size() * sizeof(float)));
+   wbCheck(cudaMemcpy(deviceA, &hostA[0], hostA.size() * sizeof(float), cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(deviceB, &hostB[0], hostB.size() * sizeof(float), cudaMemcpyHostToDevice));
+
+   const int tile = 16; // TILE_WIDTH of both labs
+   const char * variants[] = { "simple", "tiled", "register-4x4", "register-8x8", "host-sgemm" };
+   const int numVariants = sizeof(variants) / sizeof(variants[0]);
+
+   for (int variant = 0; variant < numVariants; ++variant)
+   {
+      Result result;
+      result.benchmark = "matmul";
+      result.variant = variants[variant];
+      result.shape = std::to_string(rows) + "x" + std::to_string(columns) + "x" + std::to_string(depth);
+      result.work = 2.0 * rows * columns * depth;
+      result.unit = "GFLOP/s";
+
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+         {
+            dim3 dimGrid((rows - 1) / tile + 1, (columns - 1) / tile + 1, 1);
+            launchKernel(simpleMatrixMultiplication::matrixMultiply, dimGrid, dim3(tile, tile, 1),
+                         deviceA, deviceB, deviceC, rows, depth, depth, columns, rows, columns);
+         }
+         else if (variant == 1)
+         {
+            dim3 dimGrid((columns - 1) / tile + 1, (rows - 1) / tile + 1, 1);
+            launchKernel(tiledMatrixMultiplication::matrixMultiply, dimGrid, dim3(tile, tile, 1),
+                         deviceA, deviceB, deviceC, rows, depth, depth, columns, rows, columns);
+         }
+         else if (variant == 2)
+            return launchRegisterTiledMatrixMultiply<64, 64, 8, 4, 4>(deviceA, deviceB, deviceC, rows, columns, depth);
+         else if (variant == 3)
+            return launchRegisterTiledMatrixMultiply<128, 128, 8, 8, 8>(deviceA, deviceB, deviceC, rows, columns, depth);
+         else
+            hostSgemm(rows, columns, depth, &hostA[0], depth, &hostB[0], columns, &hostC[0], columns);
+         return cudaGetLastError();
+      }, result.times));
+
+      if (variant < numVariants - 1)
+         wbCheck(cudaMemcpy(&hostC[0], deviceC, hostC.size() * sizeof(float), cudaMemcpyDeviceToHost));
+
+      bool correct = true;
+      for (size_t i = 0; i < hostC.size() && correct; ++i)
+         correct = closeTo(referenceC[i], hostC[i], 1e-3);
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceA);
+   cudaFree(deviceB);
+   cudaFree(deviceC);
+   return 0;
+}
+
+int benchmarkBatchedGemm(const Options& options, int size)
+{
+   int count = std::max(BATCHED_GEMM_ELEMENTS / (size * size), 1);
+   long stride = (long) size * size;
+   std::vector<float> hostA = randomValues(count * stride, -1.0f, 1.0f, 8);
+   std::vector<float> hostB = randomValues(count * stride, -1.0f, 1.0f, 9);
+   std::vector<float> hostC(count * stride);
+   std::vector<float> referenceC(count * stride);
+   for (int i = 0; i < count; ++i)
+      hostGemm(size, size, size, &hostA[i * stride], &hostB[i * stride], &referenceC[i * stride]);
+
+   float * deviceA;
+   float * deviceB;
+   float * deviceC;
+   wbCheck(cudaMalloc((void **) &deviceA, hostA.size() * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceB, hostB.size() * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceC, hostC.size() * sizeof(float)));
+   wbCheck(cudaMemcpy(deviceA, &hostA[0], hostA.size() * sizeof(float), cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(deviceB, &hostB[0], hostB.size() * sizeof(float), cudaMemcpyHostToDevice));
+
+   // the same batch as pointer arrays, in device memory
+   std::vector<const float *> hostPointersA(count);
+   std::vector<const float *> hostPointersB(count);
+   std::vector<float *> hostPointersC(count);
+   for (int i = 0; i < count; ++i)
+   {
+      hostPointersA[i] = deviceA + i * stride;
+      hostPointersB[i] = deviceB + i * stride;
+      hostPointersC[i] = deviceC + i * stride;
+   }
+   const float ** devicePointersA;
+   const float ** devicePointersB;
+   float ** devicePointersC;
+   wbCheck(cudaMalloc((void **) &devicePointersA, count * sizeof(float *)));
+   wbCheck(cudaMalloc((void **) &devicePointersB, count * sizeof(float *)));
+   wbCheck(cudaMalloc((void **) &devicePointersC, count * sizeof(float *)));
+   wbCheck(cudaMemcpy(devicePointersA, &hostPointersA[0], count * sizeof(float *), cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(devicePointersB, &hostPointersB[0], count * sizeof(float *), cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(devicePointersC, &hostPointersC[0], count * sizeof(float *), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "strided", "pointers", "generic" };
+
+   for (int variant = 0; variant < 3; ++variant)
+   {
+      Result result;
+      result.benchmark = "batched-gemm";
+      result.variant = variant == 0 && !batchedGemmIsSpecialized(size, size, size) ? "strided-generic" : variants[variant];
+      result.shape = std::to_string(count) + "x" + std::to_string(size) + "x" + std::to_string(size);
+      result.work = 2.0 * count * stride * size;
+      result.unit = "GFLOP/s";
+
+      wbCheck(cudaMemset(deviceC, 0, hostC.size() * sizeof(float)));
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+            return batchedGemmStrided(size, size, size, deviceA, stride, deviceB, stride, deviceC, stride, count);
+         if (variant == 1)
+            return batchedGemmPointers(size, size, size, devicePointersA, devicePointersB, devicePointersC, count);
+         StridedBatch batch = { deviceA, stride, deviceB, stride, deviceC, stride };
+         return runBatchedGemmGeneric(batch, count, size, size, size);
+      }, result.times));
+
+      wbCheck(cudaMemcpy(&hostC[0], deviceC, hostC.size() * sizeof(float), cudaMemcpyDeviceToHost));
+      bool correct = true;
+      for (size_t i = 0; i < hostC.size() && correct; ++i)
+         correct = closeTo(referenceC[i], hostC[i], 1e-3);
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceA);
+   cudaFree(deviceB);
+   cudaFree(deviceC);
+   cudaFree(devicePointersA);
+   cudaFree(devicePointersB);
+   cudaFree(devicePointersC);
+   return 0;
+}
+
+int benchmarkScan(const Options& options, int len)
+{
+   std::vector<float> hostInput = randomValues(len, 0.0f, 1.0f, 4);
+   std::vector<double> expected(len);
+   double running = 0.0;
+   for (int i = 0; i < len; ++i)
+      expected[i] = running += hostInput[i];
+   std::vector<float> hostOutput(len);
+
+   float * deviceInput;
+   float * deviceOutput;
+   float * deviceScratch = NULL;
+   long long scratchLength = hierarchicalScanScratchLength(len);
+   wbCheck(cudaMalloc((void **) &deviceInput, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, len * sizeof(float)));
+   void * deviceSinglePassScratch;
+   if (scratchLength > 0)
+      wbCheck(cudaMalloc((void **) &deviceScratch, scratchLength * sizeof(float)));
+   wbCheck(cudaMalloc(&deviceSinglePassScratch, singlePassScanScratchBytes<float>(len)));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], len * sizeof(float), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "simple", "simple-abit-improved", "work-efficient", "hierarchical", "single-pass" };
+
+   for (int variant = 0; variant < 5; ++variant)
+   {
+      // the fix-up block of SimpleScanAbitImproved holds one total per thread
+      if (variant == 1 && len > simpleScanAbitImproved::blockSize * simpleScanAbitImproved::blockSize)
+      {
+         fprintf(stderr, "scan %s skipped: %d elements exceed its %d\n", variants[variant], len,
+                 simpleScanAbitImproved::blockSize * simpleScanAbitImproved::blockSize);
+         continue;
+      }
+
+      Result result;
+      result.benchmark = "scan";
+      result.variant = variants[variant];
+      result.shape = std::to_string(len);
+      result.work = 2.0 * len * sizeof(float);
+      result.unit = "GB/s";
+
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+         {
+            const int blockSize = simpleScan::blockSize;
+            launchKernel(simpleScan::scan, dim3((len - 1) / blockSize + 1, 1, 1), dim3(blockSize, 1, 1),
+                         deviceInput, deviceOutput, len);
+            launchKernel(simpleScan::scan_sumUp, dim3(1, 1, 1), dim3(blockSize, 1, 1), deviceOutput, len);
+         }
+         else if (variant == 1)
+         {
+            const int blockSize = simpleScanAbitImproved::blockSize;
+            launchKernel(simpleScanAbitImproved::scan, dim3((len - 1) / blockSize + 1, 1, 1), dim3(blockSize, 1, 1),
+                         deviceInput, deviceOutput, len);
+            launchKernel(simpleScanAbitImproved::scan_sumUp, dim3(1, 1, 1), dim3(blockSize, 1, 1), deviceOutput, len);
+         }
+         else if (variant == 2)
+         {
+            const int blockSize = workEfficientScan::blockSize;
+            launchKernel(workEfficientScan::scan, dim3((len - 1) / (2 * blockSize) + 1, 1, 1), dim3(blockSize, 1, 1),
+                         deviceInput, deviceOutput, len);
+            launchKernel(workEfficientScan::scan_sumUp, dim3(1, 1, 1), dim3(2 * blockSize, 1, 1), deviceOutput, len);
+         }
+         else if (variant == 3)
+            return hierarchicalScanDevice<float>(deviceInput, deviceOutput, len, deviceScratch);
+         else
+            return singlePassScanDevice<float>(deviceInput, deviceOutput, len, deviceSinglePassScratch);
+         return cudaGetLastError();
+      }, result.times));
+
+      wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, len * sizeof(float), cudaMemcpyDeviceToHost));
+      bool correct = true;
+      for (int i = 0; i < len && correct; ++i)
+         correct = closeTo(expected[i], hostOutput[i], 1e-3);
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceScratch);
+   cudaFree(deviceSinglePassScratch);
+   return 0;
+}
+
+int benchmarkSegmented(const Options& options, int len)
+{
+   std::vector<float> hostInput = randomValues(len, 0.0f, 1.0f, 7);
+   std::mt19937 generator(8);
+   std::uniform_int_distribution<int> segmentLength(0, 2 * SEGMENT_MEAN_LENGTH);
+   std::vector<long long> hostOffsets(1, 0);
+   while (hostOffsets.back() < len)
+      hostOffsets.push_back(std::min(hostOffsets.back() + segmentLength(generator), (long long) len));
+   long long segmentCount = hostOffsets.size() - 1;
+   std::vector<unsigned char> hostHeadFlags(len, 0);
+   for (long long segment = 0; segment < segmentCount; ++segment)
+      if (hostOffsets[segment] < len)
+         hostHeadFlags[hostOffsets[segment]] = 1;
+
+   std::vector<double> expected(len);
+   std::vector<double> expectedTotals(segmentCount, 0.0);
+   for (long long segment = 0; segment < segmentCount; ++segment)
+   {
+      double running = 0.0;
+      for (long long i = hostOffsets[segment]; i < hostOffsets[segment + 1]; ++i)
+         expected[i] = running += hostInput[i];
+      expectedTotals[segment] = running;
+   }
+   std::vector<float> hostOutput(std::max((long long) len, segmentCount));
+
+   float * deviceInput;
+   float * deviceOutput;
+   unsigned char * deviceHeadFlags;
+   long long * deviceOffsets;
+   void * deviceScratch;
+   wbCheck(cudaMalloc((void **) &deviceInput, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, hostOutput.size() * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceHeadFlags, len));
+   wbCheck(cudaMalloc((void **) &deviceOffsets, (segmentCount + 1) * sizeof(long long)));
+   wbCheck(cudaMalloc(&deviceScratch, singlePassScanScratchBytes<float>(len)));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], len * sizeof(float), cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(deviceHeadFlags, &hostHeadFlags[0], len, cudaMemcpyHostToDevice));
+   wbCheck(cudaMemcpy(deviceOffsets, &hostOffsets[0], (segmentCount + 1) * sizeof(long long), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "scan-head-flags", "scan-offsets", "reduce-offsets" };
+
+   for (int variant = 0; variant < 3; ++variant)
+   {
+      Result result;
+      result.benchmark = "segmented";
+      result.variant = variants[variant];
+      result.shape = std::to_string(len) + "/" + std::to_string(segmentCount);
+      result.unit = "GB/s";
+      if (variant == 0)
+         result.work = 2.0 * len * sizeof(float) + len;
+      else if (variant == 1)
+         result.work = 2.0 * len * sizeof(float) + segmentCount * sizeof(long long);
+      else
+         result.work = (double) len * sizeof(float) + segmentCount * (sizeof(long long) + sizeof(float));
+
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+            return segmentedScanDevice<float>(deviceInput, deviceHeadFlags, deviceOutput, len, deviceScratch);
+         else if (variant == 1)
+            return segmentedScanDevice<float>(deviceInput, deviceOffsets, segmentCount, deviceOutput, len, deviceScratch);
+         else
+            return segmentedReduceDevice<float>(deviceInput, deviceOffsets, segmentCount, deviceOutput, len, deviceScratch);
+      }, result.times));
+
+      wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, hostOutput.size() * sizeof(float), cudaMemcpyDeviceToHost));
+      bool correct = true;
+      if (variant < 2)
+         for (int i = 0; i < len && correct; ++i)
+            correct = closeTo(expected[i], hostOutput[i], 1e-3);
+      else
+         for (long long segment = 0; segment < segmentCount && correct; ++segment)
+            correct = closeTo(expectedTotals[segment], hostOutput[segment], 1e-3);
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceHeadFlags);
+   cudaFree(deviceOffsets);
+   cudaFree(deviceScratch);
+   return 0;
+}
+
+struct BelowHalf
+{
+   __host__ __device__ bool operator()(const float& value) const
+   {
+      return value < 0.5f;
+   }
+};
+
+int benchmarkCompaction(const Options& options, int len)
+{
+   std::vector<float> hostInput = randomValues(len, 0.0f, 1.0f, 9);
+   std::vector<float> expected;
+   for (float value : hostInput)
+      if (BelowHalf()(value))
+         expected.push_back(value);
+   long long expectedCount = expected.size();
+   for (float value : hostInput)
+      if (!BelowHalf()(value))
+         expected.push_back(value);
+   std::vector<float> hostOutput(len);
+
+   float * deviceInput;
+   float * deviceOutput;
+   float * deviceRejected;
+   long long * deviceCount;
+   void * deviceScratch;
+   wbCheck(cudaMalloc((void **) &deviceInput, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceRejected, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceCount, sizeof(long long)));
+   wbCheck(cudaMalloc(&deviceScratch, streamCompactionScratchBytes(len)));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], len * sizeof(float), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "std-copy-if", "copy-if", "partition-copy", "stable-partition" };
+
+   for (int variant = 0; variant < 4; ++variant)
+   {
+      Result result;
+      result.benchmark = "compaction";
+      result.variant = variants[variant];
+      result.shape = std::to_string(len);
+      result.work = (len + (variant < 2 ? expectedCount : len)) * (double) sizeof(float);
+      result.unit = "GB/s";
+
+      long long count = 0;
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+         {
+            count = std::copy_if(hostInput.begin(), hostInput.end(), hostOutput.begin(), BelowHalf()) - hostOutput.begin();
+            return cudaSuccess;
+         }
+         else if (variant == 1)
+            return copyIfDevice(deviceInput, deviceOutput, len, BelowHalf(), deviceCount, deviceScratch);
+         else if (variant == 2)
+            return partitionCopyDevice(deviceInput, deviceOutput, deviceRejected, len, BelowHalf(), deviceCount, deviceScratch);
+         else
+            return stablePartitionDevice(deviceInput, deviceOutput, len, BelowHalf(), deviceCount, deviceScratch);
+      }, result.times));
+
+      if (variant > 0)
+      {
+         wbCheck(cudaMemcpy(&count, deviceCount, sizeof(long long), cudaMemcpyDeviceToHost));
+         wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, len * sizeof(float), cudaMemcpyDeviceToHost));
+         if (variant == 2 && expectedCount < len)
+            wbCheck(cudaMemcpy(&hostOutput[expectedCount], deviceRejected, (len - expectedCount) * sizeof(float),
+                               cudaMemcpyDeviceToHost));
+      }
+      long long checked = variant < 2 ? expectedCount : len;
+      bool correct = count == expectedCount && std::equal(expected.begin(), expected.begin() + checked, hostOutput.begin());
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceRejected);
+   cudaFree(deviceCount);
+   cudaFree(deviceScratch);
+   return 0;
+}
+
+int benchmarkSort(const Options& options, int len)
+{
+   std::vector<float> hostKeys = randomValues(len, -1.0f, 1.0f, 10);
+   std::vector<float> expected = hostKeys;
+   std::sort(expected.begin(), expected.end());
+   std::vector<float> hostOutput(len);
+   std::vector<unsigned int> hostValues(len);
+
+   float * deviceUnsorted;
+   float * deviceKeys;
+   unsigned int * deviceValues;
+   void * deviceScratch;
+   wbCheck(cudaMalloc((void **) &deviceUnsorted, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceKeys, len * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceValues, len * sizeof(unsigned int)));
+   wbCheck(cudaMalloc(&deviceScratch, radixSortScratchBytes<float, unsigned int>(len)));
+   wbCheck(cudaMemcpy(deviceUnsorted, &hostKeys[0], len * sizeof(float), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "std-sort", "radix-keys", "radix-pairs" };
+
+   for (int variant = 0; variant < 3; ++variant)
+   {
+      Result result;
+      result.benchmark = "sort";
+      result.variant = variants[variant];
+      result.shape = std::to_string(len);
+      result.work = len;
+      result.unit = "Gkeys/s";
+
+      wbCheck(timeRuns(options, [&]() -> cudaError_t {
+         if (variant == 0)
+         {
+            hostOutput = hostKeys;
+            std::sort(hostOutput.begin(), hostOutput.end());
+            return cudaSuccess;
+         }
+         cudaError_t err = cudaMemcpy(deviceKeys, deviceUnsorted, len * sizeof(float), cudaMemcpyDeviceToDevice);
+         if (err != cudaSuccess)
+            return err;
+         if (variant == 1)
+            return radixSortDevice<float>(deviceKeys, len, deviceScratch);
+         return radixSortDevice<float, unsigned int>(deviceKeys, deviceValues, len, deviceScratch);
+      }, result.times));
+
+      if (variant > 0)
+         wbCheck(cudaMemcpy(&hostOutput[0], deviceKeys, len * sizeof(float), cudaMemcpyDeviceToHost));
+      bool correct = hostOutput == expected;
+      if (variant == 2)
+      {
+         // sort once more with the indices as values: they must follow their
+         // keys, in their original order among equal keys
+         wbCheck(cudaMemcpy(deviceKeys, deviceUnsorted, len * sizeof(float), cudaMemcpyDeviceToDevice));
+         for (int i = 0; i < len; ++i)
+            hostValues[i] = i;
+         wbCheck(cudaMemcpy(deviceValues, &hostValues[0], len * sizeof(unsigned int), cudaMemcpyHostToDevice));
+         wbCheck((radixSortDevice<float, unsigned int>(deviceKeys, deviceValues, len, deviceScratch)));
+         wbCheck(cudaMemcpy(&hostValues[0], deviceValues, len * sizeof(unsigned int), cudaMemcpyDeviceToHost));
+         for (int i = 0; i < len && correct; ++i)
+            correct = hostKeys[hostValues[i]] == expected[i] && (i == 0 || expected[i] != expected[i - 1] || hostValues[i] > hostValues[i - 1]);
+      }
+      result.verified = correct ? "yes" : "no";
+      printResult(options, result);
+   }
+
+   cudaFree(deviceUnsorted);
+   cudaFree(deviceKeys);
+   cudaFree(deviceValues);
+   cudaFree(deviceScratch);
+   return 0;
+}
+
+int benchmarkConvolution(const Options& options, int width, int height, const std::vector<int>& maskSizes)
+{
+   const int channels = 3;
+   size_t imageLength = (size_t) width * height * channels;
+   std::vector<float> hostInput = randomValues(imageLength, 0.0f, 1.0f, 5);
+   std::vector<float> hostReference(imageLength);
+   std::vector<float> hostOutput(imageLength);
+
+   float * deviceInput;
+   float * deviceOutput;
+   float * deviceIntermediate;
+   float * deviceMask;
+   float * deviceFactors;
+   void * deviceScratch;
+   int largestMask = *std::max_element(maskSizes.begin(), maskSizes.end());
+   wbCheck(cudaMalloc((void **) &deviceInput, imageLength * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, imageLength * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceIntermediate, imageLength * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceMask, largestMask * largestMask * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceFactors, 2 * largestMask * sizeof(float)));
+   size_t scratchBytes = 0;
+   for (int maskWidth : maskSizes)
+      if (fftConvolutionSupported(maskWidth, maskWidth))
+         scratchBytes = std::max(scratchBytes, fftConvolutionScratchBytes(height, width, maskWidth, maskWidth));
+   wbCheck(cudaMalloc(&deviceScratch, scratchBytes));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], imageLength * sizeof(float), cudaMemcpyHostToDevice));
+
+   for (int maskWidth : maskSizes)
+   {
+      std::vector<float> column = randomValues(maskWidth, 0.0f, 1.0f / maskWidth, 6);
+      std::vector<float> row = randomValues(maskWidth, 0.0f, 1.0f / maskWidth, 8);
+      std::vector<float> hostMask(maskWidth * maskWidth);
+      for (int i = 0; i < maskWidth; ++i)
+         for (int j = 0; j < maskWidth; ++j)
+            hostMask[i * maskWidth + j] = column[i] * row[j];
+      wbCheck(cudaMemcpy(deviceMask, &hostMask[0], hostMask.size() * sizeof(float), cudaMemcpyHostToDevice));
+
+      std::string shape = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels) +
+                          "/" + std::to_string(maskWidth) + "x" + std::to_string(maskWidth);
+
+      Result result;
+      result.benchmark = "convolution";
+      result.variant = convolution2DPath(maskWidth, maskWidth);
+      result.shape = shape;
+      result.work = 2.0 * imageLength * maskWidth * maskWidth;
+      result.unit = "GFLOP/s";
+      result.verified = "-";
+
+      wbCheck(timeRuns(options, [&]() {
+         return convolution2D(deviceInput, deviceOutput, height, width, channels, deviceMask, maskWidth, maskWidth);
+      }, result.times));
+      printResult(options, result);
+      wbCheck(cudaMemcpy(&hostReference[0], deviceOutput, imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+
+      if (result.variant == "host")
+      {
+         // the kernels behind convolution2D on a GPU, run by the CPU executor
+         Result emulated;
+         emulated.benchmark = "convolution";
+         emulated.variant = convolutionIsSpecialized(maskWidth, maskWidth) ? "tiled-emulated" : "generic-emulated";
+         emulated.shape = shape;
+         emulated.work = result.work;
+         emulated.unit = "GFLOP/s";
+
+         wbCheck(timeRuns(options, [&]() {
+            return convolution2DKernels(deviceInput, deviceOutput, height, width, channels, deviceMask, maskWidth, maskWidth);
+         }, emulated.times));
+         wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+
+         bool correct = true;
+         for (size_t i = 0; i < imageLength && correct; ++i)
+            correct = closeTo(hostReference[i], hostOutput[i], 1e-4);
+         emulated.verified = correct ? "yes" : "no";
+         printResult(options, emulated);
+      }
+
+      if (fftConvolutionSupported(maskWidth, maskWidth))
+      {
+         Result fft;
+         fft.benchmark = "convolution";
+         fft.variant = "fft";
+         fft.shape = shape;
+         fft.work = result.work;
+         fft.unit = "GFLOP/s";
+
+         wbCheck(timeRuns(options, [&]() {
+            return fftConvolution(deviceInput, deviceOutput, height, width, channels, deviceMask, maskWidth, maskWidth,
+                                  deviceScratch);
+         }, fft.times));
+         wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+
+         bool correct = true;
+         for (size_t i = 0; i < imageLength && correct; ++i)
+            correct = closeTo(hostReference[i], hostOutput[i], 1e-4);
+         fft.verified = correct ? "yes" : "no";
+         printResult(options, fft);
+      }
+
+      std::vector<float> factors(2 * maskWidth);
+      if (!separableConvolutionSupported(maskWidth, maskWidth, channels) ||
+          !factorSeparableMask(&hostMask[0], maskWidth, maskWidth, &factors[0], &factors[maskWidth]))
+         continue;
+      wbCheck(cudaMemcpy(deviceFactors, &factors[0], factors.size() * sizeof(float), cudaMemcpyHostToDevice));
+
+      Result separable;
+      separable.benchmark = "convolution";
+      separable.variant = "separable";
+      separable.shape = shape;
+      separable.work = 2.0 * imageLength * 2 * maskWidth;
+      separable.unit = "GFLOP/s";
+
+      wbCheck(timeRuns(options, [&]() {
+         return separableConvolution(deviceInput, deviceOutput, deviceIntermediate, height, width, channels,
+                                     deviceFactors, maskWidth, deviceFactors + maskWidth, maskWidth);
+      }, separable.times));
+      wbCheck(cudaMemcpy(&hostOutput[0], deviceOutput, imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+
+      bool correct = true;
+      for (size_t i = 0; i < imageLength && correct; ++i)
+         correct = closeTo(hostReference[i], hostOutput[i], 1e-4);
+      separable.verified = correct ? "yes" : "no";
+      printResult(options, separable);
+   }
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceIntermediate);
+   cudaFree(deviceMask);
+   cudaFree(deviceFactors);
+   cudaFree(deviceScratch);
+   return 0;
+}
+
+int benchmarkFilterChain(const Options& options, int width, int height)
+{
+   const int channels = 3;
+   size_t imageLength = (size_t) width * height * channels;
+   std::vector<float> hostInput = randomValues(imageLength, 0.0f, 1.0f, 9);
+   std::vector<float> hostReference(imageLength);
+   std::vector<float> hostOutput(imageLength);
+
+   std::vector<float> blur(25, 1.0f / 25);
+   float sharpen[9] = { 0.0f, -1.0f, 0.0f, -1.0f, 5.0f, -1.0f, 0.0f, -1.0f, 0.0f };
+
+   FilterChain stages[5];
+   stages[0].convolve(&blur[0], 5, 5);
+   stages[1].clamp(0.0f, 1.0f);
+   stages[2].convolve(sharpen, 3, 3);
+   stages[3].affine(1.2f, -0.1f);
+   stages[4].clamp(0.0f, 1.0f);
+   FilterChain fused;
+   fused.convolve(&blur[0], 5, 5).clamp(0.0f, 1.0f).convolve(sharpen, 3, 3).affine(1.2f, -0.1f).clamp(0.0f, 1.0f);
+
+   float * deviceImages[3];
+   for (int i = 0; i < 3; ++i)
+      wbCheck(cudaMalloc((void **) &deviceImages[i], imageLength * sizeof(float)));
+   wbCheck(cudaMemcpy(deviceImages[0], &hostInput[0], imageLength * sizeof(float), cudaMemcpyHostToDevice));
+
+   const char * variants[] = { "stages", "fused" };
+   for (int variant = 0; variant < 2; ++variant)
+   {
+      Result result;
+      result.benchmark = "filter-chain";
+      result.variant = variants[variant];
+      result.shape = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+      result.work = 2.0 * imageLength * (25 + 9);
+      result.unit = "GFLOP/s";
+
+      // the stages alternate between deviceImages[1] and [2] and end in [1]
+      wbCheck(timeRuns(options, [&]() {
+         if (variant == 1)
+            return fused.run(deviceImages[0], deviceImages[1], height, width, channels);
+         cudaError_t err = stages[0].run(deviceImages[0], deviceImages[1], height, width, channels);
+         for (int s = 1; s < 5 && err == cudaSuccess; ++s)
+            err = stages[s].run(deviceImages[2 - s % 2], deviceImages[1 + s % 2], height, width, channels);
+         return err;
+      }, result.times));
+      wbCheck(cudaMemcpy(variant == 0 ? &hostReference[0] : &hostOutput[0], deviceImages[1],
+                         imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+
+      if (variant == 0)
+         result.verified = "-";
+      else
+      {
+         bool correct = true;
+         for (size_t i = 0; i < imageLength && correct; ++i)
+            correct = closeTo(hostReference[i], hostOutput[i], 1e-4);
+         result.verified = correct ? "yes" : "no";
+      }
+      printResult(options, result);
+   }
+
+   for (int i = 0; i < 3; ++i)
+      cudaFree(deviceImages[i]);
+   return 0;
+}
+
+int benchmarkHistogram(const Options& options, int width, int height)
+{
+   using namespace fusedHistogramEqualization;
+
+   const int channels = 3;
+   long pixels = (long) width * height;
+   long imageLength = pixels * channels;
+   std::vector<float> hostInput = randomValues(imageLength, 0.0f, 1.0f, 7);
+
+   float * deviceInput;
+   float * deviceOutput;
+   unsigned int * deviceHistogram;
+   float * deviceLut;
+   wbCheck(cudaMalloc((void **) &deviceInput, imageLength * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceOutput, imageLength * sizeof(float)));
+   wbCheck(cudaMalloc((void **) &deviceHistogram, HISTOGRAM_LENGTH * sizeof(unsigned int)));
+   wbCheck(cudaMalloc((void **) &deviceLut, HISTOGRAM_LENGTH * sizeof(float)));
+   wbCheck(cudaMemcpy(deviceInput, &hostInput[0], imageLength * sizeof(float), cudaMemcpyHostToDevice));
+
+   Result result;
+   result.benchmark = "histogram";
+   result.variant = "fused";
+   result.shape = std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+   result.work = 3.0 * imageLength * sizeof(float); // two reads of the image, one write
+   result.unit = "GB/s";
+   result.verified = "-";
+
+   wbCheck(timeRuns(options, [&]() -> cudaError_t {
+      cudaError_t err = cudaMemset(deviceHistogram, 0, HISTOGRAM_LENGTH * sizeof(unsigned int));
+      if (err != cudaSuccess)
+         return err;
+      launchKernel(histogramOfFloatImage, dim3(gridSize(pixels, HISTOGRAM_BLOCK_SIZE, HISTOGRAM_MAX_BLOCKS), 1, 1),
+                   dim3(HISTOGRAM_BLOCK_SIZE, 1, 1), deviceInput, pixels, channels, deviceHistogram);
+      launchKernel(buildEqualizationLut, dim3(1, 1, 1), dim3(HISTOGRAM_LENGTH, 1, 1), deviceHistogram, pixels, deviceLut);
+      launchKernel(applyEqualizationLut, dim3(gridSize(imageLength, LUT_BLOCK_SIZE, LUT_MAX_BLOCKS), 1, 1),
+                   dim3(LUT_BLOCK_SIZE, 1, 1), deviceInput, deviceOutput, imageLength, deviceLut);
+      return cudaGetLastError();
+   }, result.times));
+   printResult(options, result);
+
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceHistogram);
+   cudaFree(deviceLut);
+   return 0;
+}
+
+int main(int argc, char ** argv)
+{
+   Options options;
+   if (!parseOptions(argc, argv, options))
+   {
+      fprintf(stderr, "Usage: %s [--benchmarks=reduction,matmul,batched-gemm,scan,segmented,compaction,sort,convolution,filter-chain,histogram] "
+                      "[--vector-sizes=N,...] [--matrix-sizes=RxCxK,...] [--batch-sizes=N,...] "
+                      "[--image-sizes=WxH,...] [--mask-sizes=M,...] "
+                      "[--warmup=N] [--repetitions=N] [--format=csv|json]\n", argv[0]);
+      return 1;
+   }
+
+   cudaDeviceProp deviceProp;
+   wbCheck(cudaGetDeviceProperties(&deviceProp, 0));
+   fprintf(stderr, "Device: %s\n", deviceProp.name);
+
+   printHeader(options);
+
+   if (selected(options, "reduction"))
+      for (long len : options.vectorSizes)
+         if (benchmarkReduction(options, (int) len) != 0)
+            return -1;
+
+   if (selected(options, "matmul"))
+      for (const std::vector<int>& shape : options.matrixSizes)
+         if (benchmarkMatrixMultiplication(options, shape[0], shape[1], shape[2]) != 0)
+            return -1;
+
+   if (selected(options, "batched-gemm"))
+      for (int size : options.batchSizes)
+         if (benchmarkBatchedGemm(options, size) != 0)
+            return -1;
+
+   if (selected(options, "scan"))
+      for (long len : options.vectorSizes)
+         if (benchmarkScan(options, (int) len) != 0)
+            return -1;
+
+   if (selected(options, "segmented"))
+      for (long len : options.vectorSizes)
+         if (benchmarkSegmented(options, (int) len) != 0)
+            return -1;
+
+   if (selected(options, "compaction"))
+      for (long len : options.vectorSizes)
+         if (benchmarkCompaction(options, (int) len) != 0)
+            return -1;
+
+   if (selected(options, "sort"))
+      for (long len : options.vectorSizes)
+         if (benchmarkSort(options, (int) len) != 0)
+            return -1;
+
+   if (selected(options, "convolution") && !options.maskSizes.empty())
+      for (const std::vector<int>& size : options.imageSizes)
+         if (benchmarkConvolution(options, size[0], size[1], options.maskSizes) != 0)
+            return -1;
+
+   if (selected(options, "filter-chain"))
+      for (const std::vector<int>& size : options.imageSizes)
+         if (benchmarkFilterChain(options, size[0], size[1]) != 0)
+            return -1;
+
+   if (selected(options, "histogram"))
+      for (const std::vector<int>& size : options.imageSizes)
+         if (benchmarkHistogram(options, size[0], size[1]) != 0)
+            return -1;
+
+   return 0;
+}
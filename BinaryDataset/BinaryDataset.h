@@ -0,0 +1,291 @@
+// Binary container for the lab datasets.
+//
+// The text datasets are parsed character by character by wbImport, which
+// dominates the run time of most labs ("Importing data and creating memory on
+// host" is ~60 ms for 12670 floats). A .wbb file stores the same values in
+// native little-endian form behind a 64-byte header, and wbBinary_import maps
+// it into memory: the cost becomes the page faults on first touch, and no
+// byte is parsed or copied.
+//
+// Layout:
+//    offset  0   char[8]   magic "WBBINARY"
+//    offset  8   uint32    format version (1)
+//    offset 12   uint32    element type (wbBinary_type)
+//    offset 16   uint32    rank: 1 for a vector, 2 for a matrix (rows, columns),
+//                          3 for an image (height, width, channels)
+//    offset 20   uint32    reserved, 0
+//    offset 24   uint64[3] shape, unused dimensions are 1
+//    offset 48   uint64    payload offset, a multiple of 64
+//    offset 56   uint64    payload size in bytes
+//
+// Text datasets are converted with BinaryDataset/ConvertDataset.cpp.
+// wbBinary_import falls back to wbImport for files that are not .wbb, so a
+// lab can switch to it without changing its datasets. Memory returned by
+// wbBinary_import must be released with wbBinary_free.
+
+#ifndef BINARY_DATASET_H
+#define BINARY_DATASET_H
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WB_BINARY_MAGIC "WBBINARY"
+#define WB_BINARY_VERSION 1
+#define WB_BINARY_ALIGNMENT 64
+
+enum wbBinary_type
+{
+   wbBinary_float32 = 1,
+   wbBinary_int32 = 2,
+   wbBinary_uint8 = 3
+};
+
+struct wbBinary_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t type;
+   uint32_t rank;
+   uint32_t reserved;
+   uint64_t shape[3];
+   uint64_t payloadOffset;
+   uint64_t payloadBytes;
+};
+
+static_assert(sizeof(wbBinary_header) == WB_BINARY_ALIGNMENT, "the header fills exactly one aligned slot");
+
+inline size_t wbBinary_typeSize(uint32_t type)
+{
+   switch (type)
+   {
+   case wbBinary_float32: return 4;
+   case wbBinary_int32: return 4;
+   case wbBinary_uint8: return 1;
+   }
+   return 0;
+}
+
+// The header of a dataset whose payload follows it directly.
+inline wbBinary_header wbBinary_makeHeader(wbBinary_type type, unsigned rank, const uint64_t * shape)
+{
+   wbBinary_header header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, WB_BINARY_MAGIC, sizeof(header.magic));
+   header.version = WB_BINARY_VERSION;
+   header.type = type;
+   header.rank = rank;
+
+   uint64_t elements = 1;
+   for (unsigned i = 0; i < 3; ++i)
+   {
+      header.shape[i] = i < rank ? shape[i] : 1;
+      elements *= header.shape[i];
+   }
+   header.payloadOffset = WB_BINARY_ALIGNMENT;
+   header.payloadBytes = elements * wbBinary_typeSize(type);
+   return header;
+}
+
+// Writes a dataset; returns false on an I/O error.
+inline bool wbBinary_export(const char * file, const void * data, wbBinary_type type,
+                            unsigned rank, const uint64_t * shape)
+{
+   wbBinary_header header = wbBinary_makeHeader(type, rank, shape);
+
+   FILE * out = fopen(file, "wb");
+   if (!out)
+      return false;
+
+   bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+   if (ok && header.payloadBytes > 0)
+      ok = fwrite(data, header.payloadBytes, 1, out) == 1;
+   return (fclose(out) == 0) && ok;
+}
+
+namespace wbBinaryDetail
+{
+
+struct Mapping
+{
+   void * base;
+   size_t length;
+};
+
+// Payload pointer -> mapping, so that wbBinary_free can tell mapped datasets
+// from the malloc'ed ones returned by the wbImport fallback.
+inline std::map<const void *, Mapping>& mappings()
+{
+   static std::map<const void *, Mapping> registry;
+   return registry;
+}
+
+inline std::mutex& mappingsLock()
+{
+   static std::mutex lock;
+   return lock;
+}
+
+} // namespace wbBinaryDetail
+
+// Reads and checks the header of an open .wbb file: the rank is 1, 2 or 3,
+// the unused dimensions are 1, the payload holds exactly the elements of the
+// shape, at most maxElements of them, and lies within the file after the
+// header.
+inline bool wbBinary_readHeader(int fd, wbBinary_type type, wbBinary_header * header,
+                                uint64_t maxElements = INT_MAX)
+{
+   struct stat info;
+   if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(wbBinary_header) ||
+       pread(fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header))
+      return false;
+
+   if (memcmp(header->magic, WB_BINARY_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != WB_BINARY_VERSION || header->type != (uint32_t) type ||
+       header->rank < 1 || header->rank > 3)
+      return false;
+
+   uint64_t elements = 1;
+   for (unsigned i = 0; i < 3; ++i)
+   {
+      uint64_t dimension = header->shape[i];
+      if (dimension > INT_MAX || (i >= header->rank && dimension != 1))
+         return false;
+      if (dimension != 0 && elements > maxElements / dimension)
+         return false;
+      elements *= dimension;
+   }
+
+   // elements <= maxElements, so the products below cannot overflow for any
+   // maxElements up to 2^60
+   uint64_t size = (uint64_t) info.st_size;
+   return elements <= maxElements && header->payloadBytes == elements * wbBinary_typeSize(type) &&
+          header->payloadOffset % WB_BINARY_ALIGNMENT == 0 &&
+          header->payloadOffset >= sizeof(wbBinary_header) && header->payloadOffset <= size &&
+          header->payloadBytes <= size - header->payloadOffset;
+}
+
+// True when file starts with the .wbb magic, valid or not.
+inline bool wbBinary_isContainer(const char * file)
+{
+   char magic[sizeof(((wbBinary_header *) 0)->magic)];
+   int fd = open(file, O_RDONLY);
+   if (fd < 0)
+      return false;
+   bool found = pread(fd, magic, sizeof(magic), 0) == (ssize_t) sizeof(magic) &&
+                memcmp(magic, WB_BINARY_MAGIC, sizeof(magic)) == 0;
+   close(fd);
+   return found;
+}
+
+// Maps a .wbb file. Returns its payload and fills header, or returns NULL if
+// the file is missing or is not a valid container of the expected type.
+inline void * wbBinary_map(const char * file, wbBinary_type type, wbBinary_header * header)
+{
+   int fd = open(file, O_RDONLY);
+   if (fd < 0)
+      return NULL;
+
+   if (!wbBinary_readHeader(fd, type, header))
+   {
+      close(fd);
+      return NULL;
+   }
+
+   // private and writable: a lab that updates its input in place gets
+   // copy-on-write pages and the file is never modified
+   size_t length = (size_t) (header->payloadOffset + header->payloadBytes);
+   void * base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED)
+      return NULL;
+   // advice values are not flags: one call each
+   madvise(base, length, MADV_SEQUENTIAL);
+   madvise(base, length, MADV_WILLNEED);
+
+   void * payload = (char *) base + header->payloadOffset;
+   std::lock_guard<std::mutex> guard(wbBinaryDetail::mappingsLock());
+   wbBinaryDetail::mappings()[payload] = wbBinaryDetail::Mapping{ base, length };
+   return payload;
+}
+
+// Releases memory returned by wbBinary_import or wbBinary_map.
+inline void wbBinary_free(void * data)
+{
+   {
+      std::lock_guard<std::mutex> guard(wbBinaryDetail::mappingsLock());
+      std::map<const void *, wbBinaryDetail::Mapping>::iterator found = wbBinaryDetail::mappings().find(data);
+      if (found != wbBinaryDetail::mappings().end())
+      {
+         munmap(found->second.base, found->second.length);
+         wbBinaryDetail::mappings().erase(found);
+         return;
+      }
+   }
+   free(data);
+}
+
+#ifndef BINARY_DATASET_NO_WB
+
+// Drop-in replacements for the wbImport overloads of the vector and matrix
+// labs: .wbb files are mapped, anything else goes through wbImport. A .wbb
+// file whose header does not check out is an error (NULL, with the sizes
+// set to 0), not text.
+
+inline void * wbBinary_import(const char * file, int * length)
+{
+   wbBinary_header header;
+   if (void * data = wbBinary_map(file, wbBinary_float32, &header))
+   {
+      *length = (int) (header.shape[0] * header.shape[1] * header.shape[2]);
+      return data;
+   }
+   if (wbBinary_isContainer(file))
+   {
+      wbLog(ERROR, "Invalid or unreadable binary dataset ", file);
+      *length = 0;
+      return NULL;
+   }
+   void * data = wbImport(file, length);
+   if (data == NULL)
+      *length = 0;
+   return data;
+}
+
+inline void * wbBinary_import(const char * file, int * rows, int * columns)
+{
+   wbBinary_header header;
+   if (void * data = wbBinary_map(file, wbBinary_float32, &header))
+   {
+      *rows = (int) header.shape[0];
+      *columns = (int) (header.shape[1] * header.shape[2]);
+      return data;
+   }
+   if (wbBinary_isContainer(file))
+   {
+      wbLog(ERROR, "Invalid or unreadable binary dataset ", file);
+      *rows = 0;
+      *columns = 0;
+      return NULL;
+   }
+   void * data = wbImport(file, rows, columns);
+   if (data == NULL)
+   {
+      *rows = 0;
+      *columns = 0;
+   }
+   return data;
+}
+
+#endif // BINARY_DATASET_NO_WB
+
+#endif // BINARY_DATASET_H
@@ -0,0 +1,145 @@
+// Converts a lab dataset to the .wbb binary container of BinaryDataset.h.
+//
+//    ConvertDataset input.raw output.wbb
+//
+// Accepted inputs:
+//    vector   first line "length", then the values
+//    matrix   first line "rows columns", then the values in row-major order
+//    image    binary PPM (P6) or PGM (P5), stored as height x width x channels
+//             floats in [0, 1], the values wbImport gives for images
+
+#define BINARY_DATASET_NO_WB
+#include "BinaryDataset.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+bool readFile(const char * file, std::vector<char>& contents)
+{
+   FILE * in = fopen(file, "rb");
+   if (!in)
+      return false;
+
+   fseek(in, 0, SEEK_END);
+   long size = ftell(in);
+   fseek(in, 0, SEEK_SET);
+
+   contents.resize(size + 1);
+   bool ok = size == 0 || fread(&contents[0], size, 1, in) == 1;
+   contents[size] = '\0'; // strtof stops at the terminator
+   fclose(in);
+   return ok;
+}
+
+bool convertImage(const std::vector<char>& contents, const char * output)
+{
+   int channels = contents[1] == '6' ? 3 : 1;
+
+   // header: magic, width, height, maximum value, then one whitespace byte
+   const char * cursor = &contents[2];
+   char * end;
+   long values[3];
+   for (int i = 0; i < 3; ++i)
+   {
+      while (*cursor == '#' || *cursor == ' ' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t')
+      {
+         if (*cursor == '#')
+            while (*cursor && *cursor != '\n')
+               ++cursor;
+         else
+            ++cursor;
+      }
+      values[i] = strtol(cursor, &end, 10);
+      cursor = end;
+   }
+   ++cursor;
+
+   long width = values[0];
+   long height = values[1];
+   long maximum = values[2];
+   size_t count = (size_t) width * height * channels;
+   if (width <= 0 || height <= 0 || maximum <= 0 || maximum > 255 ||
+       (size_t) (cursor - &contents[0]) + count > contents.size() - 1)
+   {
+      fprintf(stderr, "Malformed image header\n");
+      return false;
+   }
+
+   std::vector<float> pixels(count);
+   const unsigned char * bytes = (const unsigned char *) cursor;
+   for (size_t i = 0; i < count; ++i)
+      pixels[i] = bytes[i] / (float) maximum;
+
+   uint64_t shape[3] = { (uint64_t) height, (uint64_t) width, (uint64_t) channels };
+   return wbBinary_export(output, &pixels[0], wbBinary_float32, 3, shape);
+}
+
+bool convertValues(const std::vector<char>& contents, const char * output)
+{
+   // the first line holds the shape: one number for a vector, two for a matrix
+   const char * cursor = &contents[0];
+   char * end;
+   uint64_t shape[2];
+   unsigned rank = 0;
+   while (rank < 2)
+   {
+      while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+         ++cursor;
+      if (*cursor == '\n' || *cursor == '\0')
+         break;
+      long dimension = strtol(cursor, &end, 10);
+      if (end == cursor || dimension < 0)
+      {
+         fprintf(stderr, "Malformed shape line\n");
+         return false;
+      }
+      shape[rank++] = (uint64_t) dimension;
+      cursor = end;
+   }
+   if (rank == 0)
+   {
+      fprintf(stderr, "Missing shape line\n");
+      return false;
+   }
+
+   size_t count = rank == 1 ? shape[0] : shape[0] * shape[1];
+   std::vector<float> values(count);
+   for (size_t i = 0; i < count; ++i)
+   {
+      values[i] = strtof(cursor, &end);
+      if (end == cursor)
+      {
+         fprintf(stderr, "Expected %zu values, found %zu\n", count, i);
+         return false;
+      }
+      cursor = end;
+   }
+
+   return wbBinary_export(output, count ? &values[0] : NULL, wbBinary_float32, rank, shape);
+}
+
+int main(int argc, char ** argv)
+{
+   if (argc != 3)
+   {
+      fprintf(stderr, "Usage: %s input output.wbb\n", argv[0]);
+      return 1;
+   }
+
+   std::vector<char> contents;
+   if (!readFile(argv[1], contents))
+   {
+      fprintf(stderr, "Cannot read %s\n", argv[1]);
+      return 1;
+   }
+
+   bool isImage = contents.size() > 2 && contents[0] == 'P' && (contents[1] == '5' || contents[1] == '6');
+   bool ok = isImage ? convertImage(contents, argv[2]) : convertValues(contents, argv[2]);
+   if (!ok)
+   {
+      fprintf(stderr, "Cannot convert %s\n", argv[1]);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,170 @@
+// Size-class pool of device buffers.
+//
+// Pipelines that run the same stages frame after frame ask for the same
+// buffer sizes every time. Instead of a cudaMalloc / cudaFree pair per stage,
+// they borrow buffers from the pool and give them back:
+//
+//    DeviceBufferPool pool;
+//    float * image = pool.acquire<float>(length);   // cudaMalloc only if the
+//    ...                                            // size class is empty
+//    pool.release(image, length);                   // back to its size class
+//
+// Requests are rounded up to a size class: 256 bytes, then four classes per
+// power of two (5/4, 6/4, 7/4 and 8/4 of it), so at most 25% of a buffer is
+// padding. A released buffer is kept on the free list of its class and is
+// handed out again to the next request of that class; the device memory is
+// returned with cudaFree only by trim() or when the pool is destroyed.
+//
+// The counters tell how often the pool had to go to cudaMalloc, so a
+// pipeline can check that its steady state allocates nothing.
+
+#ifndef DEVICE_BUFFER_POOL_H
+#define DEVICE_BUFFER_POOL_H
+
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#define BUFFER_POOL_MIN_BYTES 256
+#define BUFFER_POOL_CLASSES_PER_DOUBLING 4
+
+class DeviceBufferPool
+{
+public:
+   struct Counters
+   {
+      size_t acquisitions;   // calls to acquire
+      size_t allocations;    // acquisitions served by cudaMalloc
+      size_t bytesAllocated; // device memory held by the pool, in use or free
+      size_t buffersInUse;
+   };
+
+   DeviceBufferPool() : freeLists(64 * BUFFER_POOL_CLASSES_PER_DOUBLING)
+   {
+      counters.acquisitions = 0;
+      counters.allocations = 0;
+      counters.bytesAllocated = 0;
+      counters.buffersInUse = 0;
+   }
+
+   ~DeviceBufferPool()
+   {
+      trim();
+   }
+
+   // A buffer of at least bytes bytes, or NULL if cudaMalloc fails.
+   void * acquire(size_t bytes)
+   {
+      size_t index;
+      size_t rounded = sizeClass(bytes, &index);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      ++counters.acquisitions;
+
+      std::vector<void *>& freeList = freeLists[index];
+      if (!freeList.empty())
+      {
+         void * buffer = freeList.back();
+         freeList.pop_back();
+         ++counters.buffersInUse;
+         return buffer;
+      }
+
+      void * buffer = NULL;
+      if (cudaMalloc(&buffer, rounded) != cudaSuccess)
+         return NULL;
+      ++counters.allocations;
+      counters.bytesAllocated += rounded;
+      ++counters.buffersInUse;
+      return buffer;
+   }
+
+   template <typename T>
+   T * acquire(size_t count)
+   {
+      return (T *) acquire(count * sizeof(T));
+   }
+
+   // Gives back a buffer obtained with acquire(bytes); bytes must be the size
+   // that was requested (or any size of the same class).
+   void release(void * buffer, size_t bytes)
+   {
+      if (buffer == NULL)
+         return;
+
+      size_t index;
+      sizeClass(bytes, &index);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      freeLists[index].push_back(buffer);
+      --counters.buffersInUse;
+   }
+
+   template <typename T>
+   void release(T * buffer, size_t count)
+   {
+      release((void *) buffer, count * sizeof(T));
+   }
+
+   // Frees every buffer that is not in use.
+   void trim()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t index = 0; index < freeLists.size(); ++index)
+      {
+         size_t bytes = classBytes(index);
+         for (size_t i = 0; i < freeLists[index].size(); ++i)
+         {
+            cudaFree(freeLists[index][i]);
+            counters.bytesAllocated -= bytes;
+         }
+         freeLists[index].clear();
+      }
+   }
+
+   Counters getCounters()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      return counters;
+   }
+
+   // Bytes of the class of a request of bytes bytes, and the index of the class.
+   static size_t sizeClass(size_t bytes, size_t * index)
+   {
+      if (bytes <= BUFFER_POOL_MIN_BYTES)
+      {
+         *index = 0;
+         return BUFFER_POOL_MIN_BYTES;
+      }
+
+      // 2^power < bytes <= 2^(power + 1), rounded up to a quarter of 2^power
+      int power = 0;
+      while (((size_t) 2 << power) < bytes)
+         ++power;
+      size_t step = ((size_t) 1 << power) / BUFFER_POOL_CLASSES_PER_DOUBLING;
+      size_t steps = (bytes + step - 1) / step; // BUFFER_POOL_CLASSES_PER_DOUBLING + 1 ... 2 * BUFFER_POOL_CLASSES_PER_DOUBLING
+
+      *index = (power - 8) * BUFFER_POOL_CLASSES_PER_DOUBLING + (steps - BUFFER_POOL_CLASSES_PER_DOUBLING);
+      return steps * step;
+   }
+
+private:
+   static size_t classBytes(size_t index)
+   {
+      if (index == 0)
+         return BUFFER_POOL_MIN_BYTES;
+      size_t power = (index - 1) / BUFFER_POOL_CLASSES_PER_DOUBLING + 8;
+      size_t steps = (index - 1) % BUFFER_POOL_CLASSES_PER_DOUBLING + BUFFER_POOL_CLASSES_PER_DOUBLING + 1;
+      return steps * (((size_t) 1 << power) / BUFFER_POOL_CLASSES_PER_DOUBLING);
+   }
+
+   std::mutex mutex;
+   std::vector<std::vector<void *> > freeLists;
+   Counters counters;
+};
+
+#endif // DEVICE_BUFFER_POOL_H
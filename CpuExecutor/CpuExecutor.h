@@ -0,0 +1,785 @@
+// CPU execution backend for the __global__ kernels of the labs.
+//
+// Lets the lab sources be compiled by a plain C++17 compiler on hosts that
+// have no GPU (g++ -std=c++17 -O2 -pthread). A grid launch is split into
+// ranges of blocks that are spread over a work-stealing thread pool. All the
+// threads of one block run as fibers on a single worker, so __shared__
+// variables (thread_local statics) are private to the block, and
+// __syncthreads() is a real barrier: a thread that reaches it is suspended
+// until every other live thread of the block has reached it as well.
+//
+// Launch a kernel with cpuLaunch() where the CUDA source uses <<< >>>:
+//
+//    #ifdef __CUDACC__
+//        total<<< DimGrid, DimBlock >>>(deviceInput, deviceOutput, len);
+//    #else
+//        cpuLaunch(DimGrid, DimBlock, total, deviceInput, deviceOutput, len);
+//    #endif
+//
+// Code shared by both builds can use launchKernel(kernel, grid, block, args...)
+// instead, which expands to the <<< >>> launch under nvcc.
+//
+// Code that has both a kernel path and a host path takes the kernel path when
+// RUN_KERNELS is defined: always under nvcc, and without it when built with
+// -DEMULATE_KERNELS, which runs the kernels on this backend to test them
+// without a GPU.
+//
+// Under nvcc only the host helpers (cpuParallelFor, cpuThreadCount) and
+// launchKernel are defined. The number of worker threads defaults to the
+// number of cores and can be overridden with the CPU_EXECUTOR_THREADS
+// environment variable.
+
+#ifndef CPU_EXECUTOR_H
+#define CPU_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !(defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)))
+#include <ucontext.h>
+#endif
+
+#ifndef CPU_EXECUTOR_STACK_SIZE
+#define CPU_EXECUTOR_STACK_SIZE (64 * 1024) // stack of one emulated CUDA thread
+#endif
+
+namespace cpuExecutor
+{
+
+// Items [0, count) of a parallel loop; run() is called on disjoint subranges.
+class Job
+{
+public:
+   Job(size_t count, size_t grain) : pending(count), grain(grain > 0 ? grain : 1) {}
+   virtual ~Job() {}
+   virtual void run(size_t begin, size_t end) = 0;
+
+   std::atomic<size_t> pending; // items not yet run
+   size_t grain;                // ranges at most this long are not split further
+};
+
+struct Task
+{
+   Job * job;
+   size_t begin;
+   size_t end;
+};
+
+// Every worker owns a deque of tasks: it pushes and pops at the back, idle
+// workers steal from the front. A task is split in halves until it is no
+// longer than the job's grain, the upper half staying available for thieves.
+// Queue 0 is shared by the threads outside of the pool, which help executing
+// tasks while they wait for their own job.
+class ThreadPool
+{
+public:
+   static ThreadPool& instance()
+   {
+      static ThreadPool pool;
+      return pool;
+   }
+
+   unsigned threadCount() const { return queueCount; }
+
+   void execute(Job& job, size_t count)
+   {
+      if (count == 0)
+         return;
+
+      push(Task{ &job, 0, count });
+
+      Task task;
+      while (job.pending.load(std::memory_order_acquire) != 0)
+      {
+         if (findTask(task))
+            runTask(task);
+         else
+            std::this_thread::yield();
+      }
+   }
+
+   ~ThreadPool()
+   {
+      {
+         std::lock_guard<std::mutex> guard(sleepLock);
+         stopping = true;
+         ++epoch;
+      }
+      wakeUp.notify_all();
+      for (size_t i = 0; i < workers.size(); ++i)
+         workers[i].join();
+   }
+
+private:
+   struct Queue
+   {
+      std::mutex lock;
+      std::deque<Task> tasks;
+   };
+
+   ThreadPool() : queueCount(std::thread::hardware_concurrency()), sleepers(0), epoch(0), stopping(false)
+   {
+      if (const char * env = getenv("CPU_EXECUTOR_THREADS"))
+         queueCount = (unsigned) atoi(env);
+      if (queueCount == 0)
+         queueCount = 1;
+
+      queues.reset(new Queue[queueCount]);
+      for (unsigned i = 1; i < queueCount; ++i)
+         workers.emplace_back(&ThreadPool::workerLoop, this, i);
+   }
+
+   static unsigned& workerIndex()
+   {
+      static thread_local unsigned index = 0;
+      return index;
+   }
+
+   void push(const Task& task)
+   {
+      Queue& queue = queues[workerIndex()];
+      {
+         std::lock_guard<std::mutex> guard(queue.lock);
+         queue.tasks.push_back(task);
+      }
+      if (sleepers.load() > 0)
+      {
+         {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            ++epoch;
+         }
+         wakeUp.notify_all();
+      }
+   }
+
+   bool findTask(Task& task)
+   {
+      unsigned self = workerIndex();
+      for (unsigned i = 0; i < queueCount; ++i)
+      {
+         unsigned victim = (self + i) % queueCount;
+         Queue& queue = queues[victim];
+         std::lock_guard<std::mutex> guard(queue.lock);
+         if (queue.tasks.empty())
+            continue;
+
+         if (victim == self)
+         {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+         }
+         else
+         {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+         }
+         return true;
+      }
+      return false;
+   }
+
+   void runTask(Task task)
+   {
+      while (task.end - task.begin > task.job->grain)
+      {
+         size_t middle = task.begin + (task.end - task.begin) / 2;
+         push(Task{ task.job, middle, task.end });
+         task.end = middle;
+      }
+
+      Job * job = task.job;
+      job->run(task.begin, task.end);
+      job->pending.fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+   }
+
+   void workerLoop(unsigned index)
+   {
+      workerIndex() = index;
+
+      Task task;
+      for (;;)
+      {
+         bool found = false;
+         for (int spin = 0; spin < 64 && !found; ++spin)
+         {
+            found = findTask(task);
+            if (!found)
+               std::this_thread::yield();
+         }
+
+         if (!found)
+         {
+            sleepers.fetch_add(1);
+            uint64_t seenEpoch;
+            {
+               std::lock_guard<std::mutex> guard(sleepLock);
+               seenEpoch = epoch;
+            }
+            found = findTask(task);
+            if (!found)
+            {
+               std::unique_lock<std::mutex> guard(sleepLock);
+               wakeUp.wait(guard, [&] { return epoch != seenEpoch || stopping; });
+               if (stopping)
+                  return;
+            }
+            sleepers.fetch_sub(1);
+         }
+
+         if (found)
+            runTask(task);
+      }
+   }
+
+   unsigned queueCount;
+   std::unique_ptr<Queue[]> queues;
+   std::vector<std::thread> workers;
+
+   std::atomic<int> sleepers;
+   std::mutex sleepLock;
+   std::condition_variable wakeUp;
+   uint64_t epoch;
+   bool stopping;
+};
+
+template <typename Body>
+class ParallelForJob : public Job
+{
+public:
+   ParallelForJob(size_t count, size_t grain, const Body& body) : Job(count, grain), body(body) {}
+   void run(size_t begin, size_t end) { body(begin, end); }
+
+private:
+   const Body& body;
+};
+
+} // namespace cpuExecutor
+
+// Number of threads that execute a parallel loop or a grid (pool workers plus
+// the calling thread).
+inline unsigned cpuThreadCount()
+{
+   return cpuExecutor::ThreadPool::instance().threadCount();
+}
+
+// Calls body(begin, end) on disjoint subranges of [0, count), no longer than
+// grain, from all the pool threads. Returns when the whole range is done.
+template <typename Body>
+void cpuParallelFor(size_t count, size_t grain, const Body& body)
+{
+   if (count <= grain || cpuThreadCount() == 1)
+   {
+      if (count > 0)
+         body(0, count);
+      return;
+   }
+   cpuExecutor::ParallelForJob<Body> job(count, grain, body);
+   cpuExecutor::ThreadPool::instance().execute(job, count);
+}
+
+#ifdef __CUDACC__
+#define launchKernel(kernel, grid, block, ...) kernel<<< grid, block >>>(__VA_ARGS__)
+#else
+#define launchKernel(kernel, grid, block, ...) cpuLaunch(grid, block, kernel, __VA_ARGS__)
+#endif
+
+#if defined(__CUDACC__) || defined(EMULATE_KERNELS)
+#define RUN_KERNELS
+#endif
+
+#ifndef __CUDACC__
+
+#define __global__
+#define __device__
+#define __host__
+#define __constant__
+#define __forceinline__ inline
+#define __shared__ static thread_local
+
+struct uint3
+{
+   unsigned int x, y, z;
+};
+
+struct dim3
+{
+   unsigned int x, y, z;
+   dim3(unsigned int vx = 1, unsigned int vy = 1, unsigned int vz = 1) : x(vx), y(vy), z(vz) {}
+   dim3(uint3 v) : x(v.x), y(v.y), z(v.z) {}
+};
+
+inline thread_local uint3 threadIdx;
+inline thread_local uint3 blockIdx;
+inline thread_local dim3 blockDim;
+inline thread_local dim3 gridDim;
+
+const int warpSize = 32;
+
+namespace cpuExecutor
+{
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+// Saves the callee-saved registers on the current stack, stores the stack
+// pointer to *from and resumes the fiber whose stack pointer is to.
+__attribute__((naked, noinline)) static void switchStack(void ** /* from */, void * /* to */)
+{
+   __asm__ volatile(
+      "pushq %rbp\n\t"
+      "pushq %rbx\n\t"
+      "pushq %r12\n\t"
+      "pushq %r13\n\t"
+      "pushq %r14\n\t"
+      "pushq %r15\n\t"
+      "movq %rsp, (%rdi)\n\t"
+      "movq %rsi, %rsp\n\t"
+      "popq %r15\n\t"
+      "popq %r14\n\t"
+      "popq %r13\n\t"
+      "popq %r12\n\t"
+      "popq %rbx\n\t"
+      "popq %rbp\n\t"
+      "ret\n\t");
+}
+
+#endif
+
+// Runs the threads of one block at a time as fibers on the calling worker.
+// Every fiber is resumed in turn until it finishes or reaches __syncthreads();
+// a sweep over all the fibers therefore moves the whole block from one
+// barrier to the next.
+class BlockRunner
+{
+public:
+   static BlockRunner& local()
+   {
+      static thread_local BlockRunner runner;
+      return runner;
+   }
+
+   template <typename Launch>
+   void runBlock(const Launch& launch, size_t linearBlock)
+   {
+      gridDim = launch.grid;
+      blockDim = launch.block;
+      blockIdx.x = (unsigned int) (linearBlock % launch.grid.x);
+      blockIdx.y = (unsigned int) ((linearBlock / launch.grid.x) % launch.grid.y);
+      blockIdx.z = (unsigned int) (linearBlock / ((size_t) launch.grid.x * launch.grid.y));
+
+      unsigned int threads = launch.block.x * launch.block.y * launch.block.z;
+      entry = &Launch::runThread;
+      context = &launch;
+
+      if (threads == 1)
+      {
+         threadIdx = uint3{ 0, 0, 0 };
+         entry(context);
+         return;
+      }
+
+      prepare(threads);
+
+      unsigned int live = threads;
+      inFiber = true;
+      while (live > 0)
+      {
+         for (unsigned int i = 0; i < threads; ++i)
+         {
+            if (done[i])
+               continue;
+
+            threadIdx.x = i % launch.block.x;
+            threadIdx.y = (i / launch.block.x) % launch.block.y;
+            threadIdx.z = i / (launch.block.x * launch.block.y);
+            current = i;
+            resume(i);
+            if (done[i])
+               --live;
+         }
+      }
+      inFiber = false;
+   }
+
+   // Called by __syncthreads(): suspends the current fiber until the next sweep.
+   void barrier()
+   {
+      if (inFiber)
+         suspend(current);
+   }
+
+private:
+   BlockRunner() : entry(0), context(0), current(0), inFiber(false), stacks(0), stackCount(0) {}
+
+   ~BlockRunner()
+   {
+      if (stacks)
+         munmap(stacks, stackCount * (size_t) CPU_EXECUTOR_STACK_SIZE);
+   }
+
+   void prepare(unsigned int threads)
+   {
+      if (threads > stackCount)
+      {
+         if (stacks)
+            munmap(stacks, stackCount * (size_t) CPU_EXECUTOR_STACK_SIZE);
+
+         size_t bytes = threads * (size_t) CPU_EXECUTOR_STACK_SIZE;
+         void * memory = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+         if (memory == MAP_FAILED)
+            abort();
+         stacks = (char *) memory;
+         stackCount = threads;
+
+         // a guard page below each stack turns an overflow into a fault
+         long page = sysconf(_SC_PAGESIZE);
+         for (unsigned int i = 0; i < threads; ++i)
+            mprotect(stacks + i * (size_t) CPU_EXECUTOR_STACK_SIZE, page, PROT_NONE);
+
+#if !(defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)))
+         contexts.resize(threads);
+#endif
+         fiberStack.resize(threads);
+         done.resize(threads);
+      }
+
+      for (unsigned int i = 0; i < threads; ++i)
+      {
+         done[i] = false;
+         initFiber(i);
+      }
+   }
+
+   static void fiberMain()
+   {
+      BlockRunner& runner = local();
+      runner.entry(runner.context);
+      runner.done[runner.current] = true;
+      runner.suspend(runner.current);
+   }
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+   void initFiber(unsigned int i)
+   {
+      // top of stack: a null return address for fiberMain (keeping the ABI
+      // alignment at its entry), the address switchStack returns to and the
+      // six callee-saved registers it pops
+      void ** top = (void **) (stacks + (i + 1) * (size_t) CPU_EXECUTOR_STACK_SIZE - (i % 16) * 256);
+      top[-1] = 0;
+      top[-2] = (void *) &fiberMain;
+      for (int r = 3; r <= 8; ++r)
+         top[-r] = 0;
+      fiberStack[i] = top - 8;
+   }
+
+   void resume(unsigned int i) { switchStack(&schedulerStack, fiberStack[i]); }
+   void suspend(unsigned int i) { switchStack(&fiberStack[i], schedulerStack); }
+
+   void * schedulerStack;
+
+#else
+
+   void initFiber(unsigned int i)
+   {
+      getcontext(&contexts[i]);
+      contexts[i].uc_stack.ss_sp = stacks + i * (size_t) CPU_EXECUTOR_STACK_SIZE;
+      contexts[i].uc_stack.ss_size = CPU_EXECUTOR_STACK_SIZE;
+      contexts[i].uc_link = 0;
+      makecontext(&contexts[i], &BlockRunner::fiberMain, 0);
+   }
+
+   void resume(unsigned int i) { swapcontext(&scheduler, &contexts[i]); }
+   void suspend(unsigned int i) { swapcontext(&contexts[i], &scheduler); }
+
+   ucontext_t scheduler;
+   std::vector<ucontext_t> contexts;
+
+#endif
+
+   void (*entry)(const void *);
+   const void * context;
+   unsigned int current;
+   bool inFiber;
+
+   char * stacks;
+   unsigned int stackCount;
+   std::vector<void *> fiberStack;
+   std::vector<char> done;
+};
+
+template <typename Kernel, typename... Args>
+class KernelLaunch : public Job
+{
+public:
+   KernelLaunch(dim3 grid, dim3 block, Kernel kernel, Args... args)
+      : Job((size_t) grid.x * grid.y * grid.z, 1), grid(grid), block(block), kernel(kernel), args(args...)
+   {
+      // keep roughly 16 ranges per thread so that stealing balances the tail
+      size_t blocks = (size_t) grid.x * grid.y * grid.z;
+      this->grain = blocks / (16 * cpuThreadCount()) + 1;
+   }
+
+   void run(size_t begin, size_t end)
+   {
+      BlockRunner& runner = BlockRunner::local();
+      for (size_t b = begin; b < end; ++b)
+         runner.runBlock(*this, b);
+   }
+
+   static void runThread(const void * launch)
+   {
+      const KernelLaunch * self = (const KernelLaunch *) launch;
+      std::apply(self->kernel, self->args);
+   }
+
+   dim3 grid;
+   dim3 block;
+
+private:
+   Kernel kernel;
+   std::tuple<Args...> args;
+};
+
+} // namespace cpuExecutor
+
+inline void __syncthreads()
+{
+   cpuExecutor::BlockRunner::local().barrier();
+}
+
+inline void __threadfence()
+{
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+// Runs kernel(args...) over the grid and returns when every block is done.
+template <typename... Params, typename... Args>
+void cpuLaunch(dim3 grid, dim3 block, void (*kernel)(Params...), Args... args)
+{
+   typedef cpuExecutor::KernelLaunch<void (*)(Params...), Params...> Launch;
+   Launch launch(grid, block, kernel, ((Params) args)...);
+   size_t blocks = (size_t) grid.x * grid.y * grid.z;
+   if (cpuThreadCount() == 1 || blocks == 1)
+      launch.run(0, blocks);
+   else
+      cpuExecutor::ThreadPool::instance().execute(launch, blocks);
+}
+
+namespace cpuExecutor
+{
+
+// Keeps the value argument of the atomics out of template deduction, so that
+// atomicAdd(&unsignedCounter, 1) converts 1 as the CUDA overloads do.
+template <typename T>
+struct NonDeduced
+{
+   typedef T type;
+};
+
+} // namespace cpuExecutor
+
+// Blocks of different workers run concurrently, so device atomics are real
+// atomics; threads of one block never preempt each other.
+template <typename T>
+T atomicAdd(T * address, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   return __atomic_fetch_add(address, value, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+T atomicSub(T * address, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   return __atomic_fetch_sub(address, value, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+T atomicExch(T * address, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   return __atomic_exchange_n(address, value, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+T atomicCAS(T * address, typename cpuExecutor::NonDeduced<T>::type compare, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   __atomic_compare_exchange_n(address, &compare, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+   return compare;
+}
+
+template <typename T>
+T atomicMin(T * address, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   T old;
+   __atomic_load(address, &old, __ATOMIC_RELAXED);
+   while (value < old && !__atomic_compare_exchange(address, &old, &value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+   return old;
+}
+
+template <typename T>
+T atomicMax(T * address, typename cpuExecutor::NonDeduced<T>::type value)
+{
+   T old;
+   __atomic_load(address, &old, __ATOMIC_RELAXED);
+   while (old < value && !__atomic_compare_exchange(address, &old, &value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+   return old;
+}
+
+template <typename T>
+T atomicFloatAdd(T * address, T value)
+{
+   T old, sum;
+   __atomic_load(address, &old, __ATOMIC_RELAXED);
+   do
+   {
+      sum = old + value;
+   } while (!__atomic_compare_exchange(address, &old, &sum, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+   return old;
+}
+
+inline float atomicAdd(float * address, float value) { return atomicFloatAdd(address, value); }
+inline double atomicAdd(double * address, double value) { return atomicFloatAdd(address, value); }
+
+// Minimal CUDA runtime: device memory is host memory and every operation,
+// asynchronous ones included, completes before it returns.
+
+enum cudaError_t
+{
+   cudaSuccess = 0,
+   cudaErrorInvalidValue = 1,
+   cudaErrorMemoryAllocation = 2
+};
+
+enum cudaMemcpyKind
+{
+   cudaMemcpyHostToHost = 0,
+   cudaMemcpyHostToDevice = 1,
+   cudaMemcpyDeviceToHost = 2,
+   cudaMemcpyDeviceToDevice = 3,
+   cudaMemcpyDefault = 4
+};
+
+typedef struct cudaStreamOpaque * cudaStream_t;
+
+#define cudaHostAllocDefault 0
+
+struct cudaDeviceProp
+{
+   char name[256];
+   size_t totalGlobalMem;
+   size_t sharedMemPerBlock;
+   size_t totalConstMem;
+   int warpSize;
+   int maxThreadsPerBlock;
+   int maxThreadsDim[3];
+   int maxGridSize[3];
+   int major;
+   int minor;
+   int multiProcessorCount;
+};
+
+inline const char * cudaGetErrorString(cudaError_t error)
+{
+   switch (error)
+   {
+   case cudaSuccess: return "no error";
+   case cudaErrorInvalidValue: return "invalid argument";
+   case cudaErrorMemoryAllocation: return "out of memory";
+   }
+   return "unknown error";
+}
+
+inline cudaError_t cudaGetLastError() { return cudaSuccess; }
+
+inline cudaError_t cudaMalloc(void ** devPtr, size_t size)
+{
+   // 64-byte alignment: a cache line, and enough for any vector load
+   if (posix_memalign(devPtr, 64, size ? size : 1) != 0)
+      return cudaErrorMemoryAllocation;
+   return cudaSuccess;
+}
+
+template <typename T>
+cudaError_t cudaMalloc(T ** devPtr, size_t size)
+{
+   return cudaMalloc((void **) devPtr, size);
+}
+
+inline cudaError_t cudaFree(void * devPtr)
+{
+   free(devPtr);
+   return cudaSuccess;
+}
+
+inline cudaError_t cudaHostAlloc(void ** ptr, size_t size, unsigned int /* flags */) { return cudaMalloc(ptr, size); }
+inline cudaError_t cudaMallocHost(void ** ptr, size_t size) { return cudaMalloc(ptr, size); }
+inline cudaError_t cudaFreeHost(void * ptr) { return cudaFree(ptr); }
+
+inline cudaError_t cudaMemcpy(void * dst, const void * src, size_t count, cudaMemcpyKind /* kind */)
+{
+   memmove(dst, src, count);
+   return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpyAsync(void * dst, const void * src, size_t count, cudaMemcpyKind kind, cudaStream_t /* stream */ = 0)
+{
+   return cudaMemcpy(dst, src, count, kind);
+}
+
+inline cudaError_t cudaMemset(void * devPtr, int value, size_t count)
+{
+   memset(devPtr, value, count);
+   return cudaSuccess;
+}
+
+inline cudaError_t cudaDeviceSynchronize() { return cudaSuccess; }
+inline cudaError_t cudaStreamCreate(cudaStream_t * stream) { *stream = 0; return cudaSuccess; }
+inline cudaError_t cudaStreamDestroy(cudaStream_t /* stream */) { return cudaSuccess; }
+inline cudaError_t cudaStreamSynchronize(cudaStream_t /* stream */) { return cudaSuccess; }
+
+inline cudaError_t cudaGetDeviceCount(int * count)
+{
+   *count = 1;
+   return cudaSuccess;
+}
+
+// Describes the executor the way CUDA described its emulation device
+// (compute capability 9999.9999).
+inline cudaError_t cudaGetDeviceProperties(cudaDeviceProp * prop, int /* device */)
+{
+   memset(prop, 0, sizeof(*prop));
+   snprintf(prop->name, sizeof(prop->name), "CPU executor (%u threads)", cpuThreadCount());
+   prop->totalGlobalMem = (size_t) sysconf(_SC_PHYS_PAGES) * (size_t) sysconf(_SC_PAGESIZE);
+   prop->sharedMemPerBlock = 48 * 1024;
+   prop->totalConstMem = 64 * 1024;
+   prop->warpSize = warpSize;
+   prop->maxThreadsPerBlock = 1024;
+   prop->maxThreadsDim[0] = 1024;
+   prop->maxThreadsDim[1] = 1024;
+   prop->maxThreadsDim[2] = 64;
+   prop->maxGridSize[0] = 2147483647;
+   prop->maxGridSize[1] = 65535;
+   prop->maxGridSize[2] = 65535;
+   prop->major = 9999;
+   prop->minor = 9999;
+   prop->multiProcessorCount = (int) cpuThreadCount();
+   return cudaSuccess;
+}
+
+#endif // __CUDACC__
+
+#endif // CPU_EXECUTOR_H
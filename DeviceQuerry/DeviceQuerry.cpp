@@ -1,4 +1,5 @@
 #include        <wb.h>
+#include "../Profiler/WbProfiler.h"
 
 //@@ The purpose of this code is to become familiar with the submission 
 //@@ process. Do not worry if you do not understand all the details of 
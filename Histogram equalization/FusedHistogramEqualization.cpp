@@ -0,0 +1,209 @@
+// Histogram equalization in two sweeps over the image.
+//
+// HistogramEqualization.cpp materializes every stage (unsigned char image,
+// gray scale image, histogram, CDF, corrected image, float image), so the
+// image goes through memory six times. Here:
+//
+//    histogramOfFloatImage   one read of the float image: the unsigned char
+//                            conversion, the gray conversion and a privatized
+//                            histogram, without storing either image
+//    buildEqualizationLut    one block: CDF, minimum CDF and the 256 output
+//                            values, already converted back to float
+//    applyEqualizationLut    one read of the float image and one write of the
+//                            output through the LUT held in shared memory
+
+#include <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../CpuExecutor/CpuExecutor.h"
+#include <cmath>
+
+#define wbCheck(stmt) do {                                                    \
+        cudaError_t err = stmt;                                               \
+        if (err != cudaSuccess) {                                             \
+            wbLog(ERROR, "Failed to run stmt ", #stmt);                       \
+            wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));    \
+            return -1;                                                        \
+        }                                                                     \
+    } while(0)
+
+#define RGB_CHANNELS 3
+#define HISTOGRAM_LENGTH 256
+#define HISTOGRAM_BLOCK_SIZE 256
+#define HISTOGRAM_MAX_BLOCKS 256
+#define LUT_BLOCK_SIZE 256
+#define LUT_MAX_BLOCKS 1024
+
+__device__ unsigned char toUnsignedChar(float value)
+{
+   return (unsigned char) ( 255 * value );
+}
+
+// Same conversion as convertToUnsignedChar followed by convertToGrayScaleImage.
+__device__ unsigned char grayValue(const float *pixel, int channels)
+{
+   if (RGB_CHANNELS == channels)
+   {
+      unsigned char r = toUnsignedChar(pixel[0]);
+      unsigned char g = toUnsignedChar(pixel[1]);
+      unsigned char b = toUnsignedChar(pixel[2]);
+      return (unsigned char) ( 0.21 * r + 0.71 * g + 0.07 * b );
+   }
+
+   unsigned int average = 0;
+   for (int k = 0; k < channels; ++k)
+   {
+      average += toUnsignedChar(pixel[k]);
+   }
+   return (unsigned char) ( average / channels );
+}
+
+__global__ void histogramOfFloatImage(const float *inputImage, long pixels, int channels, unsigned int *histogram)
+{
+   __shared__ unsigned int histo_private[HISTOGRAM_LENGTH];
+
+   for (int i = threadIdx.x; i < HISTOGRAM_LENGTH; i += blockDim.x)
+      histo_private[i] = 0;
+
+   __syncthreads();
+
+   long stride = (long) blockDim.x * gridDim.x; // stride is total number of threads
+   for (long i = threadIdx.x + (long) blockIdx.x * blockDim.x; i < pixels; i += stride)
+   {
+      atomicAdd( &(histo_private[grayValue(inputImage + i * channels, channels)]), 1u);
+   }
+
+   __syncthreads();
+
+   for (int i = threadIdx.x; i < HISTOGRAM_LENGTH; i += blockDim.x)
+      atomicAdd( &(histogram[i]), histo_private[i] );
+}
+
+// Launched as a single block of HISTOGRAM_LENGTH threads. The counts are
+// scanned as integers, so the CDF is exact up to the final division.
+__global__ void buildEqualizationLut(const unsigned int *histogram, long pixels, float *lut)
+{
+   __shared__ unsigned int counts[HISTOGRAM_LENGTH];
+
+   unsigned int t = threadIdx.x;
+   counts[t] = histogram[t];
+
+   __syncthreads();
+
+   // Hillis-Steele scan: 256 entries do not need a work-efficient one
+   for (unsigned int stride = 1; stride < HISTOGRAM_LENGTH; stride *= 2)
+   {
+      unsigned int temp = t >= stride ? counts[t - stride] : 0;
+
+      __syncthreads();
+
+      counts[t] += temp;
+
+      __syncthreads();
+   }
+
+   // the CDF is non-decreasing, so its minimum is its first entry
+   float minimumCDF = (float) counts[0] / pixels;
+   float cdf = (float) counts[t] / pixels;
+
+   float corrected = 255 * (float) t / (HISTOGRAM_LENGTH - 1); // constant image: identity
+   if (minimumCDF < 1.0f)
+      corrected = 255 * ( (cdf - minimumCDF) / (1 - minimumCDF) );
+
+   corrected = fminf(fmaxf(corrected, 0.0f), 255.0f);
+   lut[t] = (float) ( (unsigned char) corrected ) / 255;
+}
+
+__global__ void applyEqualizationLut(const float *inputImage, float *outputImage, long len, const float *lut)
+{
+   __shared__ float lut_private[HISTOGRAM_LENGTH];
+
+   for (int i = threadIdx.x; i < HISTOGRAM_LENGTH; i += blockDim.x)
+      lut_private[i] = lut[i];
+
+   __syncthreads();
+
+   long stride = (long) blockDim.x * gridDim.x;
+   for (long i = threadIdx.x + (long) blockIdx.x * blockDim.x; i < len; i += stride)
+   {
+      outputImage[i] = lut_private[toUnsignedChar(inputImage[i])];
+   }
+}
+
+int gridSize(long work, int blockSize, int maxBlocks)
+{
+   long blocks = (work - 1) / blockSize + 1;
+   return (int) (blocks < maxBlocks ? blocks : maxBlocks);
+}
+
+int main(int argc, char ** argv)
+{
+    wbArg_t args = wbArg_read(argc, argv); /* parse the input arguments */
+
+    const char * inputImageFile = wbArg_getInputFile(args, 0);
+
+    wbTime_start(Generic, "Importing data and creating memory on host");
+    wbImage_t inputImage = wbImport(inputImageFile);
+    int imageWidth = wbImage_getWidth(inputImage);
+    int imageHeight = wbImage_getHeight(inputImage);
+    int imageChannels = wbImage_getChannels(inputImage);
+    wbImage_t outputImage = wbImage_new(imageWidth, imageHeight, imageChannels);
+    wbTime_stop(Generic, "Importing data and creating memory on host");
+
+    long pixels = (long) imageWidth * imageHeight;
+    long imageLength = pixels * imageChannels;
+
+    float * hostInputImageData = wbImage_getData(inputImage);
+    float * hostOutputImageData = wbImage_getData(outputImage);
+    float * deviceInputImageData;
+    float * deviceOutputImageData;
+    unsigned int * deviceHistogram;
+    float * deviceLut;
+
+    wbTime_start(GPU, "Allocating GPU memory");
+    wbCheck(cudaMalloc((void **) &deviceInputImageData, imageLength * sizeof(float)));
+    wbCheck(cudaMalloc((void **) &deviceOutputImageData, imageLength * sizeof(float)));
+    wbCheck(cudaMalloc((void **) &deviceHistogram, HISTOGRAM_LENGTH * sizeof(unsigned int)));
+    wbCheck(cudaMalloc((void **) &deviceLut, HISTOGRAM_LENGTH * sizeof(float)));
+    wbTime_stop(GPU, "Allocating GPU memory");
+
+    wbTime_start(Copy, "Copying data to the GPU");
+    wbCheck(cudaMemcpy(deviceInputImageData, hostInputImageData, imageLength * sizeof(float), cudaMemcpyHostToDevice));
+    wbCheck(cudaMemset(deviceHistogram, 0, HISTOGRAM_LENGTH * sizeof(unsigned int)));
+    wbTime_stop(Copy, "Copying data to the GPU");
+
+    wbTime_start(Compute, "Compute histogram of the float image");
+    dim3 DimGrid_histogram(gridSize(pixels, HISTOGRAM_BLOCK_SIZE, HISTOGRAM_MAX_BLOCKS), 1, 1);
+    dim3 DimBlock_histogram(HISTOGRAM_BLOCK_SIZE, 1, 1);
+    launchKernel(histogramOfFloatImage, DimGrid_histogram, DimBlock_histogram,
+                 deviceInputImageData, pixels, imageChannels, deviceHistogram);
+    wbTime_stop(Compute, "Compute histogram of the float image");
+
+    wbTime_start(Compute, "Build the equalization table");
+    launchKernel(buildEqualizationLut, dim3(1, 1, 1), dim3(HISTOGRAM_LENGTH, 1, 1),
+                 deviceHistogram, pixels, deviceLut);
+    wbTime_stop(Compute, "Build the equalization table");
+
+    wbTime_start(Compute, "Equalize the image");
+    dim3 DimGrid_apply(gridSize(imageLength, LUT_BLOCK_SIZE, LUT_MAX_BLOCKS), 1, 1);
+    dim3 DimBlock_apply(LUT_BLOCK_SIZE, 1, 1);
+    launchKernel(applyEqualizationLut, DimGrid_apply, DimBlock_apply,
+                 deviceInputImageData, deviceOutputImageData, imageLength, deviceLut);
+    cudaDeviceSynchronize();
+    wbTime_stop(Compute, "Equalize the image");
+
+    wbTime_start(Copy, "Copying output image from the GPU");
+    wbCheck(cudaMemcpy(hostOutputImageData, deviceOutputImageData, imageLength * sizeof(float), cudaMemcpyDeviceToHost));
+    wbTime_stop(Copy, "Copying output image from the GPU");
+
+    wbSolution(args, outputImage);
+
+    cudaFree(deviceInputImageData);
+    cudaFree(deviceOutputImageData);
+    cudaFree(deviceHistogram);
+    cudaFree(deviceLut);
+
+    wbImage_delete(outputImage);
+    wbImage_delete(inputImage);
+
+    return 0;
+}
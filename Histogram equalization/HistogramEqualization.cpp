@@ -1,4 +1,7 @@
 #include <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../BufferPool/DeviceBufferPool.h"
+#include "../ListReduction/ReductionEngine.h"
 #include <sstream>
 #include <algorithm>
 #include <limits>
@@ -16,9 +19,12 @@
 #define RGB_CHANNELS 3
 #define HISTOGRAM_LENGTH 256
 #define SCAN_BLOCK_SIZE 256
-#define MIN_CDF_BLOCK_SIZE 256 
 #define HEF_BLOCK_SIZE 256 
 
+#ifndef EQUALIZATION_FRAMES
+#define EQUALIZATION_FRAMES 1 // times the input image is equalized, to measure the steady state
+#endif
+
 __global__ void convertToUnsignedChar(float *inputImage, unsigned char *outputImage, int height, int width, int channels) 
 {
    int y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -148,43 +154,6 @@ __global__ void scan(unsigned int * input, float * output, int len, int pixelsAm
        output[secondIndexInArray] = XY[secondIndexInBlock];
 }
 
-__global__ void computeMinimumCDF_kernel(float * input, float * output, int len) 
-{
-    __shared__ float partialMin[2 * MIN_CDF_BLOCK_SIZE];
-    
-    unsigned int t = threadIdx.x;
-    unsigned int start = 2 * blockIdx.x * blockDim.x;
-
-    //@@ Load a segment of the input vector into shared memory
-    if (start + t < len)
-       partialMin[t] = input[start + t];
-    else
-       partialMin[t] = 1.0f;
-
-    if (start + blockDim.x + t < len)
-       partialMin[blockDim.x + t] = input[start + blockDim.x + t];
-    else
-       partialMin[blockDim.x + t] = 1.0f;
-
-    __syncthreads();
-
-    //@@ Traverse the reduction tree
-    for (unsigned int stride = blockDim.x; stride > 0; stride /= 2)
-    {
-       if (t < stride )
-       {
-          if (partialMin[t + stride] < partialMin[t]) 
-             partialMin[t] = partialMin[t + stride];
-       }
-
-       __syncthreads();
-    }
-
-    //@@ Write the computed minimum of the block to the output vector at the correct index
-    if (t == 0)
-       output[blockIdx.x] = partialMin[0];
-}
-
 __global__ void correctImageColor(unsigned char *deviceUcharImage, float* deviceComulativeDistributionFunction, float minimumCDF, int height, int width, int channels) 
 {
    int y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -228,15 +197,15 @@ void checkComulativeDistributionFunction(unsigned int* deviceHistogram, int imag
 void checkMinimumCDF(float* deviceComulativeDistributionFunction, float computedMinimumCDF);
 void checkCorrectedImage(unsigned char* deviceUcharImage, unsigned char* hostUcharImageCopy, int imageWidth, int imageHeight, int imageChannels, float* deviceComulativeDistributionFunction, float minimumCDF);
 
-float* prepareDeviceInputImageMemory(float* hostInputImageData, int imageHeight, int imageWidth, int imageChannels);
-unsigned char* convertImageToUnsignedChar(float * deviceInputImageData, int imageHeight, int imageWidth, int imageChannels);
-unsigned char* convertImageToGrayScale(unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels);
-unsigned int* computeHistogram(unsigned char* deviceGrayScaleImage, int imageHeight, int imageWidth);
-float* computeComulativeDistributionFunction(unsigned int* deviceHistogram, int imageHeight, int imageWidth);
-float computeMinimumCDF(float* deviceComulativeDistributionFunction);
+float* prepareDeviceInputImageMemory(DeviceBufferPool& pool, float* hostInputImageData, int imageHeight, int imageWidth, int imageChannels);
+unsigned char* convertImageToUnsignedChar(DeviceBufferPool& pool, float * deviceInputImageData, int imageHeight, int imageWidth, int imageChannels);
+unsigned char* convertImageToGrayScale(DeviceBufferPool& pool, unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels);
+unsigned int* computeHistogram(DeviceBufferPool& pool, unsigned char* deviceGrayScaleImage, int imageHeight, int imageWidth);
+float* computeComulativeDistributionFunction(DeviceBufferPool& pool, unsigned int* deviceHistogram, int imageHeight, int imageWidth);
+float computeMinimumCDF(DeviceBufferPool& pool, float* deviceComulativeDistributionFunction);
 void applyHistogramEqualizationFunction(unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels,
                                         float* deviceComulativeDistributionFunction, float minimumCDF);
-float* castBackToFloat(unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels);
+float* castBackToFloat(DeviceBufferPool& pool, unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels);
 
 int main(int argc, char ** argv) 
 {
@@ -253,42 +222,64 @@ int main(int argc, char ** argv)
     wbTime_stop(Generic, "Importing data and creating memory on host");
 
     float* hostInputImageData  = wbImage_getData(inputImage);
+    float* hostOutputImageData = wbImage_getData(outputImage);
 
-    float* deviceInputImageData = prepareDeviceInputImageMemory(hostInputImageData, imageHeight, imageWidth, imageChannels);
-                                      
-    unsigned char* deviceUcharImage = convertImageToUnsignedChar(deviceInputImageData, imageHeight, imageWidth, imageChannels);
+    int imageLength = imageWidth * imageHeight * imageChannels;
+    int pixels = imageWidth * imageHeight;
 
-    unsigned char* deviceGrayScaleImage = convertImageToGrayScale(deviceUcharImage, imageHeight, imageWidth, imageChannels);
+    // every stage borrows its buffers from the pool and returns them at the
+    // end of the frame, so only the first frame goes to cudaMalloc
+    DeviceBufferPool pool;
+    size_t firstFrameAllocations = 0;
 
-    unsigned int* deviceHistogram = computeHistogram(deviceGrayScaleImage, imageHeight, imageWidth);
-    //checkHistoOutput(deviceGrayScaleImage, imageWidth, imageHeight, deviceHistogram);
+    for (int frame = 0; frame < EQUALIZATION_FRAMES; ++frame)
+    {
+        float* deviceInputImageData = prepareDeviceInputImageMemory(pool, hostInputImageData, imageHeight, imageWidth, imageChannels);
 
-    float* deviceComulativeDistributionFunction = computeComulativeDistributionFunction(deviceHistogram, imageHeight, imageWidth);
-    //checkComulativeDistributionFunction(deviceHistogram, imageHeight, imageWidth, deviceComulativeDistributionFunction);
+        unsigned char* deviceUcharImage = convertImageToUnsignedChar(pool, deviceInputImageData, imageHeight, imageWidth, imageChannels);
 
-    float MinimumCDF = computeMinimumCDF(deviceComulativeDistributionFunction);
-    //checkMinimumCDF(deviceComulativeDistributionFunction, MinimumCDF);
+        unsigned char* deviceGrayScaleImage = convertImageToGrayScale(pool, deviceUcharImage, imageHeight, imageWidth, imageChannels);
 
-    //unsigned char* hostUcharImageCopy = (unsigned char*) malloc(imageWidth * imageHeight * imageChannels * sizeof(unsigned char));
-    //cudaMemcpy(hostUcharImageCopy, deviceUcharImage, imageWidth * imageHeight * imageChannels * sizeof(unsigned char), cudaMemcpyDeviceToHost);
+        unsigned int* deviceHistogram = computeHistogram(pool, deviceGrayScaleImage, imageHeight, imageWidth);
+        //checkHistoOutput(deviceGrayScaleImage, imageWidth, imageHeight, deviceHistogram);
 
-    applyHistogramEqualizationFunction(deviceUcharImage, imageHeight, imageWidth, imageChannels, deviceComulativeDistributionFunction, MinimumCDF);
-    //checkCorrectedImage(deviceUcharImage, hostUcharImageCopy, imageHeight, imageWidth, imageChannels, deviceComulativeDistributionFunction, MinimumCDF);
-    
-    float* deviceOutputImageData = castBackToFloat(deviceUcharImage, imageHeight, imageWidth, imageChannels);
-    float* hostOutputImageData = wbImage_getData(outputImage);
+        float* deviceComulativeDistributionFunction = computeComulativeDistributionFunction(pool, deviceHistogram, imageHeight, imageWidth);
+        //checkComulativeDistributionFunction(deviceHistogram, imageHeight, imageWidth, deviceComulativeDistributionFunction);
 
-    wbTime_start(Copy, "Copying output image from the GPU");
-    cudaMemcpy(hostOutputImageData, deviceOutputImageData, imageWidth * imageHeight * imageChannels * sizeof(float), cudaMemcpyDeviceToHost);
-    wbTime_stop(Copy, "Copying output image from the GPU");
+        float MinimumCDF = computeMinimumCDF(pool, deviceComulativeDistributionFunction);
+        //checkMinimumCDF(deviceComulativeDistributionFunction, MinimumCDF);
 
-    wbSolution(args, outputImage);
+        //unsigned char* hostUcharImageCopy = (unsigned char*) malloc(imageWidth * imageHeight * imageChannels * sizeof(unsigned char));
+        //cudaMemcpy(hostUcharImageCopy, deviceUcharImage, imageWidth * imageHeight * imageChannels * sizeof(unsigned char), cudaMemcpyDeviceToHost);
+
+        applyHistogramEqualizationFunction(deviceUcharImage, imageHeight, imageWidth, imageChannels, deviceComulativeDistributionFunction, MinimumCDF);
+        //checkCorrectedImage(deviceUcharImage, hostUcharImageCopy, imageHeight, imageWidth, imageChannels, deviceComulativeDistributionFunction, MinimumCDF);
+
+        float* deviceOutputImageData = castBackToFloat(pool, deviceUcharImage, imageHeight, imageWidth, imageChannels);
+
+        wbTime_start(Copy, "Copying output image from the GPU");
+        cudaMemcpy(hostOutputImageData, deviceOutputImageData, imageLength * sizeof(float), cudaMemcpyDeviceToHost);
+        wbTime_stop(Copy, "Copying output image from the GPU");
+
+        pool.release(deviceInputImageData, imageLength);
+        pool.release(deviceUcharImage, imageLength);
+        pool.release(deviceGrayScaleImage, pixels);
+        pool.release(deviceHistogram, HISTOGRAM_LENGTH);
+        pool.release(deviceComulativeDistributionFunction, HISTOGRAM_LENGTH);
+        pool.release(deviceOutputImageData, imageLength);
+
+        if (frame == 0)
+            firstFrameAllocations = pool.getCounters().allocations;
+    }
+
+    DeviceBufferPool::Counters counters = pool.getCounters();
+    wbLog(TRACE, "Frames equalized: ", EQUALIZATION_FRAMES, ", buffers acquired: ", counters.acquisitions,
+          ", device allocations: ", counters.allocations, " (", counters.allocations - firstFrameAllocations,
+          " after the first frame), device memory held: ", counters.bytesAllocated, " bytes");
+    if (counters.buffersInUse != 0)
+        wbLog(ERROR, counters.buffersInUse, " buffers were not returned to the pool");
 
-    cudaFree(deviceInputImageData);
-    cudaFree(deviceUcharImage);
-    cudaFree(deviceGrayScaleImage);
-    cudaFree(deviceHistogram);
-    cudaFree(deviceComulativeDistributionFunction);
+    wbSolution(args, outputImage);
 
     wbImage_delete(outputImage);
     wbImage_delete(inputImage);
@@ -487,11 +478,10 @@ void checkCorrectedImage(unsigned char* deviceUcharImage, unsigned char* hostUch
     free(hostUcharImageExpected);
 }
 
-float* prepareDeviceInputImageMemory(float* hostInputImageData, int imageHeight, int imageWidth, int imageChannels)
+float* prepareDeviceInputImageMemory(DeviceBufferPool& pool, float* hostInputImageData, int imageHeight, int imageWidth, int imageChannels)
 {
     wbTime_start(GPU, "Allocating memory for images in GPU");
-    float * deviceInputImageData;
-    cudaMalloc((void **) &deviceInputImageData, imageWidth * imageHeight * imageChannels * sizeof(float));
+    float * deviceInputImageData = pool.acquire<float>(imageWidth * imageHeight * imageChannels);
     wbTime_stop(GPU, "Allocating memory for images in GPU");
 
     wbTime_start(Copy, "Copying data to the GPU");
@@ -501,11 +491,10 @@ float* prepareDeviceInputImageMemory(float* hostInputImageData, int imageHeight,
     return deviceInputImageData;
 }
 
-unsigned char* convertImageToUnsignedChar(float * deviceInputImageData, int imageHeight, int imageWidth, int imageChannels) 
+unsigned char* convertImageToUnsignedChar(DeviceBufferPool& pool, float * deviceInputImageData, int imageHeight, int imageWidth, int imageChannels) 
 {
     wbTime_start(GPU, "Allocating memory in GPU to convert input image to unsigned char");
-    unsigned char* deviceUcharImage = NULL;
-    cudaMalloc((void **) &deviceUcharImage, imageWidth * imageHeight * imageChannels * sizeof(unsigned char));
+    unsigned char* deviceUcharImage = pool.acquire<unsigned char>(imageWidth * imageHeight * imageChannels);
     wbTime_stop(GPU, "Allocating memory in GPU to convert input image to unsigned char");
 
     wbTime_start(Compute, "Convert image to unsigned char");
@@ -517,11 +506,10 @@ unsigned char* convertImageToUnsignedChar(float * deviceInputImageData, int imag
     return deviceUcharImage;
 }
 
-unsigned char* convertImageToGrayScale(unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels) 
+unsigned char* convertImageToGrayScale(DeviceBufferPool& pool, unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels) 
 {
     wbTime_start(GPU, "Allocating memory in GPU to convert input image to gray scale");
-    unsigned char* deviceGrayScaleImage = NULL;
-    cudaMalloc((void **) &deviceGrayScaleImage, imageWidth * imageHeight * sizeof(unsigned char));
+    unsigned char* deviceGrayScaleImage = pool.acquire<unsigned char>(imageWidth * imageHeight);
     wbTime_stop(GPU, "Allocating memory in GPU to convert input image to gray scale");
 
     wbTime_start(Compute, "Convert image to unsigned char");
@@ -533,11 +521,11 @@ unsigned char* convertImageToGrayScale(unsigned char* deviceUcharImage, int imag
     return deviceGrayScaleImage;
 }
 
-unsigned int* computeHistogram(unsigned char* deviceGrayScaleImage, int imageHeight, int imageWidth)
+unsigned int* computeHistogram(DeviceBufferPool& pool, unsigned char* deviceGrayScaleImage, int imageHeight, int imageWidth)
 {
     wbTime_start(GPU, "Allocating memory in GPU for histogram");
-    unsigned int* deviceHistogram = NULL;
-    cudaMalloc((void **) &deviceHistogram, HISTOGRAM_LENGTH * sizeof(unsigned int));
+    unsigned int* deviceHistogram = pool.acquire<unsigned int>(HISTOGRAM_LENGTH);
+    cudaMemset(deviceHistogram, 0, HISTOGRAM_LENGTH * sizeof(unsigned int)); // a reused buffer holds the last frame
     wbTime_stop(GPU, "Allocating memory in GPU for histogram");
 
     wbTime_start(Compute, "Compute histogram of the image");
@@ -549,11 +537,10 @@ unsigned int* computeHistogram(unsigned char* deviceGrayScaleImage, int imageHei
     return deviceHistogram;
 }
 
-float* computeComulativeDistributionFunction(unsigned int* deviceHistogram, int imageHeight, int imageWidth)
+float* computeComulativeDistributionFunction(DeviceBufferPool& pool, unsigned int* deviceHistogram, int imageHeight, int imageWidth)
 {
     wbTime_start(GPU, "Allocating memory in GPU for histogram");
-    float* deviceComulativeDistributionFunction = NULL;
-    cudaMalloc((void **) &deviceComulativeDistributionFunction, HISTOGRAM_LENGTH * sizeof(float));
+    float* deviceComulativeDistributionFunction = pool.acquire<float>(HISTOGRAM_LENGTH);
     wbTime_stop(GPU, "Allocating memory in GPU for histogram");
 
     dim3 DimGrid_scan((HISTOGRAM_LENGTH - 1) / (2 * SCAN_BLOCK_SIZE) + 1, 1, 1);
@@ -577,24 +564,19 @@ float* computeComulativeDistributionFunction(unsigned int* deviceHistogram, int
     return deviceComulativeDistributionFunction;
 }
 
-float computeMinimumCDF(float* deviceComulativeDistributionFunction)
+float computeMinimumCDF(DeviceBufferPool& pool, float* deviceComulativeDistributionFunction)
 {
     wbTime_start(GPU, "Allocating GPU memory for computeMinimumCDF");
-    float* deviceMinimumCDF = NULL;
-    wbCheck(cudaMalloc((void **) &deviceMinimumCDF, sizeof(float)));
+    float* deviceScratch = pool.acquire<float>(reductionScratchLength());
     wbTime_stop(GPU, "Allocating GPU memory for computeMinimumCDF");
 
-    dim3 DimGrid(HISTOGRAM_LENGTH, 1, 1);
-    dim3 DimBlock(HISTOGRAM_LENGTH, 1, 1);
-
     wbTime_start(Compute, "Performing CUDA computation of Minimum CDF");
-    computeMinimumCDF_kernel<<< DimGrid, DimBlock >>>(deviceComulativeDistributionFunction, deviceMinimumCDF, HISTOGRAM_LENGTH);
+    float hostMinimumCDF = 0.0f;
+    cudaError_t err = reduce<MinOp<float> >(deviceComulativeDistributionFunction, HISTOGRAM_LENGTH, deviceScratch, &hostMinimumCDF);
     wbTime_stop(Compute, "Performing CUDA computation of Minimum CDF");
 
-    cudaDeviceSynchronize();
-
-    float hostMinimumCDF = 0.0f;
-    wbCheck(cudaMemcpy(&hostMinimumCDF, deviceMinimumCDF, sizeof(float), cudaMemcpyDeviceToHost));
+    pool.release(deviceScratch, reductionScratchLength());
+    wbCheck(err);
     return hostMinimumCDF;
 }
 
@@ -608,11 +590,10 @@ void applyHistogramEqualizationFunction(unsigned char* deviceUcharImage, int ima
     wbTime_stop(Compute, "Correct color of input image");
 }
 
-float* castBackToFloat(unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels)
+float* castBackToFloat(DeviceBufferPool& pool, unsigned char* deviceUcharImage, int imageHeight, int imageWidth, int imageChannels)
 {
     wbTime_start(GPU, "Allocating memory in GPU to convert unsigned char image back to float");
-    float* deviceFloatImage = NULL;
-    cudaMalloc((void **) &deviceFloatImage, imageWidth * imageHeight * imageChannels * sizeof(float));
+    float* deviceFloatImage = pool.acquire<float>(imageWidth * imageHeight * imageChannels);
     wbTime_stop(GPU, "Allocating memory in GPU to convert unsigned char image back to float");
 
     wbTime_start(Compute, "Convert image back to float");
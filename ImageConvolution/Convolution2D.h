@@ -0,0 +1,318 @@
+// 2D convolution of an interleaved float image with a mask chosen at run time.
+//
+// ImageConvolution.cpp used to fix the mask at 5 x 5 through MASK_WIDTH and
+// O_TILE_WIDTH. Here both are template parameters of the tiled kernel, which
+// is instantiated for the odd square masks from 3 x 3 to 15 x 15; with the
+// mask width known at compile time the two mask loops unroll completely.
+// convolution2D picks the instantiation from the mask shape at run time:
+//
+//    3 x 3 ... 15 x 15 (odd)   convolutionTiled<MASK_WIDTH, O_TILE_WIDTH>
+//    any other shape           convolutionGeneric, one output per thread
+//                              straight from global memory
+//
+// Every block of the tiled kernel is a BLOCK_WIDTH x BLOCK_WIDTH square of
+// threads: the output tile plus the halo of MASK_WIDTH - 1 pixels. Small
+// masks keep the 16 x 16 block of the original lab, larger ones use 32 x 32
+// so that the halo does not dominate the tile.
+//
+// convolutionTiled reloads the tile, with two barriers, for every channel,
+// each load strided by the channel count. RGB and RGBA images (3 and 4
+// channels) go to convolutionTiledInterleaved instead: the tile holds whole
+// pixels, one ConvolutionPixel (float4) each, loaded once (RGBA as a single
+// 16-byte load), and every thread keeps one accumulator per channel.
+//
+// Without nvcc device memory is host memory and the convolution runs on the
+// CPU executor pool, a band of rows per task. The interleaved channels are
+// packed into the SIMD lanes as they come: every output row accumulates, for
+// each mask entry, the input row shifted by that entry's offset in floats,
+// a multiply-add of whole rows the compiler vectorizes whatever the channel
+// count. Building with -DCONVOLUTION_EMULATE_KERNELS (or -DEMULATE_KERNELS,
+// see CpuExecutor.h) sends convolution2D to the kernels instead, run by the
+// CPU executor, to test them without a GPU; convolution2DKernels always takes
+// that route.
+
+#ifndef CONVOLUTION_2D_H
+#define CONVOLUTION_2D_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+
+#ifdef __CUDACC__
+#define CONVOLUTION_UNROLL _Pragma("unroll")
+#else
+#define CONVOLUTION_UNROLL _Pragma("GCC unroll 16")
+#endif
+
+#define GENERIC_CONVOLUTION_BLOCK_WIDTH 16
+#define CONVOLUTION_HOST_ROWS 8 // output rows per host task
+
+#ifdef __CUDACC__
+typedef float4 ConvolutionPixel;
+#else
+struct ConvolutionPixel
+{
+   float x, y, z, w;
+};
+#endif
+
+template <int MASK_WIDTH, int O_TILE_WIDTH>
+__global__ void convolutionTiled(const float *inputImage, float *outputImage, int height, int width, int channels, const float * __restrict__ mask)
+{
+   const int MASK_RADIUS = MASK_WIDTH / 2;
+   const int BLOCK_WIDTH = O_TILE_WIDTH + MASK_WIDTH - 1;
+
+   __shared__ float tile[BLOCK_WIDTH][BLOCK_WIDTH];
+
+   int tx = threadIdx.x;
+   int ty = threadIdx.y;
+   int row_o = blockIdx.y * O_TILE_WIDTH + ty;
+   int col_o = blockIdx.x * O_TILE_WIDTH + tx;
+   int row_i = row_o - MASK_RADIUS;
+   int col_i = col_o - MASK_RADIUS;
+   bool inside = (row_i >= 0) && (row_i < height) && (col_i >= 0) && (col_i < width);
+
+   for (int k = 0; k < channels; ++k)
+   {
+      tile[ty][tx] = inside ? inputImage[((long) row_i * width + col_i) * channels + k] : 0.0f;
+
+      __syncthreads();
+
+      if (ty < O_TILE_WIDTH && tx < O_TILE_WIDTH)
+      {
+         float output = 0.0f;
+         CONVOLUTION_UNROLL
+         for (int i = 0; i < MASK_WIDTH; ++i)
+         {
+            CONVOLUTION_UNROLL
+            for (int j = 0; j < MASK_WIDTH; ++j)
+            {
+               output += mask[i * MASK_WIDTH + j] * tile[i + ty][j + tx];
+            }
+         }
+         if (row_o < height && col_o < width)
+            outputImage[((long) row_o * width + col_o) * channels + k] = output;
+      }
+
+      __syncthreads();
+   }
+}
+
+// convolutionTiled for CHANNELS (3 or 4) interleaved channels at once.
+template <int MASK_WIDTH, int O_TILE_WIDTH, int CHANNELS>
+__global__ void convolutionTiledInterleaved(const float *inputImage, float *outputImage, int height, int width, const float * __restrict__ mask)
+{
+   const int MASK_RADIUS = MASK_WIDTH / 2;
+   const int BLOCK_WIDTH = O_TILE_WIDTH + MASK_WIDTH - 1;
+
+   __shared__ ConvolutionPixel tile[BLOCK_WIDTH][BLOCK_WIDTH];
+
+   int tx = threadIdx.x;
+   int ty = threadIdx.y;
+   int row_o = blockIdx.y * O_TILE_WIDTH + ty;
+   int col_o = blockIdx.x * O_TILE_WIDTH + tx;
+   int row_i = row_o - MASK_RADIUS;
+   int col_i = col_o - MASK_RADIUS;
+
+   ConvolutionPixel pixel = { 0.0f, 0.0f, 0.0f, 0.0f };
+   if ((row_i >= 0) && (row_i < height) && (col_i >= 0) && (col_i < width))
+   {
+      const float * source = inputImage + ((long) row_i * width + col_i) * CHANNELS;
+      if (CHANNELS == 4)
+         pixel = *(const ConvolutionPixel *) source;
+      else
+      {
+         pixel.x = source[0];
+         pixel.y = source[1];
+         pixel.z = source[2];
+      }
+   }
+   tile[ty][tx] = pixel;
+
+   __syncthreads();
+
+   if (ty < O_TILE_WIDTH && tx < O_TILE_WIDTH && row_o < height && col_o < width)
+   {
+      ConvolutionPixel output = { 0.0f, 0.0f, 0.0f, 0.0f };
+      CONVOLUTION_UNROLL
+      for (int i = 0; i < MASK_WIDTH; ++i)
+      {
+         CONVOLUTION_UNROLL
+         for (int j = 0; j < MASK_WIDTH; ++j)
+         {
+            float m = mask[i * MASK_WIDTH + j];
+            ConvolutionPixel t = tile[i + ty][j + tx];
+            output.x += m * t.x;
+            output.y += m * t.y;
+            output.z += m * t.z;
+            output.w += m * t.w;
+         }
+      }
+
+      float * target = outputImage + ((long) row_o * width + col_o) * CHANNELS;
+      if (CHANNELS == 4)
+         *(ConvolutionPixel *) target = output;
+      else
+      {
+         target[0] = output.x;
+         target[1] = output.y;
+         target[2] = output.z;
+      }
+   }
+}
+
+// Any mask shape; the mask is centered on maskRows / 2, maskColumns / 2 as in
+// the tiled kernel.
+__global__ void convolutionGeneric(const float *inputImage, float *outputImage, int height, int width, int channels,
+                                   const float * __restrict__ mask, int maskRows, int maskColumns)
+{
+   int row = blockIdx.y * blockDim.y + threadIdx.y;
+   int col = blockIdx.x * blockDim.x + threadIdx.x;
+
+   if (row >= height || col >= width)
+      return;
+
+   int firstRow = row - maskRows / 2;
+   int firstCol = col - maskColumns / 2;
+
+   for (int k = 0; k < channels; ++k)
+   {
+      float output = 0.0f;
+      for (int i = 0; i < maskRows; ++i)
+      {
+         int row_i = firstRow + i;
+         if (row_i < 0 || row_i >= height)
+            continue;
+
+         for (int j = 0; j < maskColumns; ++j)
+         {
+            int col_i = firstCol + j;
+            if (col_i >= 0 && col_i < width)
+               output += mask[i * maskColumns + j] * inputImage[((long) row_i * width + col_i) * channels + k];
+         }
+      }
+      outputImage[((long) row * width + col) * channels + k] = output;
+   }
+}
+
+template <int MASK_WIDTH, int O_TILE_WIDTH>
+cudaError_t launchConvolutionTiled(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels, const float *deviceMask)
+{
+   const int BLOCK_WIDTH = O_TILE_WIDTH + MASK_WIDTH - 1;
+
+   dim3 dimBlock(BLOCK_WIDTH, BLOCK_WIDTH, 1);
+   dim3 dimGrid((width - 1) / O_TILE_WIDTH + 1, (height - 1) / O_TILE_WIDTH + 1, 1);
+   void (*kernel)(const float *, float *, int, int, int, const float *) = convolutionTiled<MASK_WIDTH, O_TILE_WIDTH>;
+   if (channels == 3 || channels == 4)
+   {
+      void (*interleaved)(const float *, float *, int, int, const float *) =
+         channels == 3 ? convolutionTiledInterleaved<MASK_WIDTH, O_TILE_WIDTH, 3>
+                       : convolutionTiledInterleaved<MASK_WIDTH, O_TILE_WIDTH, 4>;
+      launchKernel(interleaved, dimGrid, dimBlock,
+                   deviceInputImage, deviceOutputImage, height, width, deviceMask);
+      return cudaGetLastError();
+   }
+   launchKernel(kernel, dimGrid, dimBlock,
+                deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+   return cudaGetLastError();
+}
+
+// output[e] += factor * input[e + shift] for the elements of a row of length
+// rowLength whose source is inside the row.
+inline void multiplyAddShifted(float * __restrict__ output, const float * __restrict__ input, long rowLength, long shift,
+                               float factor)
+{
+   long begin = std::max(0L, -shift);
+   long end = std::min(rowLength, rowLength - shift);
+   for (long e = begin; e < end; ++e)
+      output[e] += factor * input[e + shift];
+}
+
+inline void convolution2DHost(const float *inputImage, float *outputImage, int height, int width, int channels,
+                              const float *mask, int maskRows, int maskColumns)
+{
+   long rowLength = (long) width * channels;
+   cpuParallelFor(height, CONVOLUTION_HOST_ROWS, [&](size_t begin, size_t end) {
+      for (size_t row = begin; row < end; ++row)
+      {
+         float * target = outputImage + row * rowLength;
+         std::fill(target, target + rowLength, 0.0f);
+         for (int i = 0; i < maskRows; ++i)
+         {
+            long source = (long) row - maskRows / 2 + i;
+            if (source < 0 || source >= height)
+               continue;
+            for (int j = 0; j < maskColumns; ++j)
+               multiplyAddShifted(target, inputImage + source * rowLength, rowLength,
+                                  (long) (j - maskColumns / 2) * channels, mask[i * maskColumns + j]);
+         }
+      }
+   });
+}
+
+// True when convolution2D has a specialized kernel for this mask shape.
+inline bool convolutionIsSpecialized(int maskRows, int maskColumns)
+{
+   return maskRows == maskColumns && maskRows % 2 == 1 && maskRows >= 3 && maskRows <= 15;
+}
+
+// The path convolution2D takes for this mask shape: "tiled", "generic" or,
+// without nvcc, "host".
+inline const char * convolution2DPath(int maskRows, int maskColumns)
+{
+#if defined(RUN_KERNELS) || defined(CONVOLUTION_EMULATE_KERNELS)
+   return convolutionIsSpecialized(maskRows, maskColumns) ? "tiled" : "generic";
+#else
+   (void) maskRows;
+   (void) maskColumns;
+   return "host";
+#endif
+}
+
+// The kernels of convolution2D; without nvcc they go through the CPU
+// executor.
+inline cudaError_t convolution2DKernels(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels,
+                                        const float *deviceMask, int maskRows, int maskColumns)
+{
+   if (height <= 0 || width <= 0 || channels <= 0)
+      return cudaSuccess;
+
+   if (convolutionIsSpecialized(maskRows, maskColumns))
+   {
+      switch (maskRows)
+      {
+      case 3:  return launchConvolutionTiled<3, 14>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 5:  return launchConvolutionTiled<5, 12>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 7:  return launchConvolutionTiled<7, 26>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 9:  return launchConvolutionTiled<9, 24>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 11: return launchConvolutionTiled<11, 22>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 13: return launchConvolutionTiled<13, 20>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      case 15: return launchConvolutionTiled<15, 18>(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask);
+      }
+   }
+
+   dim3 dimBlock(GENERIC_CONVOLUTION_BLOCK_WIDTH, GENERIC_CONVOLUTION_BLOCK_WIDTH, 1);
+   dim3 dimGrid((width - 1) / GENERIC_CONVOLUTION_BLOCK_WIDTH + 1, (height - 1) / GENERIC_CONVOLUTION_BLOCK_WIDTH + 1, 1);
+   launchKernel(convolutionGeneric, dimGrid, dimBlock,
+                deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns);
+   return cudaGetLastError();
+}
+
+// outputImage = inputImage (height x width x channels, on the device)
+// convolved with the maskRows x maskColumns deviceMask; pixels outside the
+// image count as zero.
+inline cudaError_t convolution2D(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels,
+                                 const float *deviceMask, int maskRows, int maskColumns)
+{
+#if defined(RUN_KERNELS) || defined(CONVOLUTION_EMULATE_KERNELS)
+   return convolution2DKernels(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns);
+#else
+   if (height <= 0 || width <= 0 || channels <= 0)
+      return cudaSuccess;
+
+   convolution2DHost(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns);
+   return cudaSuccess;
+#endif
+}
+
+#endif // CONVOLUTION_2D_H
@@ -0,0 +1,528 @@
+// Convolution through the FFT, for large masks.
+//
+// The direct kernels do maskRows x maskColumns multiply-adds per output and,
+// in the tiled one, load a halo of MASK_WIDTH - 1 pixels around every output
+// tile, and for large masks both costs dominate. Here the image is cut into
+// overlap-save tiles of FFT_SIZE x FFT_SIZE pixels (a power of two), each
+// tile is transformed, multiplied by the conjugate spectrum of the mask and
+// transformed back, and the (FFT_SIZE - maskRows + 1) x (FFT_SIZE -
+// maskColumns + 1) outputs that the circular correlation gets right are kept:
+// O(log FFT_SIZE) per output whatever the mask size.
+//
+// The mask is real, so the correlation of a complex tile is the correlation
+// of its real part plus i times that of its imaginary part: every transform
+// carries two tiles (or two channels of one tile), one in each half.
+//
+// A 2D transform is a pass of 1D transforms over the rows, a transpose and a
+// second pass over the rows; the spectra stay transposed, the mask spectrum
+// is computed the same way, and the inverse transform undoes the transpose.
+//
+//    fftGatherTiles       image pixels (zero outside) to complex tiles
+//    fftRows              one block per row, radix 2 in shared memory
+//    fftTranspose         32 x 32 tiles through shared memory
+//    fftMultiplySpectrum  times the conjugate mask spectrum, and 1 / size^2
+//    fftScatterTiles      valid outputs back to the image
+//
+// The tiles go through in batches of at most FFT_BATCH_ELEMENTS complex
+// values, so the scratch memory (fftConvolutionScratchBytes) does not grow
+// with the image. Without nvcc every host task transforms the pairs of tiles
+// it is given in split real and imaginary arrays; the butterflies work on
+// whole rows (the 1D transforms run down the columns, with the transpose in
+// between), which the compiler vectorizes.
+//
+// convolutionPrefersFft() picks this path from FFT_CONVOLUTION_CROSSOVER on:
+// the mask width where the fft variant of the convolution benchmark
+// overtakes the direct convolution2D. The two builds have their own: on the
+// CPU executor (one thread) the fft variant is ahead from 8 x 8 at 256x256,
+// 640x480 and 1920x1080 (9 x 9 at 640x480: 20 ms against 61 ms), and about
+// even at 7 x 7; the nvcc value is an estimate until the benchmark has run
+// on the target device.
+
+#ifndef FFT_CONVOLUTION_H
+#define FFT_CONVOLUTION_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __CUDACC__
+#define FFT_CONVOLUTION_CROSSOVER 31
+#else
+#define FFT_CONVOLUTION_CROSSOVER 8
+#endif
+#define FFT_MIN_SIZE 64
+#define FFT_MAX_SIZE 1024          // largest transform a block of fftRows holds in shared memory
+#define FFT_BLOCK_SIZE 256
+#define FFT_TRANSPOSE_TILE 32
+#define FFT_BATCH_ELEMENTS (1 << 21) // complex values per batch buffer
+
+struct FftComplex
+{
+   float re;
+   float im;
+};
+
+inline bool fftConvolutionSupported(int maskRows, int maskColumns)
+{
+   return maskRows >= 1 && maskColumns >= 1 && maskRows <= FFT_MAX_SIZE / 2 && maskColumns <= FFT_MAX_SIZE / 2;
+}
+
+inline bool convolutionPrefersFft(int maskRows, int maskColumns)
+{
+   return fftConvolutionSupported(maskRows, maskColumns) &&
+          maskRows * maskColumns >= FFT_CONVOLUTION_CROSSOVER * FFT_CONVOLUTION_CROSSOVER;
+}
+
+// The transform size with the least work for the image: tiles x size^2 x
+// log2(size), stopping at the first size that covers the image in one tile.
+inline int fftConvolutionSize(int height, int width, int maskRows, int maskColumns)
+{
+   int best = 0;
+   double bestCost = 0.0;
+   for (int size = FFT_MIN_SIZE; size <= FFT_MAX_SIZE; size *= 2)
+   {
+      if (size < 2 * std::max(maskRows, maskColumns))
+         continue;
+      double tilesDown = std::ceil((double) height / (size - maskRows + 1));
+      double tilesAcross = std::ceil((double) width / (size - maskColumns + 1));
+      double cost = tilesDown * tilesAcross * size * size * std::log2((double) size);
+      if (best == 0 || cost < bestCost)
+      {
+         best = size;
+         bestCost = cost;
+      }
+      if (tilesDown == 1 && tilesAcross == 1)
+         break;
+   }
+   return best;
+}
+
+inline long fftBatchPairs(int size)
+{
+   return std::max(1L, (long) FFT_BATCH_ELEMENTS / ((long) size * size));
+}
+
+// Twiddles, mask spectrum and two batch buffers.
+inline size_t fftScratchBytes(int size)
+{
+   return ((size_t) size / 2 + (size_t) size * size + 2 * fftBatchPairs(size) * size * size) * sizeof(FftComplex);
+}
+
+inline size_t fftConvolutionScratchBytes(int height, int width, int maskRows, int maskColumns)
+{
+   return fftScratchBytes(fftConvolutionSize(height, width, maskRows, maskColumns));
+}
+
+// Enough scratch for any image shape (strips of different heights, say).
+inline size_t fftConvolutionMaxScratchBytes()
+{
+   return fftScratchBytes(FFT_MAX_SIZE);
+}
+
+// Twiddle k of a transform of the given size: exp(-2 pi i k / size).
+inline void fftTwiddles(int size, FftComplex * twiddles)
+{
+   const double pi = 3.14159265358979323846;
+   for (int k = 0; k < size / 2; ++k)
+   {
+      twiddles[k].re = (float) std::cos(2.0 * pi * k / size);
+      twiddles[k].im = (float) -std::sin(2.0 * pi * k / size);
+   }
+}
+
+__device__ inline int fftReverseBits(int value, int bits)
+{
+   int reversed = 0;
+   for (int b = 0; b < bits; ++b)
+   {
+      reversed = (reversed << 1) | (value & 1);
+      value >>= 1;
+   }
+   return reversed;
+}
+
+// Tiles firstItem / 2 ... of the batch: item = tile * channels + channel,
+// items 2p and 2p + 1 share transform p. One block row: part of one transform.
+__global__ void fftGatherTiles(const float *inputImage, FftComplex *tiles, int height, int width, int channels,
+                               int maskRows, int maskColumns, int size, int tilesAcross, long firstItem, long items)
+{
+   long element = blockIdx.x * (long) blockDim.x + threadIdx.x;
+   if (element >= (long) size * size)
+      return;
+
+   int r = (int) (element / size);
+   int x = (int) (element % size);
+   float value[2];
+   for (int half = 0; half < 2; ++half)
+   {
+      long item = firstItem + 2 * (long) blockIdx.y + half;
+      value[half] = 0.0f;
+      if (item >= items)
+         continue;
+      long tile = item / channels;
+      int row = (int) (tile / tilesAcross) * (size - maskRows + 1) - maskRows / 2 + r;
+      int column = (int) (tile % tilesAcross) * (size - maskColumns + 1) - maskColumns / 2 + x;
+      if (row >= 0 && row < height && column >= 0 && column < width)
+         value[half] = inputImage[((long) row * width + column) * channels + item % channels];
+   }
+   tiles[blockIdx.y * (long) size * size + element].re = value[0];
+   tiles[blockIdx.y * (long) size * size + element].im = value[1];
+}
+
+__global__ void fftGatherMask(const float *mask, FftComplex *tile, int maskRows, int maskColumns, int size)
+{
+   long element = blockIdx.x * (long) blockDim.x + threadIdx.x;
+   if (element >= (long) size * size)
+      return;
+
+   int r = (int) (element / size);
+   int x = (int) (element % size);
+   tile[element].re = r < maskRows && x < maskColumns ? mask[r * maskColumns + x] : 0.0f;
+   tile[element].im = 0.0f;
+}
+
+// One block: the transform of row blockIdx.x (rows of all tiles end to end).
+__global__ void fftRows(FftComplex *data, const FftComplex * __restrict__ twiddles, int size, int log2Size, int inverse)
+{
+   __shared__ FftComplex row[FFT_MAX_SIZE];
+
+   FftComplex * values = data + blockIdx.x * (long) size;
+   for (int i = threadIdx.x; i < size; i += blockDim.x)
+      row[fftReverseBits(i, log2Size)] = values[i];
+
+   __syncthreads();
+
+   for (int half = 1; half < size; half *= 2)
+   {
+      int stride = size / (2 * half);
+      for (int b = threadIdx.x; b < size / 2; b += blockDim.x)
+      {
+         int k = b % half;
+         int first = (b / half) * 2 * half + k;
+         FftComplex w = twiddles[k * stride];
+         if (inverse)
+            w.im = -w.im;
+         FftComplex u = row[first];
+         FftComplex v = row[first + half];
+         float re = w.re * v.re - w.im * v.im;
+         float im = w.re * v.im + w.im * v.re;
+         row[first].re = u.re + re;
+         row[first].im = u.im + im;
+         row[first + half].re = u.re - re;
+         row[first + half].im = u.im - im;
+      }
+      __syncthreads();
+   }
+
+   for (int i = threadIdx.x; i < size; i += blockDim.x)
+      values[i] = row[i];
+}
+
+// Block FFT_TRANSPOSE_TILE x 8: one square of tile blockIdx.z.
+__global__ void fftTranspose(const FftComplex *input, FftComplex *output, int size)
+{
+   __shared__ FftComplex square[FFT_TRANSPOSE_TILE][FFT_TRANSPOSE_TILE + 1];
+
+   long offset = blockIdx.z * (long) size * size;
+   int x = blockIdx.x * FFT_TRANSPOSE_TILE + threadIdx.x;
+   int y = blockIdx.y * FFT_TRANSPOSE_TILE + threadIdx.y;
+   for (int j = 0; j < FFT_TRANSPOSE_TILE; j += blockDim.y)
+      square[threadIdx.y + j][threadIdx.x] = input[offset + (long) (y + j) * size + x];
+
+   __syncthreads();
+
+   x = blockIdx.y * FFT_TRANSPOSE_TILE + threadIdx.x;
+   y = blockIdx.x * FFT_TRANSPOSE_TILE + threadIdx.y;
+   for (int j = 0; j < FFT_TRANSPOSE_TILE; j += blockDim.y)
+      output[offset + (long) (y + j) * size + x] = square[threadIdx.x][threadIdx.y + j];
+}
+
+__global__ void fftMultiplySpectrum(FftComplex *data, const FftComplex * __restrict__ maskSpectrum, long tileElements,
+                                    long count, float scale)
+{
+   long i = blockIdx.x * (long) blockDim.x + threadIdx.x;
+   if (i >= count)
+      return;
+
+   FftComplex a = data[i];
+   FftComplex m = maskSpectrum[i % tileElements];
+   data[i].re = (a.re * m.re + a.im * m.im) * scale;
+   data[i].im = (a.im * m.re - a.re * m.im) * scale;
+}
+
+__global__ void fftScatterTiles(const FftComplex *tiles, float *outputImage, int height, int width, int channels,
+                                int maskRows, int maskColumns, int size, int tilesAcross, long firstItem, long items)
+{
+   long element = blockIdx.x * (long) blockDim.x + threadIdx.x;
+   int validRows = size - maskRows + 1;
+   int validColumns = size - maskColumns + 1;
+   int r = (int) (element / size);
+   int x = (int) (element % size);
+   if (element >= (long) size * size || r >= validRows || x >= validColumns)
+      return;
+
+   FftComplex value = tiles[blockIdx.y * (long) size * size + element];
+   for (int half = 0; half < 2; ++half)
+   {
+      long item = firstItem + 2 * (long) blockIdx.y + half;
+      if (item >= items)
+         continue;
+      long tile = item / channels;
+      int row = (int) (tile / tilesAcross) * validRows + r;
+      int column = (int) (tile % tilesAcross) * validColumns + x;
+      if (row < height && column < width)
+         outputImage[((long) row * width + column) * channels + item % channels] = half ? value.im : value.re;
+   }
+}
+
+// Host transform of the columns of a size x size tile in split arrays, as
+// butterflies of whole rows.
+inline void fftColumnsHost(float * re, float * im, int size, const std::vector<int>& reversed,
+                           const std::vector<FftComplex>& twiddles, bool inverse)
+{
+   for (int r = 0; r < size; ++r)
+      if (reversed[r] > r)
+      {
+         std::swap_ranges(re + (long) r * size, re + (long) (r + 1) * size, re + (long) reversed[r] * size);
+         std::swap_ranges(im + (long) r * size, im + (long) (r + 1) * size, im + (long) reversed[r] * size);
+      }
+
+   for (int half = 1; half < size; half *= 2)
+   {
+      int stride = size / (2 * half);
+      for (int first = 0; first < size; first += 2 * half)
+         for (int k = 0; k < half; ++k)
+         {
+            float wRe = twiddles[k * stride].re;
+            float wIm = inverse ? -twiddles[k * stride].im : twiddles[k * stride].im;
+            float * __restrict__ uRe = re + (long) (first + k) * size;
+            float * __restrict__ uIm = im + (long) (first + k) * size;
+            float * __restrict__ vRe = re + (long) (first + k + half) * size;
+            float * __restrict__ vIm = im + (long) (first + k + half) * size;
+            for (int x = 0; x < size; ++x)
+            {
+               float tRe = wRe * vRe[x] - wIm * vIm[x];
+               float tIm = wRe * vIm[x] + wIm * vRe[x];
+               vRe[x] = uRe[x] - tRe;
+               vIm[x] = uIm[x] - tIm;
+               uRe[x] += tRe;
+               uIm[x] += tIm;
+            }
+         }
+   }
+}
+
+inline void fftTransposeHost(float * values, int size)
+{
+   for (int r0 = 0; r0 < size; r0 += FFT_TRANSPOSE_TILE)
+      for (int c0 = r0; c0 < size; c0 += FFT_TRANSPOSE_TILE)
+         for (int r = r0; r < r0 + FFT_TRANSPOSE_TILE; ++r)
+            for (int c = (c0 == r0 ? r + 1 : c0); c < c0 + FFT_TRANSPOSE_TILE; ++c)
+               std::swap(values[(long) r * size + c], values[(long) c * size + r]);
+}
+
+// Forward: columns, transpose, columns (the spectrum comes out transposed);
+// inverse: the same steps undo it.
+inline void fft2DHost(float * re, float * im, int size, const std::vector<int>& reversed,
+                      const std::vector<FftComplex>& twiddles, bool inverse)
+{
+   fftColumnsHost(re, im, size, reversed, twiddles, inverse);
+   fftTransposeHost(re, size);
+   fftTransposeHost(im, size);
+   fftColumnsHost(re, im, size, reversed, twiddles, inverse);
+}
+
+inline void fftConvolutionHost(const float *inputImage, float *outputImage, int height, int width, int channels,
+                               const float *mask, int maskRows, int maskColumns, int size)
+{
+   int log2Size = 0;
+   while ((1 << log2Size) < size)
+      ++log2Size;
+   std::vector<int> reversed(size);
+   for (int i = 0; i < size; ++i)
+   {
+      reversed[i] = 0;
+      for (int b = 0; b < log2Size; ++b)
+         reversed[i] |= ((i >> b) & 1) << (log2Size - 1 - b);
+   }
+   std::vector<FftComplex> twiddles(size / 2);
+   fftTwiddles(size, &twiddles[0]);
+
+   long tileElements = (long) size * size;
+   std::vector<float> maskRe(tileElements, 0.0f);
+   std::vector<float> maskIm(tileElements, 0.0f);
+   for (int i = 0; i < maskRows; ++i)
+      std::copy(mask + i * maskColumns, mask + (i + 1) * maskColumns, &maskRe[(long) i * size]);
+   fft2DHost(&maskRe[0], &maskIm[0], size, reversed, twiddles, false);
+
+   int validRows = size - maskRows + 1;
+   int validColumns = size - maskColumns + 1;
+   int tilesAcross = (width - 1) / validColumns + 1;
+   long items = (long) ((height - 1) / validRows + 1) * tilesAcross * channels;
+   float scale = 1.0f / (float) tileElements;
+
+   cpuParallelFor((items + 1) / 2, 1, [&](size_t begin, size_t end) {
+      std::vector<float> re(tileElements);
+      std::vector<float> im(tileElements);
+      for (size_t pair = begin; pair < end; ++pair)
+      {
+         float * halves[2] = { &re[0], &im[0] };
+         for (int half = 0; half < 2; ++half)
+         {
+            long item = 2 * (long) pair + half;
+            std::fill(halves[half], halves[half] + tileElements, 0.0f);
+            if (item >= items)
+               continue;
+            long tile = item / channels;
+            int top = (int) (tile / tilesAcross) * validRows - maskRows / 2;
+            int left = (int) (tile % tilesAcross) * validColumns - maskColumns / 2;
+            for (int r = std::max(0, -top); r < size && top + r < height; ++r)
+            {
+               const float * source = inputImage + ((long) (top + r) * width) * channels + item % channels;
+               float * target = halves[half] + (long) r * size;
+               for (int x = std::max(0, -left); x < size && left + x < width; ++x)
+                  target[x] = source[(long) (left + x) * channels];
+            }
+         }
+
+         fft2DHost(&re[0], &im[0], size, reversed, twiddles, false);
+         for (long i = 0; i < tileElements; ++i)
+         {
+            float aRe = re[i];
+            float aIm = im[i];
+            re[i] = (aRe * maskRe[i] + aIm * maskIm[i]) * scale;
+            im[i] = (aIm * maskRe[i] - aRe * maskIm[i]) * scale;
+         }
+         fft2DHost(&re[0], &im[0], size, reversed, twiddles, true);
+
+         for (int half = 0; half < 2; ++half)
+         {
+            long item = 2 * (long) pair + half;
+            if (item >= items)
+               continue;
+            long tile = item / channels;
+            int top = (int) (tile / tilesAcross) * validRows;
+            int left = (int) (tile % tilesAcross) * validColumns;
+            for (int r = 0; r < validRows && top + r < height; ++r)
+            {
+               const float * source = halves[half] + (long) r * size;
+               float * target = outputImage + ((long) (top + r) * width) * channels + item % channels;
+               for (int x = 0; x < validColumns && left + x < width; ++x)
+                  target[(long) (left + x) * channels] = source[x];
+            }
+         }
+      }
+   });
+}
+
+// Forward 2D transform of count tiles: rows of data, transpose to
+// transposed, rows of transposed.
+inline void fftForwardTiles(FftComplex *data, FftComplex *transposed, const FftComplex *twiddles, long count,
+                            int size, int log2Size)
+{
+   dim3 transposeGrid(size / FFT_TRANSPOSE_TILE, size / FFT_TRANSPOSE_TILE, (unsigned int) count);
+   dim3 transposeBlock(FFT_TRANSPOSE_TILE, 8, 1);
+   launchKernel(fftRows, dim3((unsigned int) (count * size), 1, 1), dim3(FFT_BLOCK_SIZE, 1, 1), data, twiddles, size, log2Size, 0);
+   launchKernel(fftTranspose, transposeGrid, transposeBlock, (const FftComplex *) data, transposed, size);
+   launchKernel(fftRows, dim3((unsigned int) (count * size), 1, 1), dim3(FFT_BLOCK_SIZE, 1, 1), transposed, twiddles, size, log2Size, 0);
+}
+
+// Inverse of fftForwardTiles, from transposed back to data.
+inline void fftInverseTiles(FftComplex *data, FftComplex *transposed, const FftComplex *twiddles, long count,
+                            int size, int log2Size)
+{
+   dim3 transposeGrid(size / FFT_TRANSPOSE_TILE, size / FFT_TRANSPOSE_TILE, (unsigned int) count);
+   dim3 transposeBlock(FFT_TRANSPOSE_TILE, 8, 1);
+   launchKernel(fftRows, dim3((unsigned int) (count * size), 1, 1), dim3(FFT_BLOCK_SIZE, 1, 1), transposed, twiddles, size, log2Size, 1);
+   launchKernel(fftTranspose, transposeGrid, transposeBlock, (const FftComplex *) transposed, data, size);
+   launchKernel(fftRows, dim3((unsigned int) (count * size), 1, 1), dim3(FFT_BLOCK_SIZE, 1, 1), data, twiddles, size, log2Size, 1);
+}
+
+// The kernels of fftConvolution, with transforms of the given size.
+inline cudaError_t fftConvolutionTiles(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels,
+                                       const float *deviceMask, int maskRows, int maskColumns, int size, void *deviceScratch)
+{
+   int log2Size = 0;
+   while ((1 << log2Size) < size)
+      ++log2Size;
+   long tileElements = (long) size * size;
+   long batchPairs = fftBatchPairs(size);
+   FftComplex * twiddles = (FftComplex *) deviceScratch;
+   FftComplex * maskSpectrum = twiddles + size / 2;
+   FftComplex * tiles = maskSpectrum + tileElements;
+   FftComplex * transposed = tiles + batchPairs * tileElements;
+
+   std::vector<FftComplex> hostTwiddles(size / 2);
+   fftTwiddles(size, &hostTwiddles[0]);
+   cudaError_t err = cudaMemcpy(twiddles, &hostTwiddles[0], hostTwiddles.size() * sizeof(FftComplex), cudaMemcpyHostToDevice);
+   if (err != cudaSuccess)
+      return err;
+
+   unsigned int tileBlocks = (unsigned int) ((tileElements - 1) / FFT_BLOCK_SIZE + 1);
+   launchKernel(fftGatherMask, dim3(tileBlocks, 1, 1), dim3(FFT_BLOCK_SIZE, 1, 1), deviceMask, tiles, maskRows, maskColumns, size);
+   fftForwardTiles(tiles, maskSpectrum, twiddles, 1, size, log2Size);
+
+   int validRows = size - maskRows + 1;
+   int validColumns = size - maskColumns + 1;
+   int tilesAcross = (width - 1) / validColumns + 1;
+   long items = (long) ((height - 1) / validRows + 1) * tilesAcross * channels;
+   long pairs = (items + 1) / 2;
+   for (long first = 0; first < pairs; first += batchPairs)
+   {
+      long count = pairs - first < batchPairs ? pairs - first : batchPairs;
+      launchKernel(fftGatherTiles, dim3(tileBlocks, (unsigned int) count, 1), dim3(FFT_BLOCK_SIZE, 1, 1),
+                   deviceInputImage, tiles, height, width, channels, maskRows, maskColumns, size, tilesAcross, 2 * first, items);
+      fftForwardTiles(tiles, transposed, twiddles, count, size, log2Size);
+      launchKernel(fftMultiplySpectrum, dim3((unsigned int) ((count * tileElements - 1) / FFT_BLOCK_SIZE + 1), 1, 1),
+                   dim3(FFT_BLOCK_SIZE, 1, 1), transposed, (const FftComplex *) maskSpectrum, tileElements,
+                   count * tileElements, 1.0f / (float) tileElements);
+      fftInverseTiles(tiles, transposed, twiddles, count, size, log2Size);
+      launchKernel(fftScatterTiles, dim3(tileBlocks, (unsigned int) count, 1), dim3(FFT_BLOCK_SIZE, 1, 1),
+                   (const FftComplex *) tiles, deviceOutputImage, height, width, channels, maskRows, maskColumns,
+                   size, tilesAcross, 2 * first, items);
+   }
+   return cudaGetLastError();
+}
+
+// outputImage = inputImage (height x width x channels, on the device)
+// convolved with deviceMask (maskRows x maskColumns, on the device), using
+// fftConvolutionScratchBytes(height, width, maskRows, maskColumns) bytes of
+// deviceScratch. Without nvcc device memory is host memory and the
+// transforms run on the host threads (on fftConvolutionTiles with
+// -DEMULATE_KERNELS).
+inline cudaError_t fftConvolution(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels,
+                                  const float *deviceMask, int maskRows, int maskColumns, void *deviceScratch)
+{
+   if (height <= 0 || width <= 0 || channels <= 0)
+      return cudaSuccess;
+   if (!fftConvolutionSupported(maskRows, maskColumns))
+      return cudaErrorInvalidValue;
+
+   int size = fftConvolutionSize(height, width, maskRows, maskColumns);
+
+#ifdef RUN_KERNELS
+   return fftConvolutionTiles(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns,
+                              size, deviceScratch);
+#else
+   (void) deviceScratch;
+   fftConvolutionHost(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns, size);
+   return cudaSuccess;
+#endif
+}
+
+inline cudaError_t fftConvolution(const float *deviceInputImage, float *deviceOutputImage, int height, int width, int channels,
+                                  const float *deviceMask, int maskRows, int maskColumns)
+{
+   void * deviceScratch;
+   cudaError_t err = cudaMalloc(&deviceScratch, fftConvolutionScratchBytes(height, width, maskRows, maskColumns));
+   if (err != cudaSuccess)
+      return err;
+
+   err = fftConvolution(deviceInputImage, deviceOutputImage, height, width, channels, deviceMask, maskRows, maskColumns, deviceScratch);
+   cudaFree(deviceScratch);
+   return err;
+}
+
+#endif // FFT_CONVOLUTION_H
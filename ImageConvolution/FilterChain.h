@@ -0,0 +1,491 @@
+// Chains of image filters, fused by tile.
+//
+// Blurring, then sharpening, then clamping an image with the labs means one
+// run per filter, each taking the whole image through global memory. A
+// FilterChain lists the filters once and runs them together:
+//
+//    FilterChain chain;
+//    chain.convolve(blur, 5, 5).convolve(sharpen, 3, 3).clamp(0.0f, 1.0f);
+//    wbCheck(chain.run(deviceInput, deviceOutput, height, width, channels));
+//
+// The steps are convolutions (mask centered on maskRows / 2, maskColumns / 2,
+// pixels outside the image count as zero, as in convolution2D), the
+// point-wise clamp and affine (value * scale + offset) of every channel, and
+// the color conversions toGray (0.21 R + 0.71 G + 0.07 B, the weights of
+// HistogramEqualization; the average for fewer than three channels) and
+// toRgb (the first channel, or R, G, B of three or more, as three channels).
+// Every step sees the output of the one before as its whole input image, so
+// a chain gives the same image as the steps run one by one.
+//
+// On the GPU consecutive steps run in one launch of filterChainTiles when
+// their convolution radii add up to at most FILTER_MAX_HALO. A block loads
+// the output tile plus that halo into shared memory once, and every step
+// works from one shared buffer into the other, on a region that shrinks by
+// the radius of each convolution; only the last step writes to global
+// memory. Longer chains are cut into several such groups, with an image in
+// global memory between them, and a convolution wider than the halo runs on
+// its own through convolution2D.
+//
+// Without nvcc the whole chain is one pass on the CPU executor pool: every
+// task takes a band of FILTER_HOST_ROWS rows plus the halo of the chain,
+// runs all the steps on it in two per-thread band buffers that stay in the
+// cache (and are kept from one run to the next), and writes the band of
+// output. The convolutions are multiply-adds of shifted rows, as in
+// convolution2D. Building with -DEMULATE_KERNELS makes run() take runOnDevice
+// instead.
+//
+// Images have up to FILTER_MAX_CHANNELS interleaved channels.
+
+#ifndef FILTER_CHAIN_H
+#define FILTER_CHAIN_H
+
+#include "Convolution2D.h"
+
+#include <algorithm>
+#include <vector>
+
+#define FILTER_OUTPUT_TILE 16
+#define FILTER_MAX_HALO 8 // rows and columns added on each side of the tile by the convolutions of a group
+#define FILTER_TILE_WIDTH (FILTER_OUTPUT_TILE + 2 * FILTER_MAX_HALO)
+#define FILTER_MAX_CHANNELS 4
+#define FILTER_MAX_GROUP_STEPS 16
+#define FILTER_HOST_ROWS 32 // output rows per host task
+
+enum FilterKind
+{
+   FILTER_CONVOLUTION,
+   FILTER_CLAMP,   // first = low, second = high
+   FILTER_AFFINE,  // first = scale, second = offset
+   FILTER_TO_GRAY,
+   FILTER_TO_RGB
+};
+
+struct FilterStep
+{
+   int kind;
+   int maskRows;
+   int maskColumns;
+   int maskOffset; // of the mask in the masks of the chain
+   float first;
+   float second;
+};
+
+// Steps fused into one launch of filterChainTiles; passed by value.
+struct FilterGroup
+{
+   int count;
+   int halo;
+   FilterStep steps[FILTER_MAX_GROUP_STEPS];
+};
+
+__host__ __device__ inline int filterRadius(const FilterStep& step)
+{
+   return step.kind == FILTER_CONVOLUTION ? (step.maskRows > step.maskColumns ? step.maskRows : step.maskColumns) / 2 : 0;
+}
+
+__host__ __device__ inline int filterChannels(const FilterStep& step, int channels)
+{
+   return step.kind == FILTER_TO_GRAY ? 1 : step.kind == FILTER_TO_RGB ? 3 : channels;
+}
+
+// A point-wise step on one pixel; output may be input.
+__host__ __device__ inline void filterPixel(const FilterStep& step, const float *input, int channels, float *output)
+{
+   if (step.kind == FILTER_TO_GRAY)
+   {
+      float gray = 0.0f;
+      if (channels >= 3)
+         gray = 0.21f * input[0] + 0.71f * input[1] + 0.07f * input[2];
+      else
+      {
+         for (int k = 0; k < channels; ++k)
+            gray += input[k];
+         gray /= channels;
+      }
+      output[0] = gray;
+   }
+   else if (step.kind == FILTER_TO_RGB)
+   {
+      float r = input[0];
+      float g = channels >= 3 ? input[1] : r;
+      float b = channels >= 3 ? input[2] : r;
+      output[0] = r;
+      output[1] = g;
+      output[2] = b;
+   }
+   else
+   {
+      for (int k = 0; k < channels; ++k)
+      {
+         float value = input[k];
+         if (step.kind == FILTER_CLAMP)
+            value = value < step.first ? step.first : value > step.second ? step.second : value;
+         else
+            value = value * step.first + step.second;
+         output[k] = value;
+      }
+   }
+}
+
+// One block: a FILTER_OUTPUT_TILE square of the output of the group.
+__global__ void filterChainTiles(const float *inputImage, float *outputImage, int height, int width, int channels,
+                                 FilterGroup group, const float * __restrict__ masks)
+{
+   __shared__ float tiles[2][FILTER_TILE_WIDTH * FILTER_TILE_WIDTH * FILTER_MAX_CHANNELS];
+
+   int extent = FILTER_OUTPUT_TILE + 2 * group.halo;
+   int top = blockIdx.y * FILTER_OUTPUT_TILE - group.halo; // image row of tile row 0
+   int left = blockIdx.x * FILTER_OUTPUT_TILE - group.halo;
+   int threads = blockDim.x * blockDim.y;
+   int tid = threadIdx.y * blockDim.x + threadIdx.x;
+
+   for (int i = tid; i < extent * extent; i += threads)
+   {
+      int row = top + i / extent;
+      int col = left + i % extent;
+      bool inside = row >= 0 && row < height && col >= 0 && col < width;
+      float * pixel = &tiles[0][((i / extent) * FILTER_TILE_WIDTH + i % extent) * FILTER_MAX_CHANNELS];
+      for (int k = 0; k < channels; ++k)
+         pixel[k] = inside ? inputImage[((long) row * width + col) * channels + k] : 0.0f;
+   }
+
+   __syncthreads();
+
+   // valid values: tile rows and columns [margin, extent - margin) of tiles[current]
+   int current = 0;
+   int margin = 0;
+   for (int s = 0; s < group.count; ++s)
+   {
+      const FilterStep& step = group.steps[s];
+      int outputChannels = filterChannels(step, channels);
+      int radius = filterRadius(step);
+      int span = extent - 2 * (margin + radius);
+      for (int i = tid; i < span * span; i += threads)
+      {
+         int r = margin + radius + i / span;
+         int c = margin + radius + i % span;
+         int row = top + r;
+         int col = left + c;
+         float * target = &tiles[step.kind == FILTER_CONVOLUTION ? 1 - current : current][(r * FILTER_TILE_WIDTH + c) * FILTER_MAX_CHANNELS];
+         if (row < 0 || row >= height || col < 0 || col >= width)
+         {
+            // the next step sees zeros outside the image, whatever this one makes of them
+            for (int k = 0; k < outputChannels; ++k)
+               target[k] = 0.0f;
+            continue;
+         }
+
+         if (step.kind != FILTER_CONVOLUTION)
+         {
+            filterPixel(step, target, channels, target);
+            continue;
+         }
+
+         float output[FILTER_MAX_CHANNELS] = { 0.0f, 0.0f, 0.0f, 0.0f };
+         const float * mask = masks + step.maskOffset;
+         for (int mi = 0; mi < step.maskRows; ++mi)
+            for (int mj = 0; mj < step.maskColumns; ++mj)
+            {
+               float m = mask[mi * step.maskColumns + mj];
+               const float * source = &tiles[current][((r - step.maskRows / 2 + mi) * FILTER_TILE_WIDTH +
+                                                      c - step.maskColumns / 2 + mj) * FILTER_MAX_CHANNELS];
+               for (int k = 0; k < channels; ++k)
+                  output[k] += m * source[k];
+            }
+         for (int k = 0; k < channels; ++k)
+            target[k] = output[k];
+      }
+
+      __syncthreads();
+
+      if (step.kind == FILTER_CONVOLUTION)
+         current = 1 - current;
+      margin += radius;
+      channels = outputChannels;
+   }
+
+   for (int i = tid; i < FILTER_OUTPUT_TILE * FILTER_OUTPUT_TILE; i += threads)
+   {
+      int row = blockIdx.y * FILTER_OUTPUT_TILE + i / FILTER_OUTPUT_TILE;
+      int col = blockIdx.x * FILTER_OUTPUT_TILE + i % FILTER_OUTPUT_TILE;
+      if (row >= height || col >= width)
+         continue;
+      const float * pixel = &tiles[current][((margin + i / FILTER_OUTPUT_TILE) * FILTER_TILE_WIDTH +
+                                            margin + i % FILTER_OUTPUT_TILE) * FILTER_MAX_CHANNELS];
+      for (int k = 0; k < channels; ++k)
+         outputImage[((long) row * width + col) * channels + k] = pixel[k];
+   }
+}
+
+class FilterChain
+{
+public:
+   FilterChain() : deviceMasks(NULL), uploadedMasks(0), bufferBytes(0)
+   {
+      deviceBuffers[0] = NULL;
+      deviceBuffers[1] = NULL;
+   }
+
+   ~FilterChain()
+   {
+      cudaFree(deviceMasks);
+      cudaFree(deviceBuffers[0]);
+      cudaFree(deviceBuffers[1]);
+   }
+
+   FilterChain(const FilterChain&) = delete;
+   FilterChain& operator=(const FilterChain&) = delete;
+
+   // mask: maskRows x maskColumns on the host, copied.
+   FilterChain& convolve(const float * mask, int maskRows, int maskColumns)
+   {
+      FilterStep step = { FILTER_CONVOLUTION, maskRows, maskColumns, (int) masks.size(), 0.0f, 0.0f };
+      masks.insert(masks.end(), mask, mask + maskRows * maskColumns);
+      steps.push_back(step);
+      return *this;
+   }
+
+   FilterChain& clamp(float low, float high) { return pointStep(FILTER_CLAMP, low, high); }
+   FilterChain& affine(float scale, float offset) { return pointStep(FILTER_AFFINE, scale, offset); }
+   FilterChain& toGray() { return pointStep(FILTER_TO_GRAY, 0.0f, 0.0f); }
+   FilterChain& toRgb() { return pointStep(FILTER_TO_RGB, 0.0f, 0.0f); }
+
+   // Channels of the output of an image of the given channels.
+   int outputChannels(int channels) const
+   {
+      for (size_t s = 0; s < steps.size(); ++s)
+         channels = filterChannels(steps[s], channels);
+      return channels;
+   }
+
+   // outputImage (height x width x outputChannels(channels), on the device) =
+   // inputImage (height x width x channels, on the device) through the chain.
+   cudaError_t run(const float * deviceInputImage, float * deviceOutputImage, int height, int width, int channels)
+   {
+      if (channels < 1 || channels > FILTER_MAX_CHANNELS)
+         return cudaErrorInvalidValue;
+      if (height <= 0 || width <= 0)
+         return cudaSuccess;
+#ifdef RUN_KERNELS
+      return runOnDevice(deviceInputImage, deviceOutputImage, height, width, channels);
+#else
+      return runOnHost(deviceInputImage, deviceOutputImage, height, width, channels);
+#endif
+   }
+
+   // The steps cut into groups for filterChainTiles; a group with a halo
+   // wider than FILTER_MAX_HALO is a single convolution.
+   std::vector<FilterGroup> groups() const
+   {
+      std::vector<FilterGroup> result;
+      for (size_t s = 0; s < steps.size(); ++s)
+      {
+         int radius = filterRadius(steps[s]);
+         if (result.empty() || result.back().halo > FILTER_MAX_HALO || radius > FILTER_MAX_HALO ||
+             result.back().halo + radius > FILTER_MAX_HALO || result.back().count == FILTER_MAX_GROUP_STEPS)
+         {
+            FilterGroup group;
+            group.count = 0;
+            group.halo = 0;
+            result.push_back(group);
+         }
+         result.back().steps[result.back().count++] = steps[s];
+         result.back().halo += radius;
+      }
+      return result;
+   }
+
+   // The kernels of run; without nvcc they go through the CPU executor.
+   cudaError_t runOnDevice(const float * deviceInputImage, float * deviceOutputImage, int height, int width, int channels)
+   {
+      std::vector<FilterGroup> chain = groups();
+      cudaError_t err = prepareDevice((size_t) height * width * FILTER_MAX_CHANNELS * sizeof(float), chain.size());
+      if (err != cudaSuccess)
+         return err;
+
+      if (chain.empty())
+         return cudaMemcpy(deviceOutputImage, deviceInputImage, (size_t) height * width * channels * sizeof(float),
+                           cudaMemcpyDeviceToDevice);
+
+      dim3 dimGrid((width - 1) / FILTER_OUTPUT_TILE + 1, (height - 1) / FILTER_OUTPUT_TILE + 1, 1);
+      dim3 dimBlock(FILTER_OUTPUT_TILE, FILTER_OUTPUT_TILE, 1);
+      const float * input = deviceInputImage;
+      for (size_t g = 0; g < chain.size(); ++g)
+      {
+         float * output = g + 1 == chain.size() ? deviceOutputImage : deviceBuffers[g % 2];
+         const FilterGroup& group = chain[g];
+         if (group.halo > FILTER_MAX_HALO)
+         {
+            const FilterStep& step = group.steps[0];
+            err = convolution2D(input, output, height, width, channels, deviceMasks + step.maskOffset,
+                                step.maskRows, step.maskColumns);
+            if (err != cudaSuccess)
+               return err;
+         }
+         else
+         {
+            launchKernel(filterChainTiles, dimGrid, dimBlock,
+                         input, output, height, width, channels, group, (const float *) deviceMasks);
+         }
+         for (int s = 0; s < group.count; ++s)
+            channels = filterChannels(group.steps[s], channels);
+         input = output;
+      }
+      return cudaGetLastError();
+   }
+
+   cudaError_t runOnHost(const float * inputImage, float * outputImage, int height, int width, int channels)
+   {
+      int halo = 0;
+      for (size_t s = 0; s < steps.size(); ++s)
+         halo += filterRadius(steps[s]);
+      int outputChannels = this->outputChannels(channels);
+      long stride = (long) width * FILTER_MAX_CHANNELS; // of a band row, whatever its channels
+      int bands = (height - 1) / FILTER_HOST_ROWS + 1;
+
+      cpuParallelFor(bands, 1, [&](size_t begin, size_t end) {
+         // sized for the widest stage; kept by the worker from one run to the next
+         static thread_local std::vector<float> buffers[2];
+         size_t bandLength = (size_t) (FILTER_HOST_ROWS + 2 * halo) * stride;
+         for (int b = 0; b < 2; ++b)
+            if (buffers[b].size() < bandLength)
+               buffers[b].resize(bandLength);
+         for (size_t band = begin; band < end; ++band)
+         {
+            int first = (int) band * FILTER_HOST_ROWS;
+            int last = std::min(first + FILTER_HOST_ROWS, height);
+            int top = first - halo; // image row of band row 0
+            int rows = last - first + 2 * halo;
+
+            for (int i = 0; i < rows; ++i)
+            {
+               float * target = &buffers[0][i * stride];
+               if (top + i < 0 || top + i >= height)
+                  std::fill(target, target + stride, 0.0f);
+               else
+                  std::copy(inputImage + (long) (top + i) * width * channels,
+                            inputImage + (long) (top + i + 1) * width * channels, target);
+            }
+
+            // valid rows: [margin, rows - margin) of buffers[current]
+            int current = 0;
+            int margin = 0;
+            int c = channels;
+            for (size_t s = 0; s < steps.size(); ++s)
+            {
+               const FilterStep& step = steps[s];
+               int radius = filterRadius(step);
+               int nextChannels = filterChannels(step, c);
+               bool inPlace = step.kind == FILTER_CLAMP || step.kind == FILTER_AFFINE;
+               std::vector<float>& source = buffers[current];
+               std::vector<float>& target = buffers[inPlace ? current : 1 - current];
+               long length = (long) width * c;
+               for (int i = margin + radius; i < rows - margin - radius; ++i)
+               {
+                  float * out = &target[i * stride];
+                  if (top + i < 0 || top + i >= height)
+                  {
+                     std::fill(out, out + stride, 0.0f);
+                     continue;
+                  }
+                  if (step.kind == FILTER_CONVOLUTION)
+                  {
+                     std::fill(out, out + length, 0.0f);
+                     const float * mask = &masks[step.maskOffset];
+                     for (int mi = 0; mi < step.maskRows; ++mi)
+                        for (int mj = 0; mj < step.maskColumns; ++mj)
+                           multiplyAddShifted(out, &source[(i - step.maskRows / 2 + mi) * stride], length,
+                                              (long) (mj - step.maskColumns / 2) * c, mask[mi * step.maskColumns + mj]);
+                  }
+                  else if (step.kind == FILTER_CLAMP)
+                  {
+                     for (long e = 0; e < length; ++e)
+                        out[e] = std::min(std::max(out[e], step.first), step.second);
+                  }
+                  else if (step.kind == FILTER_AFFINE)
+                  {
+                     for (long e = 0; e < length; ++e)
+                        out[e] = out[e] * step.first + step.second;
+                  }
+                  else
+                  {
+                     const float * in = &source[i * stride];
+                     for (int x = 0; x < width; ++x)
+                        filterPixel(step, in + (long) x * c, c, out + (long) x * nextChannels);
+                  }
+               }
+               if (!inPlace)
+                  current = 1 - current;
+               margin += radius;
+               c = nextChannels;
+            }
+
+            for (int i = 0; i < last - first; ++i)
+            {
+               const float * source = &buffers[current][(halo + i) * stride];
+               std::copy(source, source + (long) width * outputChannels,
+                         outputImage + (long) (first + i) * width * outputChannels);
+            }
+         }
+      });
+      return cudaSuccess;
+   }
+
+private:
+   FilterChain& pointStep(int kind, float first, float second)
+   {
+      FilterStep step = { kind, 0, 0, 0, first, second };
+      steps.push_back(step);
+      return *this;
+   }
+
+   // Uploads masks added since the last run and sizes the images between
+   // groups: one after the first group, two from the second on.
+   cudaError_t prepareDevice(size_t imageBytes, size_t groupCount)
+   {
+      cudaError_t err;
+      if (uploadedMasks != masks.size())
+      {
+         cudaFree(deviceMasks);
+         deviceMasks = NULL;
+         uploadedMasks = 0;
+         if (!masks.empty())
+         {
+            err = cudaMalloc((void **) &deviceMasks, masks.size() * sizeof(float));
+            if (err != cudaSuccess)
+               return err;
+            err = cudaMemcpy(deviceMasks, &masks[0], masks.size() * sizeof(float), cudaMemcpyHostToDevice);
+            if (err != cudaSuccess)
+               return err;
+         }
+         uploadedMasks = masks.size();
+      }
+
+      if (bufferBytes < imageBytes)
+      {
+         for (size_t b = 0; b < 2; ++b)
+         {
+            cudaFree(deviceBuffers[b]);
+            deviceBuffers[b] = NULL;
+         }
+         bufferBytes = imageBytes;
+      }
+      for (size_t b = 0; b < 2 && b + 1 < groupCount; ++b)
+         if (deviceBuffers[b] == NULL)
+         {
+            err = cudaMalloc((void **) &deviceBuffers[b], bufferBytes);
+            if (err != cudaSuccess)
+               return err;
+         }
+      return cudaSuccess;
+   }
+
+   std::vector<FilterStep> steps;
+   std::vector<float> masks;
+   float * deviceMasks;
+   size_t uploadedMasks;
+   float * deviceBuffers[2];
+   size_t bufferBytes;
+};
+
+#endif // FILTER_CHAIN_H
@@ -1,4 +1,9 @@
 #include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "Convolution2D.h"
+#include "SeparableConvolution.h"
+#include "FftConvolution.h"
+#include "StripConvolution.h"
 
 #define wbCheck(stmt) do {                                                    \
         cudaError_t err = stmt;                                               \
@@ -10,50 +15,77 @@
     } while(0)
 
 
-#define O_TILE_WIDTH 12
-#define MASK_WIDTH  5
-#define MASK_RADIUS MASK_WIDTH/2
-#define BLOCK_WIDTH (O_TILE_WIDTH + MASK_WIDTH - 1)
-
-//@@ INSERT CODE HERE
-__global__ void convolution_2D_kernel(float *inputImage, float *outputImage, int height, int width, int channels, const float * __restrict__ mask) 
-{
-   __shared__ float tile[BLOCK_WIDTH][BLOCK_WIDTH];
-
-   int tx = threadIdx.x;
-   int ty = threadIdx.y;
-   int row_o = blockIdx.y * O_TILE_WIDTH + ty;
-   int col_o = blockIdx.x * O_TILE_WIDTH + tx;
-   int row_i = row_o - MASK_RADIUS;
-   int col_i = col_o - MASK_RADIUS; 
-
-   for (int k = 0; k < channels; ++k)
-   {
-      if( (row_i >= 0) && (row_i < height) && (col_i >= 0) && (col_i < width) ) 
-         tile[ty][tx] = inputImage[(row_i * width + col_i) * channels + k];
-      else
-         tile[ty][tx] = 0.0f;
-
-      __syncthreads();
-
-      if(ty < O_TILE_WIDTH && tx < O_TILE_WIDTH)
-      {
-         float output = 0.0f;
-         for(int i = 0; i < MASK_WIDTH; ++i) 
-         {
-            for(int j = 0; j < MASK_WIDTH; ++j) 
-            {
-               output += mask[i * MASK_WIDTH + j] * tile[i + ty][j + tx];
-            }
-         }
-         if( row_o < height && col_o < width)
-            outputImage[(row_o * width + col_o) * channels + k] = output; 
-      }
-      
-      __syncthreads();
-   }
+/* The path picked at mask import: separable (deviceMask holds the column
+   factor, then the row factor), FFT or 2D. */
+static cudaError_t convolve(const float * deviceInput, float * deviceOutput, float * deviceIntermediate, void * deviceScratch,
+                            int height, int width, int channels,
+                            const float * deviceMask, int maskRows, int maskColumns, bool separable, bool fft) {
+    if (separable)
+        return separableConvolution(deviceInput, deviceOutput, deviceIntermediate, height, width, channels,
+                                    deviceMask, maskRows, deviceMask + maskRows, maskColumns);
+    if (fft)
+        return fftConvolution(deviceInput, deviceOutput, height, width, channels,
+                              deviceMask, maskRows, maskColumns, deviceScratch);
+    return convolution2D(deviceInput, deviceOutput, height, width, channels, deviceMask, maskRows, maskColumns);
 }
 
+/* Streams a .wbb image from the input file to the output file in strips,
+   within the budget of stripConvolutionBudget(). */
+static int convolveStrips(wbArg_t args, const char * inputImageFile, int imageHeight, int imageWidth, int imageChannels,
+                          const float * hostMaskData, int maskRows, int maskColumns,
+                          const float * hostColumnFactor, const float * hostRowFactor, bool separable) {
+    char * outputImageFile = wbArg_getOutputFile(args);
+    size_t rowBytes = (size_t) imageWidth * imageChannels * sizeof(float);
+    size_t budget = stripConvolutionBudget();
+    size_t scratchBytes;
+    float * deviceMaskData;
+    void * deviceScratch = NULL;
+    bool fft;
+    int stripRows;
+
+    separable = separable && separableConvolutionSupported(maskRows, maskColumns, imageChannels);
+    fft = !separable && convolutionPrefersFft(maskRows, maskColumns);
+
+    /* one FFT scratch serves every strip and comes out of the budget */
+    scratchBytes = fft ? fftConvolutionMaxScratchBytes() : 0;
+    stripRows = stripConvolutionRows(budget > scratchBytes ? budget - scratchBytes : 0, imageHeight, imageWidth,
+                                     imageChannels, maskRows, separable ? rowBytes : 0);
+    if (stripRows == 0 || outputImageFile == NULL) {
+        wbLog(ERROR, "Cannot stream ", inputImageFile, ": ", stripRows == 0 ? "budget too small" : "no output file");
+        return -1;
+    }
+    wbLog(TRACE, "Streaming ", imageHeight, " x ", imageWidth, " x ", imageChannels, " image in strips of ",
+          stripRows, " rows to ", outputImageFile);
+
+    wbTime_start(GPU, "Doing GPU Computation (memory + compute)");
+    if (separable) {
+        wbCheck(cudaMalloc((void **) &deviceMaskData, (maskRows + maskColumns) * sizeof(float)));
+        wbCheck(cudaMemcpy(deviceMaskData, hostColumnFactor, maskRows * sizeof(float), cudaMemcpyHostToDevice));
+        wbCheck(cudaMemcpy(deviceMaskData + maskRows, hostRowFactor, maskColumns * sizeof(float), cudaMemcpyHostToDevice));
+    } else {
+        wbCheck(cudaMalloc((void **) &deviceMaskData, maskRows * maskColumns * sizeof(float)));
+        wbCheck(cudaMemcpy(deviceMaskData, hostMaskData, maskRows * maskColumns * sizeof(float), cudaMemcpyHostToDevice));
+    }
+    if (fft)
+        wbCheck(cudaMalloc(&deviceScratch, scratchBytes));
+
+    wbTime_start(Compute, "Doing the computation on the GPU, strip by strip");
+    wbCheck(stripConvolution(inputImageFile, outputImageFile, maskRows, stripRows, separable ? rowBytes : 0,
+                             [&](const float * deviceStrip, float * deviceOutput, int rows, int width, int channels,
+                                 void * deviceStripScratch) {
+                                 return convolve(deviceStrip, deviceOutput, (float *) deviceStripScratch, deviceScratch,
+                                                 rows, width, channels, deviceMaskData, maskRows, maskColumns, separable, fft);
+                             }));
+    cudaDeviceSynchronize();
+    wbTime_stop(Compute, "Doing the computation on the GPU, strip by strip");
+    wbTime_stop(GPU, "Doing GPU Computation (memory + compute)");
+
+    cudaFree(deviceMaskData);
+    cudaFree(deviceScratch);
+    return 0;
+}
+
+
 int main(int argc, char* argv[]) {
     wbArg_t args;
     int maskRows;
@@ -68,20 +100,39 @@ int main(int argc, char* argv[]) {
     float * hostInputImageData;
     float * hostOutputImageData;
     float * hostMaskData;
+    float * hostColumnFactor;
+    float * hostRowFactor;
+    bool separable;
+    bool fft;
     float * deviceInputImageData;
     float * deviceOutputImageData;
+    float * deviceIntermediateImageData;
     float * deviceMaskData;
+    void * deviceScratch;
 
     args = wbArg_read(argc, argv); /* parse the input arguments */
 
     inputImageFile = wbArg_getInputFile(args, 0);
     inputMaskFile = wbArg_getInputFile(args, 1);
 
-    inputImage = wbImport(inputImageFile);
     hostMaskData = (float *) wbImport(inputMaskFile, &maskRows, &maskColumns);
 
-    assert(maskRows == 5); /* mask height is fixed to 5 in this mp */
-    assert(maskColumns == 5); /* mask width is fixed to 5 in this mp */
+    /* rank-1 masks run as a horizontal and a vertical 1D pass */
+    hostColumnFactor = (float *) malloc(maskRows * sizeof(float));
+    hostRowFactor = (float *) malloc(maskColumns * sizeof(float));
+    separable = factorSeparableMask(hostMaskData, maskRows, maskColumns, hostColumnFactor, hostRowFactor);
+
+    /* .wbb images may not fit in memory: they are streamed strip by strip */
+    if (stripImageShape(inputImageFile, &imageHeight, &imageWidth, &imageChannels)) {
+        int status = convolveStrips(args, inputImageFile, imageHeight, imageWidth, imageChannels,
+                                    hostMaskData, maskRows, maskColumns, hostColumnFactor, hostRowFactor, separable);
+        free(hostRowFactor);
+        free(hostColumnFactor);
+        free(hostMaskData);
+        return status;
+    }
+
+    inputImage = wbImport(inputImageFile);
 
     imageWidth = wbImage_getWidth(inputImage);
     imageHeight = wbImage_getHeight(inputImage);
@@ -92,12 +143,26 @@ int main(int argc, char* argv[]) {
     hostInputImageData = wbImage_getData(inputImage);
     hostOutputImageData = wbImage_getData(outputImage);
 
+    separable = separable && separableConvolutionSupported(maskRows, maskColumns, imageChannels);
+    /* large masks that are not separable go through the FFT */
+    fft = !separable && convolutionPrefersFft(maskRows, maskColumns);
+
     wbTime_start(GPU, "Doing GPU Computation (memory + compute)");
 
     wbTime_start(GPU, "Doing GPU memory allocation");
     cudaMalloc((void **) &deviceInputImageData, imageWidth * imageHeight * imageChannels * sizeof(float));
     cudaMalloc((void **) &deviceOutputImageData, imageWidth * imageHeight * imageChannels * sizeof(float));
-    cudaMalloc((void **) &deviceMaskData, maskRows * maskColumns * sizeof(float));
+    if (separable) {
+        /* the factors, column then row, take the place of the mask */
+        cudaMalloc((void **) &deviceIntermediateImageData, imageWidth * imageHeight * imageChannels * sizeof(float));
+        cudaMalloc((void **) &deviceMaskData, (maskRows + maskColumns) * sizeof(float));
+    } else {
+        deviceIntermediateImageData = NULL;
+        cudaMalloc((void **) &deviceMaskData, maskRows * maskColumns * sizeof(float));
+    }
+    deviceScratch = NULL;
+    if (fft)
+        cudaMalloc(&deviceScratch, fftConvolutionScratchBytes(imageHeight, imageWidth, maskRows, maskColumns));
     wbTime_stop(GPU, "Doing GPU memory allocation");
 
 
@@ -106,21 +171,30 @@ int main(int argc, char* argv[]) {
                hostInputImageData,
                imageWidth * imageHeight * imageChannels * sizeof(float),
                cudaMemcpyHostToDevice);
-    cudaMemcpy(deviceMaskData,
-               hostMaskData,
-               maskRows * maskColumns * sizeof(float),
-               cudaMemcpyHostToDevice);
+    if (separable) {
+        cudaMemcpy(deviceMaskData, hostColumnFactor, maskRows * sizeof(float), cudaMemcpyHostToDevice);
+        cudaMemcpy(deviceMaskData + maskRows, hostRowFactor, maskColumns * sizeof(float), cudaMemcpyHostToDevice);
+    } else {
+        cudaMemcpy(deviceMaskData,
+                   hostMaskData,
+                   maskRows * maskColumns * sizeof(float),
+                   cudaMemcpyHostToDevice);
+    }
     wbTime_stop(Copy, "Copying data to the GPU");
 
 
     wbTime_start(Compute, "Doing the computation on the GPU");
-    //@@ INSERT CODE HERE
-    dim3 dimBlock(BLOCK_WIDTH, BLOCK_WIDTH);
-    dim3 dimGrid( (imageWidth - 1) / O_TILE_WIDTH + 1, (imageHeight - 1) / O_TILE_WIDTH + 1, 1);
-    convolution_2D_kernel<<<dimGrid, dimBlock>>>(deviceInputImageData, deviceOutputImageData, 
-                                                 imageHeight, imageWidth, imageChannels,
-                                                 deviceMaskData);
-
+    if (separable)
+        wbLog(TRACE, "Mask of ", maskRows, " x ", maskColumns, " (separable, two 1D passes)");
+    else if (fft)
+        wbLog(TRACE, "Mask of ", maskRows, " x ", maskColumns, " (FFT, tiles of ",
+              fftConvolutionSize(imageHeight, imageWidth, maskRows, maskColumns), " pixels square)");
+    else
+        wbLog(TRACE, "Mask of ", maskRows, " x ", maskColumns, " (", convolution2DPath(maskRows, maskColumns), " convolution)");
+    wbCheck(convolve(deviceInputImageData, deviceOutputImageData, deviceIntermediateImageData, deviceScratch,
+                     imageHeight, imageWidth, imageChannels,
+                     deviceMaskData, maskRows, maskColumns, separable, fft));
+    cudaDeviceSynchronize();
     wbTime_stop(Compute, "Doing the computation on the GPU");
 
 
@@ -137,8 +211,12 @@ int main(int argc, char* argv[]) {
 
     cudaFree(deviceInputImageData);
     cudaFree(deviceOutputImageData);
+    cudaFree(deviceIntermediateImageData);
     cudaFree(deviceMaskData);
+    cudaFree(deviceScratch);
 
+    free(hostRowFactor);
+    free(hostColumnFactor);
     free(hostMaskData);
     wbImage_delete(outputImage);
     wbImage_delete(inputImage);
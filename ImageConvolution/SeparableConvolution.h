@@ -0,0 +1,248 @@
+// Convolution with separable masks as two 1D passes.
+//
+// A mask of rank 1 is the outer product of a column and a row,
+// mask[i][j] = column[i] * row[j] (Gaussian and box filters are), and the 2D
+// convolution is then a horizontal convolution with row followed by a
+// vertical one with column: maskRows + maskColumns multiply-adds per output
+// instead of maskRows * maskColumns.
+//
+// factorSeparableMask() finds the factors when the mask is imported. It
+// starts from the row and column of the largest entry, refines them by
+// alternating least squares (a few steps of the power method on the mask) and
+// accepts them when no entry of the mask differs from column[i] * row[j] by
+// more than SEPARABLE_MASK_TOLERANCE times the largest entry; masks that fail
+// go to convolution2D.
+//
+//    convolutionRows      horizontal pass into an intermediate image; each
+//                         block stages a segment of a row, halo included, in
+//                         shared memory, so the channel-strided taps read
+//                         shared memory and the loads are contiguous
+//    convolutionColumns   vertical pass from the intermediate; neighbouring
+//                         threads read neighbouring elements of every row,
+//                         so the taps are coalesced and the rows reused from
+//                         the cache
+//
+// Without nvcc the passes run on the CPU executor pool strip by strip: the
+// horizontal pass of the SEPARABLE_HOST_STRIP rows of a strip (plus the halo
+// rows) goes to a per-thread intermediate that stays in the cache, and the
+// vertical pass reads it from there; both passes are written as
+// multiply-adds of whole rows, which the compiler vectorizes. -DEMULATE_KERNELS
+// runs the two kernels on the executor instead.
+//
+// Pixels outside the image count as zero, as in convolution2D, and the mask
+// is centered on maskRows / 2, maskColumns / 2.
+
+#ifndef SEPARABLE_CONVOLUTION_H
+#define SEPARABLE_CONVOLUTION_H
+
+#include "Convolution2D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define SEPARABLE_MASK_TOLERANCE 1e-5f
+#define SEPARABLE_REFINEMENT_STEPS 8
+#define SEPARABLE_MAX_WIDTH 31    // mask columns the shared row segment has room for
+#define SEPARABLE_MAX_CHANNELS 4
+#define SEPARABLE_BLOCK_SIZE 256
+#define SEPARABLE_ROW_SEGMENT 1024 // row elements (pixels x channels) per block of the horizontal pass
+#define SEPARABLE_COLUMN_ROWS 16   // output rows per thread of the vertical pass
+#define SEPARABLE_HOST_STRIP 32    // output rows per host task
+
+// True when mask (rows x columns) is columnFactor * rowFactor within the
+// tolerance; the factors are set either way.
+inline bool factorSeparableMask(const float * mask, int rows, int columns, float * columnFactor, float * rowFactor,
+                                float tolerance = SEPARABLE_MASK_TOLERANCE)
+{
+   if (rows <= 0 || columns <= 0)
+      return false;
+
+   int pivot = 0;
+   for (int i = 1; i < rows * columns; ++i)
+      if (fabsf(mask[i]) > fabsf(mask[pivot]))
+         pivot = i;
+   float largest = fabsf(mask[pivot]);
+   if (largest == 0.0f)
+   {
+      std::fill(columnFactor, columnFactor + rows, 0.0f);
+      std::fill(rowFactor, rowFactor + columns, 0.0f);
+      return true;
+   }
+
+   std::vector<double> column(rows);
+   std::vector<double> row(columns);
+   for (int j = 0; j < columns; ++j)
+      row[j] = mask[(pivot / columns) * columns + j];
+
+   for (int step = 0; step < SEPARABLE_REFINEMENT_STEPS; ++step)
+   {
+      // column = mask row / |row|^2, then row = mask^T column / |column|^2
+      double norm = 0.0;
+      for (int j = 0; j < columns; ++j)
+         norm += row[j] * row[j];
+      for (int i = 0; i < rows; ++i)
+      {
+         double sum = 0.0;
+         for (int j = 0; j < columns; ++j)
+            sum += mask[i * columns + j] * row[j];
+         column[i] = sum / norm;
+      }
+
+      norm = 0.0;
+      for (int i = 0; i < rows; ++i)
+         norm += column[i] * column[i];
+      for (int j = 0; j < columns; ++j)
+      {
+         double sum = 0.0;
+         for (int i = 0; i < rows; ++i)
+            sum += mask[i * columns + j] * column[i];
+         row[j] = sum / norm;
+      }
+   }
+
+   for (int i = 0; i < rows; ++i)
+      columnFactor[i] = (float) column[i];
+   for (int j = 0; j < columns; ++j)
+      rowFactor[j] = (float) row[j];
+
+   for (int i = 0; i < rows; ++i)
+      for (int j = 0; j < columns; ++j)
+         if (fabs(mask[i * columns + j] - column[i] * row[j]) > tolerance * largest)
+            return false;
+   return true;
+}
+
+// True when separableConvolution handles this mask and image.
+inline bool separableConvolutionSupported(int maskRows, int maskColumns, int channels)
+{
+   return maskRows >= 1 && maskColumns >= 1 && maskColumns <= SEPARABLE_MAX_WIDTH &&
+          channels >= 1 && channels <= SEPARABLE_MAX_CHANNELS;
+}
+
+// One block: SEPARABLE_ROW_SEGMENT elements of one row. The rows are folded
+// into gridDim.x, segmentsPerRow blocks each, so that images taller than the
+// 65535 blocks of gridDim.y launch.
+__global__ void convolutionRows(const float *inputImage, float *outputImage, int width, int channels,
+                                const float * __restrict__ rowFactor, int maskColumns, unsigned int segmentsPerRow)
+{
+   __shared__ float segment[SEPARABLE_ROW_SEGMENT + (SEPARABLE_MAX_WIDTH - 1) * SEPARABLE_MAX_CHANNELS];
+
+   long rowLength = (long) width * channels;
+   long row = blockIdx.x / segmentsPerRow;
+   const float * inputRow = inputImage + row * rowLength;
+   long first = (long) (blockIdx.x % segmentsPerRow) * SEPARABLE_ROW_SEGMENT;
+   long haloStart = first - (long) (maskColumns / 2) * channels;
+   int loaded = SEPARABLE_ROW_SEGMENT + (maskColumns - 1) * channels;
+
+   for (int i = threadIdx.x; i < loaded; i += blockDim.x)
+   {
+      long element = haloStart + i;
+      segment[i] = element >= 0 && element < rowLength ? inputRow[element] : 0.0f;
+   }
+
+   __syncthreads();
+
+   for (int o = threadIdx.x; o < SEPARABLE_ROW_SEGMENT && first + o < rowLength; o += blockDim.x)
+   {
+      float output = 0.0f;
+      for (int j = 0; j < maskColumns; ++j)
+         output += rowFactor[j] * segment[o + j * channels];
+      outputImage[row * rowLength + first + o] = output;
+   }
+}
+
+// One thread: element x of SEPARABLE_COLUMN_ROWS consecutive rows, and of
+// the same rows gridDim.y bands further down while the image goes on.
+__global__ void convolutionColumns(const float *intermediateImage, float *outputImage, int height, int width, int channels,
+                                   const float * __restrict__ columnFactor, int maskRows)
+{
+   long rowLength = (long) width * channels;
+   long x = blockIdx.x * (long) blockDim.x + threadIdx.x;
+   if (x >= rowLength)
+      return;
+
+   for (int firstRow = blockIdx.y * SEPARABLE_COLUMN_ROWS; firstRow < height; firstRow += gridDim.y * SEPARABLE_COLUMN_ROWS)
+   {
+      int lastRow = firstRow + SEPARABLE_COLUMN_ROWS < height ? firstRow + SEPARABLE_COLUMN_ROWS : height;
+      for (int row = firstRow; row < lastRow; ++row)
+      {
+         int top = row - maskRows / 2;
+         float output = 0.0f;
+         for (int i = top < 0 ? -top : 0; i < maskRows && top + i < height; ++i)
+            output += columnFactor[i] * intermediateImage[(top + i) * rowLength + x];
+         outputImage[row * rowLength + x] = output;
+      }
+   }
+}
+
+inline void separableConvolutionHost(const float *inputImage, float *outputImage, int height, int width, int channels,
+                                     const float *columnFactor, int maskRows, const float *rowFactor, int maskColumns)
+{
+   long rowLength = (long) width * channels;
+   int strips = (height - 1) / SEPARABLE_HOST_STRIP + 1;
+
+   cpuParallelFor(strips, 1, [&](size_t begin, size_t end) {
+      // one intermediate per worker thread, reused across strips and calls
+      static thread_local std::vector<float> intermediate;
+      if (intermediate.size() < (size_t) (SEPARABLE_HOST_STRIP + maskRows - 1) * rowLength)
+         intermediate.resize((size_t) (SEPARABLE_HOST_STRIP + maskRows - 1) * rowLength);
+      for (size_t strip = begin; strip < end; ++strip)
+      {
+         int firstRow = (int) strip * SEPARABLE_HOST_STRIP;
+         int lastRow = std::min(firstRow + SEPARABLE_HOST_STRIP, height);
+         int top = firstRow - maskRows / 2; // image row of intermediate row 0
+         int intermediateRows = lastRow - firstRow + maskRows - 1;
+
+         for (int r = 0; r < intermediateRows; ++r)
+         {
+            float * target = &intermediate[r * rowLength];
+            std::fill(target, target + rowLength, 0.0f);
+            if (top + r < 0 || top + r >= height)
+               continue;
+            const float * source = inputImage + (top + r) * rowLength;
+            for (int j = 0; j < maskColumns; ++j)
+               multiplyAddShifted(target, source, rowLength, (long) (j - maskColumns / 2) * channels, rowFactor[j]);
+         }
+
+         for (int row = firstRow; row < lastRow; ++row)
+         {
+            float * target = outputImage + row * rowLength;
+            std::fill(target, target + rowLength, 0.0f);
+            for (int i = 0; i < maskRows; ++i)
+               multiplyAddShifted(target, &intermediate[(row - firstRow + i) * rowLength], rowLength, 0, columnFactor[i]);
+         }
+      }
+   });
+}
+
+// outputImage = inputImage (height x width x channels, on the device)
+// convolved with the mask deviceColumnFactor * deviceRowFactor, through
+// deviceIntermediateImage (same size as the image; not used by the host passes).
+inline cudaError_t separableConvolution(const float *deviceInputImage, float *deviceOutputImage, float *deviceIntermediateImage,
+                                        int height, int width, int channels,
+                                        const float *deviceColumnFactor, int maskRows, const float *deviceRowFactor, int maskColumns)
+{
+   if (height <= 0 || width <= 0 || channels <= 0)
+      return cudaSuccess;
+
+#ifdef RUN_KERNELS
+   long rowLength = (long) width * channels;
+   unsigned int segmentsPerRow = (unsigned int) ((rowLength - 1) / SEPARABLE_ROW_SEGMENT + 1);
+   dim3 rowsGrid(segmentsPerRow * height, 1, 1);
+   launchKernel(convolutionRows, rowsGrid, dim3(SEPARABLE_BLOCK_SIZE, 1, 1),
+                deviceInputImage, deviceIntermediateImage, width, channels, deviceRowFactor, maskColumns, segmentsPerRow);
+   int bands = (height - 1) / SEPARABLE_COLUMN_ROWS + 1;
+   dim3 columnsGrid((unsigned int) ((rowLength - 1) / SEPARABLE_BLOCK_SIZE + 1), bands < 65535 ? bands : 65535, 1);
+   launchKernel(convolutionColumns, columnsGrid, dim3(SEPARABLE_BLOCK_SIZE, 1, 1),
+                (const float *) deviceIntermediateImage, deviceOutputImage, height, width, channels, deviceColumnFactor, maskRows);
+   return cudaGetLastError();
+#else
+   (void) deviceIntermediateImage;
+   separableConvolutionHost(deviceInputImage, deviceOutputImage, height, width, channels,
+                            deviceColumnFactor, maskRows, deviceRowFactor, maskColumns);
+   return cudaSuccess;
+#endif
+}
+
+#endif // SEPARABLE_CONVOLUTION_H
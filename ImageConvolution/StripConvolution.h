@@ -0,0 +1,270 @@
+// Convolution of images larger than memory, streamed in horizontal strips.
+//
+// The image is a .wbb file of BinaryDataset.h (rank 3: height, width,
+// channels, float32; ConvertDataset makes one from a PPM) and the result is
+// written to another. Neither is ever held whole: the image is cut into
+// strips of stripRows output rows, and strip s is read together with the
+// maskRows / 2 rows above it and the maskRows - 1 - maskRows / 2 rows below
+// it (the halo; none past the edges of the image, which count as zero as in
+// convolution2D), so that its rows of output come out exact.
+//
+// Three strips are in flight at a time: while strip s is convolved, strip
+// s + 1 is read by one thread (pread) and strip s - 1 written by another
+// (pwrite). Every stage has two host buffers and alternates between them; a
+// buffer is reused only once the read or write of the strip before last is
+// done with it. With nvcc the strip goes through a device input and output
+// buffer; without it device memory is host memory and the strip is
+// convolved straight from the input buffer into the output buffer.
+//
+// The convolution itself is a functor, so any of the convolution paths can
+// run on the strips:
+//
+//    cudaError_t operator()(const float *deviceInput, float *deviceOutput,
+//                           int rows, int width, int channels, void *deviceStripScratch) const;
+//
+// rows counts the halo rows as well; deviceStripScratch holds
+// deviceBytesPerRow bytes per row of the strip (a separable intermediate,
+// for instance).
+//
+// The memory used is bounded by the strip size, not the image size:
+// stripConvolutionRows() picks the largest strip whose buffers fit in a
+// budget, by default STRIP_CONVOLUTION_DEFAULT_BUDGET or the number of MiB in
+// the CONVOLUTION_STRIP_BUDGET_MB environment variable.
+
+#ifndef STRIP_CONVOLUTION_H
+#define STRIP_CONVOLUTION_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+#include "../BinaryDataset/BinaryDataset.h"
+
+#include <algorithm>
+#include <future>
+
+#define STRIP_CONVOLUTION_DEFAULT_BUDGET ((size_t) 256 << 20)
+
+struct StripImage
+{
+   int fd;
+   int height;
+   int width;
+   int channels;
+   uint64_t payloadOffset;
+};
+
+// Opens a float32 .wbb image; false if the file is missing or is not one.
+// The image is never mapped whole, so it may hold more than INT_MAX values.
+inline bool stripImageOpen(const char * file, StripImage * image)
+{
+   image->fd = open(file, O_RDONLY);
+   if (image->fd < 0)
+      return false;
+
+   wbBinary_header header;
+   if (!wbBinary_readHeader(image->fd, wbBinary_float32, &header, (uint64_t) 1 << 60) || header.rank != 3)
+   {
+      close(image->fd);
+      return false;
+   }
+   image->height = (int) header.shape[0];
+   image->width = (int) header.shape[1];
+   image->channels = (int) header.shape[2];
+   image->payloadOffset = header.payloadOffset;
+   return true;
+}
+
+// True, with the shape, when stripConvolution can stream the file.
+inline bool stripImageShape(const char * file, int * height, int * width, int * channels)
+{
+   StripImage image;
+   if (!stripImageOpen(file, &image))
+      return false;
+   close(image.fd);
+   *height = image.height;
+   *width = image.width;
+   *channels = image.channels;
+   return true;
+}
+
+inline size_t stripConvolutionBudget()
+{
+   if (const char * env = getenv("CONVOLUTION_STRIP_BUDGET_MB"))
+   {
+      long megabytes = atol(env);
+      if (megabytes > 0)
+         return (size_t) megabytes << 20;
+   }
+   return STRIP_CONVOLUTION_DEFAULT_BUDGET;
+}
+
+// Output rows per strip whose buffers fit in budgetBytes: two host input and
+// two host output buffers, with nvcc a device input and output buffer, and
+// deviceBytesPerRow, all for the strip and its halo. 0 when not even one row
+// fits.
+inline int stripConvolutionRows(size_t budgetBytes, int height, int width, int channels, int maskRows,
+                                size_t deviceBytesPerRow)
+{
+   size_t rowBytes = (size_t) width * channels * sizeof(float);
+#ifdef __CUDACC__
+   size_t bytesPerRow = 6 * rowBytes + deviceBytesPerRow;
+#else
+   size_t bytesPerRow = 4 * rowBytes + deviceBytesPerRow;
+#endif
+   long rows = (long) (budgetBytes / bytesPerRow) - (maskRows - 1);
+   return (int) std::max(0L, std::min(rows, (long) height));
+}
+
+inline bool stripRead(int fd, uint64_t offset, void * buffer, size_t bytes)
+{
+   char * cursor = (char *) buffer;
+   while (bytes > 0)
+   {
+      ssize_t done = pread(fd, cursor, bytes, (off_t) offset);
+      if (done <= 0)
+         return false;
+      cursor += done;
+      offset += done;
+      bytes -= done;
+   }
+   return true;
+}
+
+inline bool stripWrite(int fd, uint64_t offset, const void * buffer, size_t bytes)
+{
+   const char * cursor = (const char *) buffer;
+   while (bytes > 0)
+   {
+      ssize_t done = pwrite(fd, cursor, bytes, (off_t) offset);
+      if (done <= 0)
+         return false;
+      cursor += done;
+      offset += done;
+      bytes -= done;
+   }
+   return true;
+}
+
+// Convolves the image in inputFile into outputFile, stripRows output rows at
+// a time. Returns cudaErrorInvalidValue when a file cannot be read or
+// written, or the first error of convolve.
+template <typename Convolve>
+cudaError_t stripConvolution(const char * inputFile, const char * outputFile, int maskRows, int stripRows,
+                             size_t deviceBytesPerRow, Convolve convolve)
+{
+   StripImage image;
+   if (stripRows <= 0 || !stripImageOpen(inputFile, &image))
+      return cudaErrorInvalidValue;
+
+   int output = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   uint64_t shape[3] = { (uint64_t) image.height, (uint64_t) image.width, (uint64_t) image.channels };
+   wbBinary_header header = wbBinary_makeHeader(wbBinary_float32, 3, shape);
+   if (output < 0 || !stripWrite(output, 0, &header, sizeof(header)))
+   {
+      if (output >= 0)
+         close(output);
+      close(image.fd);
+      return cudaErrorInvalidValue;
+   }
+
+   int top = maskRows / 2;
+   int bottom = maskRows - 1 - top;
+   size_t rowLength = (size_t) image.width * image.channels;
+   size_t rowBytes = rowLength * sizeof(float);
+   size_t bufferBytes = (size_t) (stripRows + maskRows - 1) * rowBytes;
+   int strips = image.height == 0 ? 0 : (image.height - 1) / stripRows + 1;
+
+   // input rows of strip s: [firstInput(s), lastInput(s))
+   auto firstInput = [&](int strip) { return std::max(strip * stripRows - top, 0); };
+   auto lastInput = [&](int strip) { return std::min((strip + 1) * stripRows + bottom, image.height); };
+   auto load = [&](int strip, float * buffer) {
+      return stripRead(image.fd, image.payloadOffset + (uint64_t) firstInput(strip) * rowBytes, buffer,
+                       (size_t) (lastInput(strip) - firstInput(strip)) * rowBytes);
+   };
+   auto store = [&](int strip, const float * rows) {
+      int first = strip * stripRows;
+      int last = std::min(first + stripRows, image.height);
+      return stripWrite(output, header.payloadOffset + (uint64_t) first * rowBytes, rows, (size_t) (last - first) * rowBytes);
+   };
+
+   float * hostInput[2] = { NULL, NULL };
+   float * hostOutput[2] = { NULL, NULL };
+   float * deviceInput = NULL;
+   float * deviceOutput = NULL;
+   void * deviceStripScratch = NULL;
+   cudaError_t err = cudaSuccess;
+   for (int b = 0; b < 2 && err == cudaSuccess; ++b)
+   {
+      err = cudaMallocHost((void **) &hostInput[b], bufferBytes);
+      if (err == cudaSuccess)
+         err = cudaMallocHost((void **) &hostOutput[b], bufferBytes);
+   }
+#ifdef __CUDACC__
+   if (err == cudaSuccess)
+      err = cudaMalloc((void **) &deviceInput, bufferBytes);
+   if (err == cudaSuccess)
+      err = cudaMalloc((void **) &deviceOutput, bufferBytes);
+#endif
+   if (err == cudaSuccess && deviceBytesPerRow > 0)
+      err = cudaMalloc(&deviceStripScratch, (size_t) (stripRows + maskRows - 1) * deviceBytesPerRow);
+
+   std::future<bool> loading;
+   std::future<bool> writing[2];
+   if (err == cudaSuccess && strips > 0)
+      loading = std::async(std::launch::async, load, 0, hostInput[0]);
+
+   for (int strip = 0; strip < strips && err == cudaSuccess; ++strip)
+   {
+      if (!loading.get())
+      {
+         err = cudaErrorInvalidValue;
+         break;
+      }
+      if (strip + 1 < strips)
+         loading = std::async(std::launch::async, load, strip + 1, hostInput[(strip + 1) % 2]);
+
+      float * in = hostInput[strip % 2];
+      float * out = hostOutput[strip % 2];
+      if (writing[strip % 2].valid() && !writing[strip % 2].get())
+      {
+         err = cudaErrorInvalidValue;
+         break;
+      }
+
+      int rows = lastInput(strip) - firstInput(strip);
+      size_t skipped = (size_t) (strip * stripRows - firstInput(strip)) * rowLength; // halo rows above the strip
+#ifdef __CUDACC__
+      err = cudaMemcpy(deviceInput, in, (size_t) rows * rowBytes, cudaMemcpyHostToDevice);
+      if (err == cudaSuccess)
+         err = convolve((const float *) deviceInput, deviceOutput, rows, image.width, image.channels, deviceStripScratch);
+      if (err == cudaSuccess)
+         err = cudaMemcpy(out + skipped, deviceOutput + skipped,
+                          (size_t) (std::min((strip + 1) * stripRows, image.height) - strip * stripRows) * rowBytes,
+                          cudaMemcpyDeviceToHost);
+#else
+      err = convolve((const float *) in, out, rows, image.width, image.channels, deviceStripScratch);
+#endif
+      if (err == cudaSuccess)
+         writing[strip % 2] = std::async(std::launch::async, store, strip, (const float *) out + skipped);
+   }
+
+   // the buffers are freed only once no read or write uses them
+   if (loading.valid())
+      loading.wait();
+   for (int b = 0; b < 2; ++b)
+      if (writing[b].valid() && !writing[b].get() && err == cudaSuccess)
+         err = cudaErrorInvalidValue;
+
+   for (int b = 0; b < 2; ++b)
+   {
+      cudaFreeHost(hostInput[b]);
+      cudaFreeHost(hostOutput[b]);
+   }
+   cudaFree(deviceInput);
+   cudaFree(deviceOutput);
+   cudaFree(deviceStripScratch);
+   if (close(output) != 0 && err == cudaSuccess)
+      err = cudaErrorInvalidValue;
+   close(image.fd);
+   return err;
+}
+
+#endif // STRIP_CONVOLUTION_H
@@ -3,6 +3,11 @@
 // Output its sum = lst[0] + lst[1] + ... + lst[n-1];
 
 #include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../BinaryDataset/BinaryDataset.h"
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
 #include <sstream>
 
 void printList(float *list, int N)
@@ -73,7 +78,11 @@ int main(int argc, char ** argv)
     args = wbArg_read(argc, argv);
 
     wbTime_start(Generic, "Importing data and creating memory on host");
-    hostInput = (float *) wbImport(wbArg_getInputFile(args, 0), &numInputElements);
+    hostInput = (float *) wbBinary_import(wbArg_getInputFile(args, 0), &numInputElements);
+    if (hostInput == NULL) {
+        wbLog(ERROR, "Failed to import ", wbArg_getInputFile(args, 0));
+        return -1;
+    }
 
     numOutputElements = numInputElements / (BLOCK_SIZE << 1);
     if (numInputElements % (BLOCK_SIZE << 1) ) 
@@ -104,7 +113,11 @@ int main(int argc, char ** argv)
 
     wbTime_start(Compute, "Performing CUDA computation");
     //@@ Launch the GPU Kernel
+#ifdef __CUDACC__
     total<<< DimGrid, DimBlock >>>(deviceInput, deviceOutput, numInputElements);
+#else
+    cpuLaunch(DimGrid, DimBlock, total, deviceInput, deviceOutput, numInputElements);
+#endif
 
     cudaDeviceSynchronize();
     wbTime_stop(Compute, "Performing CUDA computation");
@@ -148,7 +161,7 @@ int main(int argc, char ** argv)
 
     wbSolution(args, hostOutput, 1);
 
-    free(hostInput);
+    wbBinary_free(hostInput);
     free(hostOutput);
 
     return 0;
@@ -0,0 +1,175 @@
+// MP Reduction
+// Given a list (lst) of length n
+// Output its sum = lst[0] + lst[1] + ... + lst[n-1];
+//
+// Unlike EfficientListReduction, the partial sums never leave the device:
+// the block sums are reduced again by the same kernel, level after level,
+// until a single value remains, and only that scalar is copied to the host.
+//
+// Built with -DREPRODUCIBLE_REDUCTION the sum comes from reduceReproducible
+// instead, whose bits do not depend on BLOCK_SIZE or on the number of threads,
+// so the output can be compared with a golden file.
+
+#include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../BinaryDataset/BinaryDataset.h"
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
+#ifdef REPRODUCIBLE_REDUCTION
+#include "ReductionEngine.h"
+#endif
+
+#define BLOCK_SIZE 512 //@@ You can change this
+#define ELEMENTS_PER_BLOCK (2 * BLOCK_SIZE)
+
+#define wbCheck(stmt) do {                                                    \
+        cudaError_t err = stmt;                                               \
+        if (err != cudaSuccess) {                                             \
+            wbLog(ERROR, "Failed to run stmt ", #stmt);                       \
+            wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));    \
+            return -1;                                                        \
+        }                                                                     \
+    } while(0)
+
+__global__ void total(float * input, float * output, int len)
+{
+    __shared__ float partialSum[2 * BLOCK_SIZE];
+
+    unsigned int t = threadIdx.x;
+    unsigned int start = 2 * blockIdx.x * blockDim.x;
+
+    //@@ Load a segment of the input vector into shared memory
+    if (start + t < (unsigned int) len)
+       partialSum[t] = input[start + t];
+    else
+       partialSum[t] = 0.0f;
+
+    if (start + blockDim.x + t < (unsigned int) len)
+       partialSum[blockDim.x + t] = input[start + blockDim.x + t];
+    else
+       partialSum[blockDim.x + t] = 0.0f;
+
+    __syncthreads();
+
+    //@@ Traverse the reduction tree
+    for (unsigned int stride = blockDim.x; stride > 0; stride /= 2)
+    {
+       if (t < stride )
+          partialSum[t] += partialSum[t + stride];
+
+       __syncthreads();
+    }
+
+    //@@ Write the computed sum of the block to the output vector at the correct index
+    if (t == 0)
+       output[blockIdx.x] = partialSum[0];
+}
+
+int numBlockSums(int len)
+{
+    return (len - 1) / ELEMENTS_PER_BLOCK + 1;
+}
+
+// Device memory reduceOnDevice needs for an input of len elements: the block
+// sums of the first level and, behind them, those of the second level; deeper
+// levels reuse the two halves in turn.
+int reduceScratchLength(int len)
+{
+    int firstLevel = numBlockSums(len);
+    return firstLevel + numBlockSums(firstLevel);
+}
+
+void launchTotal(float * input, float * output, int len)
+{
+    dim3 DimGrid(numBlockSums(len), 1, 1);
+    dim3 DimBlock(BLOCK_SIZE, 1, 1);
+#ifdef __CUDACC__
+    total<<< DimGrid, DimBlock >>>(input, output, len);
+#else
+    cpuLaunch(DimGrid, DimBlock, total, input, output, len);
+#endif
+}
+
+// Sums the len elements of deviceInput (len > 0) on the device and copies the
+// result to *hostResult. deviceScratch holds reduceScratchLength(len) floats.
+cudaError_t reduceOnDevice(float * deviceInput, int len, float * deviceScratch, float * hostResult)
+{
+    float * levels[2] = { deviceScratch, deviceScratch + numBlockSums(len) };
+
+    float * input = deviceInput;
+    int level = 0;
+    do
+    {
+       float * output = levels[level % 2];
+       launchTotal(input, output, len);
+       input = output;
+       len = numBlockSums(len);
+       ++level;
+    } while (len > 1);
+
+    cudaError_t err = cudaGetLastError();
+    if (err != cudaSuccess)
+       return err;
+    return cudaMemcpy(hostResult, input, sizeof(float), cudaMemcpyDeviceToHost);
+}
+
+int main(int argc, char ** argv)
+{
+    wbArg_t args;
+    float * hostInput; // The input 1D list
+    float hostOutput; // The sum of the list
+    float * deviceInput;
+    float * deviceScratch;
+    int numInputElements; // number of elements in the input list
+    int numScratchElements; // number of block sums kept on the device
+
+    args = wbArg_read(argc, argv);
+
+    wbTime_start(Generic, "Importing data and creating memory on host");
+    hostInput = (float *) wbBinary_import(wbArg_getInputFile(args, 0), &numInputElements);
+    if (hostInput == NULL) {
+        wbLog(ERROR, "Failed to import ", wbArg_getInputFile(args, 0));
+        return -1;
+    }
+#ifdef REPRODUCIBLE_REDUCTION
+    numScratchElements = (int) reproducibleScratchLength(numInputElements);
+#else
+    numScratchElements = reduceScratchLength(numInputElements);
+#endif
+    wbTime_stop(Generic, "Importing data and creating memory on host");
+
+    wbLog(TRACE, "The number of input elements in the input is ", numInputElements);
+    wbLog(TRACE, "The number of block sums kept on the device is ", numScratchElements);
+
+    wbTime_start(GPU, "Allocating GPU memory.");
+    wbCheck(cudaMalloc((void **) &deviceInput, numInputElements * sizeof(float)));
+    wbCheck(cudaMalloc((void **) &deviceScratch, numScratchElements * sizeof(float)));
+    wbTime_stop(GPU, "Allocating GPU memory.");
+
+    wbTime_start(GPU, "Copying input memory to the GPU.");
+    wbCheck(cudaMemcpy(deviceInput, hostInput, numInputElements * sizeof(float), cudaMemcpyHostToDevice));
+    wbTime_stop(GPU, "Copying input memory to the GPU.");
+
+    wbTime_start(Compute, "Performing CUDA computation");
+#ifdef REPRODUCIBLE_REDUCTION
+    wbCheck(reduceReproducible<SumOp<float> >(deviceInput, numInputElements, deviceScratch, &hostOutput));
+#else
+    if (numInputElements > 0)
+       wbCheck(reduceOnDevice(deviceInput, numInputElements, deviceScratch, &hostOutput));
+    else
+       hostOutput = 0.0f;
+#endif
+    wbTime_stop(Compute, "Performing CUDA computation");
+
+    wbTime_start(GPU, "Freeing GPU Memory");
+    wbCheck(cudaFree(deviceInput));
+    wbCheck(cudaFree(deviceScratch));
+    wbTime_stop(GPU, "Freeing GPU Memory");
+
+    wbSolution(args, &hostOutput, 1);
+
+    wbBinary_free(hostInput);
+
+    return 0;
+}
@@ -0,0 +1,447 @@
+// Generic reduction engine: one implementation of the reduction tree for
+// every operator and value type.
+//
+// total() in the ListReduction labs and computeMinimumCDF_kernel() in
+// HistogramEqualization.cpp were the same shared-memory tree with + swapped
+// for min and the identity (0.0f, 1.0f) written into the loads. Here the
+// operator is a template parameter that brings its own identity:
+//
+//    float sum;
+//    wbCheck(reduce<SumOp<float> >(deviceInput, len, deviceScratch, &sum));
+//
+//    ArgValue<int> smallest;   // .value and .index of the first minimum
+//    wbCheck(reduce<ArgMinOp<int> >(deviceInts, len, argScratch, &smallest));
+//
+// An operator defines
+//
+//    Input                       element type of the input array
+//    Value                       type that is reduced (the result type)
+//    identity()                  combine(identity(), v) == v
+//    load(input, i)              the Value of element i
+//    combine(a, b)               associative (and commutative) operator
+//
+// SumOp, ProductOp, MinOp, MaxOp, ArgMinOp, ArgMaxOp, LogicalAndOp and
+// LogicalOrOp are provided for float, double, int32_t and int64_t.
+//
+// On the GPU a grid of at most REDUCTION_MAX_BLOCKS blocks walks the input
+// with a grid stride, each thread combining its elements in a register, and
+// each block reduces its threads in shared memory; a second launch of one
+// block reduces the block results. deviceScratch holds
+// reductionScratchLength() Values. Only the result is copied to the host.
+//
+// Without nvcc the input is cut into chunks of REDUCTION_HOST_CHUNK elements
+// that are reduced on the CPU executor thread pool; within a chunk
+// REDUCTION_HOST_LANES independent accumulators (lane l takes the elements
+// l, l + LANES, ...) let the compiler use SIMD registers. The chunk results
+// are combined in chunk order, so the result does not depend on the number
+// of threads. -DEMULATE_KERNELS runs the kernels on the executor instead.
+
+#ifndef REDUCTION_ENGINE_H
+#define REDUCTION_ENGINE_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define REDUCTION_BLOCK_SIZE 256
+#define REDUCTION_MAX_BLOCKS 1024
+#define REDUCTION_HOST_LANES 16
+#define REDUCTION_HOST_CHUNK (64 * 1024)
+
+// Identities of min and max.
+template <typename T> struct ReductionLimits;
+
+template <> struct ReductionLimits<float>
+{
+   static __host__ __device__ float lowest() { return -HUGE_VALF; }
+   static __host__ __device__ float highest() { return HUGE_VALF; }
+};
+
+template <> struct ReductionLimits<double>
+{
+   static __host__ __device__ double lowest() { return -HUGE_VAL; }
+   static __host__ __device__ double highest() { return HUGE_VAL; }
+};
+
+template <> struct ReductionLimits<int32_t>
+{
+   static __host__ __device__ int32_t lowest() { return INT32_MIN; }
+   static __host__ __device__ int32_t highest() { return INT32_MAX; }
+};
+
+template <> struct ReductionLimits<int64_t>
+{
+   static __host__ __device__ int64_t lowest() { return INT64_MIN; }
+   static __host__ __device__ int64_t highest() { return INT64_MAX; }
+};
+
+// Element-wise operators: the Value is the element itself.
+template <typename T>
+struct ElementOp
+{
+   typedef T Input;
+   typedef T Value;
+
+   static __host__ __device__ T load(const T * input, long i) { return input[i]; }
+};
+
+template <typename T>
+struct SumOp : ElementOp<T>
+{
+   static __host__ __device__ T identity() { return T(0); }
+   static __host__ __device__ T combine(T a, T b) { return a + b; }
+};
+
+template <typename T>
+struct ProductOp : ElementOp<T>
+{
+   static __host__ __device__ T identity() { return T(1); }
+   static __host__ __device__ T combine(T a, T b) { return a * b; }
+};
+
+template <typename T>
+struct MinOp : ElementOp<T>
+{
+   static __host__ __device__ T identity() { return ReductionLimits<T>::highest(); }
+   static __host__ __device__ T combine(T a, T b) { return b < a ? b : a; }
+};
+
+template <typename T>
+struct MaxOp : ElementOp<T>
+{
+   static __host__ __device__ T identity() { return ReductionLimits<T>::lowest(); }
+   static __host__ __device__ T combine(T a, T b) { return a < b ? b : a; }
+};
+
+// Logical operators: the Value of an element is 1 if it is non-zero, else 0.
+template <typename T>
+struct LogicalAndOp
+{
+   typedef T Input;
+   typedef int Value;
+
+   static __host__ __device__ int identity() { return 1; }
+   static __host__ __device__ int load(const T * input, long i) { return input[i] != T(0); }
+   static __host__ __device__ int combine(int a, int b) { return a & b; }
+};
+
+template <typename T>
+struct LogicalOrOp
+{
+   typedef T Input;
+   typedef int Value;
+
+   static __host__ __device__ int identity() { return 0; }
+   static __host__ __device__ int load(const T * input, long i) { return input[i] != T(0); }
+   static __host__ __device__ int combine(int a, int b) { return a | b; }
+};
+
+// Value and position of an extremum. Ties go to the smaller index, so the
+// result is the first extremum whatever the order of the combines; the
+// identity has the largest index.
+template <typename T>
+struct ArgValue
+{
+   T value;
+   int64_t index;
+};
+
+template <typename T>
+struct ArgMinOp
+{
+   typedef T Input;
+   typedef ArgValue<T> Value;
+
+   static __host__ __device__ Value identity() { Value v = { ReductionLimits<T>::highest(), INT64_MAX }; return v; }
+   static __host__ __device__ Value load(const T * input, long i) { Value v = { input[i], i }; return v; }
+   static __host__ __device__ Value combine(Value a, Value b)
+   {
+      return (b.value < a.value || (b.value == a.value && b.index < a.index)) ? b : a;
+   }
+};
+
+template <typename T>
+struct ArgMaxOp
+{
+   typedef T Input;
+   typedef ArgValue<T> Value;
+
+   static __host__ __device__ Value identity() { Value v = { ReductionLimits<T>::lowest(), INT64_MAX }; return v; }
+   static __host__ __device__ Value load(const T * input, long i) { Value v = { input[i], i }; return v; }
+   static __host__ __device__ Value combine(Value a, Value b)
+   {
+      return (a.value < b.value || (b.value == a.value && b.index < a.index)) ? b : a;
+   }
+};
+
+// Reduces the values of the threads of a block; the result is in partial[0].
+template <typename Op>
+__device__ void reduceBlock(typename Op::Value * partial, typename Op::Value value)
+{
+   unsigned int t = threadIdx.x;
+   partial[t] = value;
+
+   __syncthreads();
+
+   for (unsigned int stride = blockDim.x / 2; stride > 0; stride /= 2)
+   {
+      if (t < stride)
+         partial[t] = Op::combine(partial[t], partial[t + stride]);
+
+      __syncthreads();
+   }
+}
+
+// First pass: output[blockIdx.x] is the reduction of the elements the block
+// visits with a grid stride.
+template <typename Op>
+__global__ void reduceElements(const typename Op::Input * input, long len, typename Op::Value * output)
+{
+   typedef typename Op::Value Value;
+   __shared__ Value partial[REDUCTION_BLOCK_SIZE];
+
+   Value value = Op::identity();
+   for (long i = blockIdx.x * (long) blockDim.x + threadIdx.x; i < len; i += (long) gridDim.x * blockDim.x)
+      value = Op::combine(value, Op::load(input, i));
+
+   reduceBlock<Op>(partial, value);
+
+   if (threadIdx.x == 0)
+      output[blockIdx.x] = partial[0];
+}
+
+// Second pass, one block: *output is the reduction of the count Values.
+template <typename Op>
+__global__ void reduceValues(const typename Op::Value * values, int count, typename Op::Value * output)
+{
+   typedef typename Op::Value Value;
+   __shared__ Value partial[REDUCTION_BLOCK_SIZE];
+
+   Value value = Op::identity();
+   for (int i = threadIdx.x; i < count; i += blockDim.x)
+      value = Op::combine(value, values[i]);
+
+   reduceBlock<Op>(partial, value);
+
+   if (threadIdx.x == 0)
+      *output = partial[0];
+}
+
+// Values of device scratch the reduction of any length needs.
+inline int reductionScratchLength()
+{
+   return REDUCTION_MAX_BLOCKS + 1;
+}
+
+// Reduction of input[begin, end) on the calling thread.
+template <typename Op>
+typename Op::Value hostReduceRange(const typename Op::Input * input, long begin, long end)
+{
+   typedef typename Op::Value Value;
+   Value lanes[REDUCTION_HOST_LANES];
+   for (int l = 0; l < REDUCTION_HOST_LANES; ++l)
+      lanes[l] = Op::identity();
+
+   long i = begin;
+   for (; i + REDUCTION_HOST_LANES <= end; i += REDUCTION_HOST_LANES)
+      for (int l = 0; l < REDUCTION_HOST_LANES; ++l)
+         lanes[l] = Op::combine(lanes[l], Op::load(input, i + l));
+   for (int l = 0; i < end; ++i, ++l)
+      lanes[l] = Op::combine(lanes[l], Op::load(input, i));
+
+   for (int width = REDUCTION_HOST_LANES / 2; width > 0; width /= 2)
+      for (int l = 0; l < width; ++l)
+         lanes[l] = Op::combine(lanes[l], lanes[l + width]);
+   return lanes[0];
+}
+
+// *result = input[0] op input[1] op ... op input[len - 1] (the identity when
+// len is 0). input and deviceScratch are device memory; deviceScratch holds
+// reductionScratchLength() Values.
+template <typename Op>
+cudaError_t reduce(const typename Op::Input * input, long len, typename Op::Value * deviceScratch, typename Op::Value * result)
+{
+   typedef typename Op::Value Value;
+#ifdef RUN_KERNELS
+   int blocks = (int) std::min((len + REDUCTION_BLOCK_SIZE - 1) / REDUCTION_BLOCK_SIZE, (long) REDUCTION_MAX_BLOCKS);
+   if (blocks == 0)
+   {
+      *result = Op::identity();
+      return cudaSuccess;
+   }
+   void (*elements)(const typename Op::Input *, long, Value *) = reduceElements<Op>;
+   void (*values)(const Value *, int, Value *) = reduceValues<Op>;
+   launchKernel(elements, dim3(blocks, 1, 1), dim3(REDUCTION_BLOCK_SIZE, 1, 1), input, len, deviceScratch);
+   launchKernel(values, dim3(1, 1, 1), dim3(REDUCTION_BLOCK_SIZE, 1, 1), deviceScratch, blocks, deviceScratch + REDUCTION_MAX_BLOCKS);
+   cudaError_t err = cudaGetLastError();
+   if (err != cudaSuccess)
+      return err;
+   return cudaMemcpy(result, deviceScratch + REDUCTION_MAX_BLOCKS, sizeof(Value), cudaMemcpyDeviceToHost);
+#else
+   (void) deviceScratch;
+   long chunks = (len + REDUCTION_HOST_CHUNK - 1) / REDUCTION_HOST_CHUNK;
+   std::vector<Value> partial(chunks);
+   cpuParallelFor(chunks, 1, [&](size_t first, size_t last)
+   {
+      for (size_t c = first; c < last; ++c)
+         partial[c] = hostReduceRange<Op>(input, c * REDUCTION_HOST_CHUNK, std::min((long) (c + 1) * REDUCTION_HOST_CHUNK, len));
+   });
+
+   Value value = Op::identity();
+   for (long c = 0; c < chunks; ++c)
+      value = Op::combine(value, partial[c]);
+   *result = value;
+   return cudaSuccess;
+#endif
+}
+
+// Reproducible mode.
+//
+// reduce() combines in an order that depends on the grid (GPU) or on the
+// chunking (CPU), so float sums differ in their last bits from one
+// configuration to another. reduceReproducible() combines in an order fixed
+// by len alone: the input is cut into leaves of REPRODUCIBLE_LEAF elements;
+// in a leaf, lane l (0 <= l < REDUCTION_BLOCK_SIZE) combines the elements l,
+// l + REDUCTION_BLOCK_SIZE, ... in turn, and the lanes are combined by the
+// halving tree of reduceBlock. The leaf results are reduced the same way,
+// level after level, until one value remains. The GPU runs a leaf per block
+// and a thread per lane; the CPU runs leaves on the executor threads and the
+// lanes of a leaf as a loop the compiler vectorizes. Both follow the same
+// order, so the result has the same bits for any number of threads, on either
+// (-DEMULATE_KERNELS runs reduceLeaves on the CPU).
+
+#define REPRODUCIBLE_LEAF (8 * REDUCTION_BLOCK_SIZE)
+
+// Element i of the input of a level: an input element or a leaf result.
+template <typename Op>
+struct ElementSource
+{
+   const typename Op::Input * input;
+
+   __host__ __device__ typename Op::Value operator()(long i) const { return Op::load(input, i); }
+};
+
+template <typename Op>
+struct ValueSource
+{
+   const typename Op::Value * values;
+
+   __host__ __device__ typename Op::Value operator()(long i) const { return values[i]; }
+};
+
+inline long reproducibleLeaves(long len)
+{
+   return (len + REPRODUCIBLE_LEAF - 1) / REPRODUCIBLE_LEAF;
+}
+
+// Values of device scratch reduceReproducible needs for len elements: the
+// results of the first level and, behind them, those of the second; deeper
+// levels reuse the two halves in turn.
+inline long reproducibleScratchLength(long len)
+{
+   return reproducibleLeaves(len) + reproducibleLeaves(reproducibleLeaves(len));
+}
+
+// One leaf per block of REDUCTION_BLOCK_SIZE threads.
+template <typename Op, typename Source>
+__global__ void reduceLeaves(Source source, long len, typename Op::Value * output)
+{
+   typedef typename Op::Value Value;
+   __shared__ Value partial[REDUCTION_BLOCK_SIZE];
+
+   long base = blockIdx.x * (long) REPRODUCIBLE_LEAF + threadIdx.x;
+   Value value = Op::identity();
+   for (int round = 0; round < REPRODUCIBLE_LEAF / REDUCTION_BLOCK_SIZE; ++round)
+   {
+      long i = base + round * REDUCTION_BLOCK_SIZE;
+      if (i < len)
+         value = Op::combine(value, source(i));
+   }
+
+   reduceBlock<Op>(partial, value);
+
+   if (threadIdx.x == 0)
+      output[blockIdx.x] = partial[0];
+}
+
+// The leaf that starts at element base, in the order of reduceLeaves.
+template <typename Op, typename Source>
+typename Op::Value hostReduceLeaf(const Source& source, long base, long len)
+{
+   typedef typename Op::Value Value;
+   Value lanes[REDUCTION_BLOCK_SIZE];
+   for (int l = 0; l < REDUCTION_BLOCK_SIZE; ++l)
+      lanes[l] = Op::identity();
+
+   if (base + REPRODUCIBLE_LEAF <= len)
+   {
+      for (int round = 0; round < REPRODUCIBLE_LEAF / REDUCTION_BLOCK_SIZE; ++round)
+         for (int l = 0; l < REDUCTION_BLOCK_SIZE; ++l)
+            lanes[l] = Op::combine(lanes[l], source(base + round * REDUCTION_BLOCK_SIZE + l));
+   }
+   else
+   {
+      for (int round = 0; round < REPRODUCIBLE_LEAF / REDUCTION_BLOCK_SIZE; ++round)
+         for (int l = 0; l < REDUCTION_BLOCK_SIZE; ++l)
+            if (base + round * REDUCTION_BLOCK_SIZE + l < len)
+               lanes[l] = Op::combine(lanes[l], source(base + round * REDUCTION_BLOCK_SIZE + l));
+   }
+
+   for (int stride = REDUCTION_BLOCK_SIZE / 2; stride > 0; stride /= 2)
+      for (int l = 0; l < stride; ++l)
+         lanes[l] = Op::combine(lanes[l], lanes[l + stride]);
+   return lanes[0];
+}
+
+template <typename Op, typename Source>
+cudaError_t reduceLevel(const Source& source, long len, typename Op::Value * output)
+{
+#ifdef RUN_KERNELS
+   void (*leaves)(Source, long, typename Op::Value *) = reduceLeaves<Op, Source>;
+   launchKernel(leaves, dim3((unsigned) reproducibleLeaves(len), 1, 1), dim3(REDUCTION_BLOCK_SIZE, 1, 1), source, len, output);
+   return cudaGetLastError();
+#else
+   cpuParallelFor(reproducibleLeaves(len), 1, [&](size_t first, size_t last)
+   {
+      for (size_t leaf = first; leaf < last; ++leaf)
+         output[leaf] = hostReduceLeaf<Op>(source, (long) leaf * REPRODUCIBLE_LEAF, len);
+   });
+   return cudaSuccess;
+#endif
+}
+
+// Same result as reduce() up to rounding, with the same bits for any thread
+// count or grid. deviceScratch holds reproducibleScratchLength(len) Values.
+template <typename Op>
+cudaError_t reduceReproducible(const typename Op::Input * input, long len, typename Op::Value * deviceScratch,
+                               typename Op::Value * result)
+{
+   typedef typename Op::Value Value;
+   if (len == 0)
+   {
+      *result = Op::identity();
+      return cudaSuccess;
+   }
+
+   Value * levels[2] = { deviceScratch, deviceScratch + reproducibleLeaves(len) };
+   ElementSource<Op> elements = { input };
+   cudaError_t err = reduceLevel<Op>(elements, len, levels[0]);
+   len = reproducibleLeaves(len);
+
+   int level = 0;
+   while (err == cudaSuccess && len > 1)
+   {
+      ValueSource<Op> values = { levels[level % 2] };
+      err = reduceLevel<Op>(values, len, levels[(level + 1) % 2]);
+      len = reproducibleLeaves(len);
+      ++level;
+   }
+   if (err != cudaSuccess)
+      return err;
+   return cudaMemcpy(result, levels[level % 2], sizeof(Value), cudaMemcpyDeviceToHost);
+}
+
+#endif // REDUCTION_ENGINE_H
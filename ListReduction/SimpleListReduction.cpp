@@ -3,6 +3,10 @@
 // Output its sum = lst[0] + lst[1] + ... + lst[n-1];
 
 #include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
 #include <sstream>
 
 void printList(float *list, int N)
@@ -104,7 +108,11 @@ int main(int argc, char ** argv)
 
     wbTime_start(Compute, "Performing CUDA computation");
     //@@ Launch the GPU Kernel
+#ifdef __CUDACC__
     total<<< DimGrid, DimBlock >>>(deviceInput, deviceOutput, numInputElements);
+#else
+    cpuLaunch(DimGrid, DimBlock, total, deviceInput, deviceOutput, numInputElements);
+#endif
 
     cudaDeviceSynchronize();
     wbTime_stop(Compute, "Performing CUDA computation");
@@ -0,0 +1,99 @@
+// Batched matrix multiplication: C[i] = A[i] * B[i] for a batch of square
+// matrices. The input files hold the matrices of the batch stacked
+// vertically, so an input of (count * size) x size is count matrices of
+// size x size; the output is stacked the same way.
+
+#include <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "BatchedSmallGemm.h"
+
+#define wbCheck(stmt)                                                          \
+  do {                                                                         \
+    cudaError_t err = stmt;                                                    \
+    if (err != cudaSuccess) {                                                  \
+      wbLog(ERROR, "Failed to run stmt ", #stmt);                              \
+      wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));           \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+int main(int argc, char **argv)
+{
+  wbArg_t args;
+  float *hostA; // The A matrices
+  float *hostB; // The B matrices
+  float *hostC; // The output C matrices
+  float *deviceA;
+  float *deviceB;
+  float *deviceC;
+  int numARows;    // number of rows of the stacked A matrices
+  int numAColumns; // number of columns in every A matrix
+  int numBRows;    // number of rows of the stacked B matrices
+  int numBColumns; // number of columns in every B matrix
+
+  args = wbArg_read(argc, argv);
+
+  wbTime_start(Generic, "Importing data and creating memory on host");
+  hostA = ( float * )wbImport(wbArg_getInputFile(args, 0), &numARows, &numAColumns);
+  hostB = ( float * )wbImport(wbArg_getInputFile(args, 1), &numBRows, &numBColumns);
+
+  int size = numAColumns;
+  if (size == 0 || numBColumns != size || numARows != numBRows || numARows % size != 0)
+  {
+     wbLog(ERROR, "The inputs must be the same number of stacked square matrices");
+     return -1;
+  }
+  int count = numARows / size;
+  // a batch of millions of matrices is well past 2 GB
+  size_t sizeMatrix = (size_t) size * size * sizeof(float);
+  size_t sizeBatch = (size_t) count * sizeMatrix;
+
+  hostC = ( float * )malloc(sizeBatch);
+
+  wbTime_stop(Generic, "Importing data and creating memory on host");
+
+  wbLog(TRACE, "The batch has ", count, " matrices of ", size, " x ", size,
+        batchedGemmIsSpecialized(size, size, size) ? " (specialized)" : " (generic)");
+
+  wbTime_start(GPU, "Allocating GPU memory.");
+  //@@ One allocation for the whole batch
+  wbCheck(cudaMalloc((void**) &deviceA, sizeBatch));
+  wbCheck(cudaMalloc((void**) &deviceB, sizeBatch));
+  wbCheck(cudaMalloc((void**) &deviceC, sizeBatch));
+
+  wbTime_stop(GPU, "Allocating GPU memory.");
+
+  wbTime_start(GPU, "Copying input memory to the GPU.");
+  wbCheck(cudaMemcpy(deviceA, hostA, sizeBatch, cudaMemcpyHostToDevice));
+  wbCheck(cudaMemcpy(deviceB, hostB, sizeBatch, cudaMemcpyHostToDevice));
+
+  wbTime_stop(GPU, "Copying input memory to the GPU.");
+
+  wbTime_start(Compute, "Performing CUDA computation");
+  //@@ One launch for the whole batch
+  long stride = (long) size * size;
+  wbCheck(batchedGemmStrided(size, size, size, deviceA, stride, deviceB, stride, deviceC, stride, count));
+
+  cudaDeviceSynchronize();
+  wbTime_stop(Compute, "Performing CUDA computation");
+
+  wbTime_start(Copy, "Copying output memory to the CPU");
+  wbCheck(cudaMemcpy(hostC, deviceC, sizeBatch, cudaMemcpyDeviceToHost));
+
+  wbTime_stop(Copy, "Copying output memory to the CPU");
+
+  wbTime_start(GPU, "Freeing GPU Memory");
+  wbCheck(cudaFree(deviceA));
+  wbCheck(cudaFree(deviceB));
+  wbCheck(cudaFree(deviceC));
+
+  wbTime_stop(GPU, "Freeing GPU Memory");
+
+  wbSolution(args, hostC, numARows, numAColumns);
+
+  free(hostA);
+  free(hostB);
+  free(hostC);
+
+  return 0;
+}
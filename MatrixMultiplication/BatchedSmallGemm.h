@@ -0,0 +1,286 @@
+// Batched multiplication of many small matrices: C[i] = A[i] * B[i], row-major,
+// A[i] m x k, B[i] k x n, C[i] m x n.
+//
+// The matrixMultiply kernels of the labs are built around one large product
+// per launch; for millions of 8 x 8 ... 64 x 64 products the launch, the
+// allocations and the idle threads would cost more than the arithmetic. Here
+// one launch covers the whole batch, given either as strided arrays
+//
+//    batchedGemmStrided(m, n, k, A, strideA, B, strideB, C, strideC, count);
+//
+// (matrix i of A starts at A + i * strideA, and so on) or as arrays of
+// pointers, which must themselves be in device memory, as with cuBLAS
+//
+//    batchedGemmPointers(m, n, k, arrayOfA, arrayOfB, arrayOfC, count);
+//
+// Square sizes 8, 16, 32 and 64 are compile-time specializations: the loop
+// bounds are constants, so the inner products unroll completely. On the GPU
+// a block of BATCHED_GEMM_BLOCK_SIZE threads loads a group of matrices into
+// shared memory (four 8 x 8 products at a time, one of the larger ones) and
+// every thread computes outputs of the group; the blocks then step through the
+// batch by gridDim.x groups, so one launch of a bounded grid covers any count.
+// Other shapes run a generic kernel with one thread per output.
+//
+// Without nvcc device memory is host memory, and the batch is split over the
+// CPU executor thread pool, each thread multiplying whole matrices with
+// loops specialized for the same sizes. -DEMULATE_KERNELS runs the kernels
+// on the executor instead.
+
+#ifndef BATCHED_SMALL_GEMM_H
+#define BATCHED_SMALL_GEMM_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef __CUDACC__
+#define BATCHED_GEMM_UNROLL _Pragma("unroll")
+#else
+#define BATCHED_GEMM_UNROLL _Pragma("GCC unroll 16")
+#endif
+
+#define BATCHED_GEMM_BLOCK_SIZE 256
+#define BATCHED_GEMM_MAX_BLOCKS 4096
+#define BATCHED_GEMM_HOST_GRAIN_FLOPS 65536 // multiply-adds per host task, at least
+
+// Matrix i at a fixed distance from matrix i - 1.
+struct StridedBatch
+{
+   const float * A;
+   long strideA;
+   const float * B;
+   long strideB;
+   float * C;
+   long strideC;
+
+   __host__ __device__ const float * a(int i) const { return A + i * strideA; }
+   __host__ __device__ const float * b(int i) const { return B + i * strideB; }
+   __host__ __device__ float * c(int i) const { return C + i * strideC; }
+};
+
+// Matrix i wherever its pointer says.
+struct PointerBatch
+{
+   const float * const * A;
+   const float * const * B;
+   float * const * C;
+
+   __host__ __device__ const float * a(int i) const { return A[i]; }
+   __host__ __device__ const float * b(int i) const { return B[i]; }
+   __host__ __device__ float * c(int i) const { return C[i]; }
+};
+
+template <int M, int N, int K, typename Batch>
+__global__ void batchedGemmFixed(Batch batch, int count)
+{
+   const int OUTPUTS = M * N;
+   const int GROUP = OUTPUTS < BATCHED_GEMM_BLOCK_SIZE ? BATCHED_GEMM_BLOCK_SIZE / OUTPUTS : 1; // matrices per step
+
+   __shared__ float ds_A[GROUP][M * K];
+   __shared__ float ds_B[GROUP][K * N];
+
+   int tid = threadIdx.x;
+   for (int first = blockIdx.x * GROUP; first < count; first += gridDim.x * GROUP)
+   {
+      for (int i = tid; i < GROUP * M * K; i += blockDim.x)
+      {
+         int g = i / (M * K);
+         ds_A[g][i % (M * K)] = first + g < count ? batch.a(first + g)[i % (M * K)] : 0.0f;
+      }
+      for (int i = tid; i < GROUP * K * N; i += blockDim.x)
+      {
+         int g = i / (K * N);
+         ds_B[g][i % (K * N)] = first + g < count ? batch.b(first + g)[i % (K * N)] : 0.0f;
+      }
+
+      __syncthreads();
+
+      for (int i = tid; i < GROUP * OUTPUTS; i += blockDim.x)
+      {
+         int g = i / OUTPUTS;
+         int row = (i % OUTPUTS) / N;
+         int column = i % N;
+         if (first + g < count)
+         {
+            float sum = 0.0f;
+            BATCHED_GEMM_UNROLL
+            for (int p = 0; p < K; ++p)
+               sum += ds_A[g][row * K + p] * ds_B[g][p * N + column];
+            batch.c(first + g)[row * N + column] = sum;
+         }
+      }
+
+      __syncthreads();
+   }
+}
+
+template <typename Batch>
+__global__ void batchedGemmGeneric(Batch batch, int count, int m, int n, int k)
+{
+   long outputs = (long) count * m * n;
+   for (long i = blockIdx.x * (long) blockDim.x + threadIdx.x; i < outputs; i += (long) gridDim.x * blockDim.x)
+   {
+      int matrix = (int) (i / ((long) m * n));
+      int row = (int) (i / n % m);
+      int column = (int) (i % n);
+      const float * a = batch.a(matrix);
+      const float * b = batch.b(matrix);
+      float sum = 0.0f;
+      for (int p = 0; p < k; ++p)
+         sum += a[row * k + p] * b[p * n + column];
+      batch.c(matrix)[row * n + column] = sum;
+   }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#ifdef __AVX__
+#define BATCHED_GEMM_HOST_VECTOR 8
+#else
+#define BATCHED_GEMM_HOST_VECTOR 4
+#endif
+typedef float BatchedGemmVector __attribute__((vector_size(BATCHED_GEMM_HOST_VECTOR * sizeof(float))));
+#endif
+
+// One product on the host. Row i of C is accumulated in registers: for every
+// p, a[i][p] times row p of B. With GCC or clang the row is held in vectors of
+// BATCHED_GEMM_HOST_VECTOR floats (left to the auto-vectorizer, the fully
+// unrolled loops kept the row in memory).
+template <int M, int N, int K>
+inline void hostSmallGemm(const float * __restrict__ a, const float * __restrict__ b, float * __restrict__ c)
+{
+#ifdef BATCHED_GEMM_HOST_VECTOR
+   if (N % BATCHED_GEMM_HOST_VECTOR == 0)
+   {
+      const int V = (N + BATCHED_GEMM_HOST_VECTOR - 1) / BATCHED_GEMM_HOST_VECTOR; // N / BATCHED_GEMM_HOST_VECTOR here
+      for (int i = 0; i < M; ++i)
+      {
+         BatchedGemmVector row[V];
+         for (int v = 0; v < V; ++v)
+            row[v] = BatchedGemmVector{};
+         for (int p = 0; p < K; ++p)
+         {
+            BatchedGemmVector aip = BatchedGemmVector{} + a[i * K + p];
+            BATCHED_GEMM_UNROLL
+            for (int v = 0; v < V; ++v)
+            {
+               BatchedGemmVector bpv;
+               memcpy(&bpv, b + p * N + v * BATCHED_GEMM_HOST_VECTOR, sizeof(bpv));
+               row[v] += aip * bpv;
+            }
+         }
+         memcpy(c + i * N, row, N * sizeof(float));
+      }
+      return;
+   }
+#endif
+   for (int i = 0; i < M; ++i)
+   {
+      float row[N] = {};
+      for (int p = 0; p < K; ++p)
+      {
+         float aip = a[i * K + p];
+         for (int j = 0; j < N; ++j)
+            row[j] += aip * b[p * N + j];
+      }
+      for (int j = 0; j < N; ++j)
+         c[i * N + j] = row[j];
+   }
+}
+
+inline void hostGemm(int m, int n, int k, const float * __restrict__ a, const float * __restrict__ b, float * __restrict__ c)
+{
+   for (int i = 0; i < m; ++i)
+   {
+      float * row = c + (long) i * n;
+      std::fill(row, row + n, 0.0f);
+      for (int p = 0; p < k; ++p)
+      {
+         float aip = a[(long) i * k + p];
+         for (int j = 0; j < n; ++j)
+            row[j] += aip * b[(long) p * n + j];
+      }
+   }
+}
+
+template <int M, int N, int K, typename Batch>
+cudaError_t runBatchedGemmFixed(const Batch& batch, int count)
+{
+#ifdef RUN_KERNELS
+   const int OUTPUTS = M * N;
+   const int GROUP = OUTPUTS < BATCHED_GEMM_BLOCK_SIZE ? BATCHED_GEMM_BLOCK_SIZE / OUTPUTS : 1;
+   void (*kernel)(Batch, int) = batchedGemmFixed<M, N, K, Batch>;
+   dim3 dimGrid(std::min((count - 1) / GROUP + 1, BATCHED_GEMM_MAX_BLOCKS), 1, 1);
+   launchKernel(kernel, dimGrid, dim3(BATCHED_GEMM_BLOCK_SIZE, 1, 1), batch, count);
+   return cudaGetLastError();
+#else
+   size_t grain = std::max(BATCHED_GEMM_HOST_GRAIN_FLOPS / (M * N * K), 1);
+   cpuParallelFor(count, grain, [&](size_t first, size_t last)
+   {
+      for (size_t i = first; i < last; ++i)
+         hostSmallGemm<M, N, K>(batch.a((int) i), batch.b((int) i), batch.c((int) i));
+   });
+   return cudaSuccess;
+#endif
+}
+
+template <typename Batch>
+cudaError_t runBatchedGemmGeneric(const Batch& batch, int count, int m, int n, int k)
+{
+#ifdef RUN_KERNELS
+   long outputs = (long) count * m * n;
+   void (*kernel)(Batch, int, int, int, int) = batchedGemmGeneric<Batch>;
+   dim3 dimGrid((unsigned) std::min((outputs - 1) / BATCHED_GEMM_BLOCK_SIZE + 1, (long) BATCHED_GEMM_MAX_BLOCKS), 1, 1);
+   launchKernel(kernel, dimGrid, dim3(BATCHED_GEMM_BLOCK_SIZE, 1, 1), batch, count, m, n, k);
+   return cudaGetLastError();
+#else
+   size_t grain = std::max(BATCHED_GEMM_HOST_GRAIN_FLOPS / std::max((long) m * n * k, 1L), 1L);
+   cpuParallelFor(count, grain, [&](size_t first, size_t last)
+   {
+      for (size_t i = first; i < last; ++i)
+         hostGemm(m, n, k, batch.a((int) i), batch.b((int) i), batch.c((int) i));
+   });
+   return cudaSuccess;
+#endif
+}
+
+// True when m x n x k has a compile-time specialization.
+inline bool batchedGemmIsSpecialized(int m, int n, int k)
+{
+   return m == n && n == k && (m == 8 || m == 16 || m == 32 || m == 64);
+}
+
+template <typename Batch>
+cudaError_t batchedGemm(int m, int n, int k, const Batch& batch, int count)
+{
+   if (count <= 0 || m <= 0 || n <= 0)
+      return cudaSuccess;
+   if (batchedGemmIsSpecialized(m, n, k))
+   {
+      switch (m)
+      {
+      case 8:  return runBatchedGemmFixed<8, 8, 8>(batch, count);
+      case 16: return runBatchedGemmFixed<16, 16, 16>(batch, count);
+      case 32: return runBatchedGemmFixed<32, 32, 32>(batch, count);
+      case 64: return runBatchedGemmFixed<64, 64, 64>(batch, count);
+      }
+   }
+   return runBatchedGemmGeneric(batch, count, m, n, k);
+}
+
+inline cudaError_t batchedGemmStrided(int m, int n, int k, const float * A, long strideA, const float * B, long strideB,
+                                      float * C, long strideC, int count)
+{
+   StridedBatch batch = { A, strideA, B, strideB, C, strideC };
+   return batchedGemm(m, n, k, batch, count);
+}
+
+inline cudaError_t batchedGemmPointers(int m, int n, int k, const float * const * A, const float * const * B,
+                                       float * const * C, int count)
+{
+   PointerBatch batch = { A, B, C };
+   return batchedGemm(m, n, k, batch, count);
+}
+
+#endif // BATCHED_SMALL_GEMM_H
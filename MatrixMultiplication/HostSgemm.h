@@ -0,0 +1,303 @@
+// Host single-precision GEMM: C = A * B for row-major matrices.
+//
+// This is the CPU reference the Simple and Tiled kernels are compared against.
+// It follows the usual BLIS/GotoBLAS structure:
+//
+//    for each NC-wide column panel of B          (packed B panel sits in L3)
+//       for each KC-deep slice of the panel      (B is packed once per slice)
+//          for each MC-tall row block of A       (in parallel, packed A in L2)
+//             for each NR-wide sliver of B       (sliver stays in L1)
+//                for each MR-tall sliver of A
+//                   MR x NR micro-kernel, accumulators in registers
+//
+// Packing turns the strided accesses of A and B into unit-stride streams and
+// pads the edges with zeros, so the micro-kernel never tests a bound. The
+// micro-kernel is selected at run time from the instruction sets the CPU
+// supports: AVX-512 (12 x 32), AVX2 + FMA (6 x 16) or portable C++ (4 x 8).
+
+#ifndef HOST_SGEMM_H
+#define HOST_SGEMM_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HOST_SGEMM_X86 1
+#endif
+
+#define HOST_SGEMM_KC 256  // depth of a packed slice: an MR x KC and a KC x NR sliver fit in L1
+#define HOST_SGEMM_MC 144  // rows of a packed A block (MC x KC floats ~ 144 KB, L2)
+#define HOST_SGEMM_NC 4096 // columns of a packed B panel (KC x NC floats ~ 4 MB, L3)
+
+namespace hostSgemmDetail
+{
+
+typedef void (*MicroKernel)(int k, const float * a, const float * b, float * c, size_t ldc);
+
+struct KernelInfo
+{
+   int mr;
+   int nr;
+   MicroKernel run;
+   const char * name;
+};
+
+// c[MR x NR] += a[MR x k] * b[k x NR], a and b packed: for every p, MR values
+// of A's column p, then NR values of B's row p.
+template <int MR, int NR>
+void kernelGeneric(int k, const float * a, const float * b, float * c, size_t ldc)
+{
+   float acc[MR][NR] = {};
+   for (int p = 0; p < k; ++p)
+   {
+      for (int i = 0; i < MR; ++i)
+      {
+         float ai = a[i];
+         for (int j = 0; j < NR; ++j)
+            acc[i][j] += ai * b[j];
+      }
+      a += MR;
+      b += NR;
+   }
+
+   for (int i = 0; i < MR; ++i)
+      for (int j = 0; j < NR; ++j)
+         c[i * ldc + j] += acc[i][j];
+}
+
+#ifdef HOST_SGEMM_X86
+
+__attribute__((target("avx2,fma"))) inline void kernelAvx2(int k, const float * a, const float * b, float * c, size_t ldc)
+{
+   __m256 acc[6][2];
+#pragma GCC unroll 6
+   for (int i = 0; i < 6; ++i)
+   {
+      acc[i][0] = _mm256_setzero_ps();
+      acc[i][1] = _mm256_setzero_ps();
+   }
+
+   for (int p = 0; p < k; ++p)
+   {
+      __m256 b0 = _mm256_load_ps(b);
+      __m256 b1 = _mm256_load_ps(b + 8);
+#pragma GCC unroll 6
+      for (int i = 0; i < 6; ++i)
+      {
+         __m256 ai = _mm256_broadcast_ss(a + i);
+         acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+         acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+      }
+      a += 6;
+      b += 16;
+   }
+
+#pragma GCC unroll 6
+   for (int i = 0; i < 6; ++i)
+   {
+      float * row = c + i * ldc;
+      _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[i][0]));
+      _mm256_storeu_ps(row + 8, _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[i][1]));
+   }
+}
+
+__attribute__((target("avx512f"))) inline void kernelAvx512(int k, const float * a, const float * b, float * c, size_t ldc)
+{
+   __m512 acc[12][2];
+#pragma GCC unroll 12
+   for (int i = 0; i < 12; ++i)
+   {
+      acc[i][0] = _mm512_setzero_ps();
+      acc[i][1] = _mm512_setzero_ps();
+   }
+
+   for (int p = 0; p < k; ++p)
+   {
+      __m512 b0 = _mm512_load_ps(b);
+      __m512 b1 = _mm512_load_ps(b + 16);
+#pragma GCC unroll 12
+      for (int i = 0; i < 12; ++i)
+      {
+         __m512 ai = _mm512_set1_ps(a[i]);
+         acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+         acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+      }
+      a += 12;
+      b += 32;
+   }
+
+#pragma GCC unroll 12
+   for (int i = 0; i < 12; ++i)
+   {
+      float * row = c + i * ldc;
+      _mm512_storeu_ps(row, _mm512_add_ps(_mm512_loadu_ps(row), acc[i][0]));
+      _mm512_storeu_ps(row + 16, _mm512_add_ps(_mm512_loadu_ps(row + 16), acc[i][1]));
+   }
+}
+
+#endif // HOST_SGEMM_X86
+
+inline const KernelInfo& selectKernel()
+{
+   static const KernelInfo kernel = []() {
+#ifdef HOST_SGEMM_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx512f"))
+         return KernelInfo{ 12, 32, &kernelAvx512, "AVX-512 12x32" };
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+         return KernelInfo{ 6, 16, &kernelAvx2, "AVX2 6x16" };
+#endif
+      return KernelInfo{ 4, 8, &kernelGeneric<4, 8>, "generic 4x8" };
+   }();
+   return kernel;
+}
+
+struct AlignedBuffer
+{
+   AlignedBuffer() : data(0), capacity(0) {}
+   ~AlignedBuffer() { free(data); }
+
+   float * reserve(size_t count)
+   {
+      if (count > capacity)
+      {
+         free(data);
+         if (posix_memalign((void **) &data, 64, count * sizeof(float)) != 0)
+            abort();
+         capacity = count;
+      }
+      return data;
+   }
+
+   float * data;
+   size_t capacity;
+};
+
+// Packs rows [0, mc) x columns [0, kc) of A into MR-tall slivers.
+inline void packA(int mc, int kc, const float * A, size_t lda, int mr, float * packed)
+{
+   for (int i0 = 0; i0 < mc; i0 += mr)
+   {
+      int rows = std::min(mr, mc - i0);
+      for (int p = 0; p < kc; ++p)
+      {
+         for (int i = 0; i < rows; ++i)
+            packed[i] = A[(i0 + i) * lda + p];
+         for (int i = rows; i < mr; ++i)
+            packed[i] = 0.0f;
+         packed += mr;
+      }
+   }
+}
+
+// Packs the NR-wide sliver starting at column j0 of a kc x nc slice of B.
+inline void packBSliver(int kc, int nc, int j0, const float * B, size_t ldb, int nr, float * packed)
+{
+   int columns = std::min(nr, nc - j0);
+   for (int p = 0; p < kc; ++p)
+   {
+      memcpy(packed, B + p * ldb + j0, columns * sizeof(float));
+      for (int j = columns; j < nr; ++j)
+         packed[j] = 0.0f;
+      packed += nr;
+   }
+}
+
+} // namespace hostSgemmDetail
+
+// Name of the micro-kernel hostSgemm runs on this CPU.
+inline const char * hostSgemmKernelName()
+{
+   return hostSgemmDetail::selectKernel().name;
+}
+
+// C (m x n, leading dimension ldc) = A (m x k, lda) * B (k x n, ldb).
+inline void hostSgemm(int m, int n, int k, const float * A, int lda, const float * B, int ldb, float * C, int ldc)
+{
+   using namespace hostSgemmDetail;
+
+   if (m <= 0 || n <= 0)
+      return;
+
+   cpuParallelFor(m, 64, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+         memset(C + i * ldc, 0, n * sizeof(float));
+   });
+   if (k <= 0)
+      return;
+
+   const KernelInfo& kernel = selectKernel();
+   const int mr = kernel.mr;
+   const int nr = kernel.nr;
+
+   // enough row blocks to keep every thread busy on short matrices
+   int mc = std::min(HOST_SGEMM_MC, (m + (int) cpuThreadCount() - 1) / (int) cpuThreadCount());
+   mc = std::max(mr, (mc + mr - 1) / mr * mr);
+   size_t rowBlocks = (m + mc - 1) / mc;
+
+   AlignedBuffer packedBStorage;
+
+   for (int jc = 0; jc < n; jc += HOST_SGEMM_NC)
+   {
+      int nc = std::min(HOST_SGEMM_NC, n - jc);
+      int slivers = (nc + nr - 1) / nr;
+
+      for (int pc = 0; pc < k; pc += HOST_SGEMM_KC)
+      {
+         int kc = std::min(HOST_SGEMM_KC, k - pc);
+         const float * sliceB = B + (size_t) pc * ldb + jc;
+
+         float * packedB = packedBStorage.reserve((size_t) slivers * nr * kc);
+         cpuParallelFor(slivers, 8, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s)
+               packBSliver(kc, nc, (int) s * nr, sliceB, ldb, nr, packedB + s * nr * kc);
+         });
+
+         cpuParallelFor(rowBlocks, 1, [&](size_t begin, size_t end) {
+            static thread_local AlignedBuffer packedAStorage;
+            float edge[12 * 32]; // largest MR x NR
+
+            for (size_t block = begin; block < end; ++block)
+            {
+               int ic = (int) block * mc;
+               int rows = std::min(mc, m - ic);
+               float * packedA = packedAStorage.reserve((size_t) ((rows + mr - 1) / mr) * mr * kc);
+               packA(rows, kc, A + (size_t) ic * lda + pc, lda, mr, packedA);
+
+               for (int jr = 0; jr < nc; jr += nr)
+               {
+                  const float * sliverB = packedB + (size_t) (jr / nr) * nr * kc;
+                  int columns = std::min(nr, nc - jr);
+
+                  for (int ir = 0; ir < rows; ir += mr)
+                  {
+                     const float * sliverA = packedA + (size_t) (ir / mr) * mr * kc;
+                     float * tileC = C + (size_t) (ic + ir) * ldc + jc + jr;
+                     int tileRows = std::min(mr, rows - ir);
+
+                     if (tileRows == mr && columns == nr)
+                     {
+                        kernel.run(kc, sliverA, sliverB, tileC, ldc);
+                        continue;
+                     }
+
+                     // partial tile: run the full kernel on a scratch tile
+                     memset(edge, 0, mr * nr * sizeof(float));
+                     kernel.run(kc, sliverA, sliverB, edge, nr);
+                     for (int i = 0; i < tileRows; ++i)
+                        for (int j = 0; j < columns; ++j)
+                           tileC[(size_t) i * ldc + j] += edge[i * nr + j];
+                  }
+               }
+            }
+         });
+      }
+   }
+}
+
+#endif // HOST_SGEMM_H
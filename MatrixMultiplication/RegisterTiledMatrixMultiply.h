@@ -0,0 +1,134 @@
+// Register-blocked tiled matrix multiplication: C = A * B, row-major.
+//
+// In TiledMatrixMultiplication.cpp every thread computes one element of C, so
+// each value it reads from shared memory feeds a single multiply-add. Here a
+// block computes a BM x BN tile of C and every thread a TM x TN block of it,
+// held in registers. For each step p of the BK-deep shared tiles a thread
+// reads TM values of A and TN values of B and does TM * TN multiply-adds:
+//
+//    one output per thread:  2 loads per multiply-add
+//    4 x 4 per thread:       8 loads for 16 (4 times the work per load)
+//    8 x 8 per thread:      16 loads for 64 (8 times)
+//
+// The outputs of a thread are interleaved with those of its neighbours
+// (rows ty, ty + BM / TM, ...; columns tx, tx + BN / TN, ...), so the threads
+// of a warp read consecutive shared-memory words and write consecutive
+// elements of C. A is stored transposed in shared memory, so a column of the
+// A tile is contiguous. Edges are padded with zeros when the tiles are
+// loaded; only the final store checks the bounds.
+//
+// registerTiledMatrixMultiply() picks 128 x 128 tiles with 8 x 8 outputs per
+// thread for large matrices and 64 x 64 tiles with 4 x 4 outputs otherwise;
+// launchRegisterTiledMatrixMultiply<BM, BN, BK, TM, TN> runs any other shape.
+
+#ifndef REGISTER_TILED_MATRIX_MULTIPLY_H
+#define REGISTER_TILED_MATRIX_MULTIPLY_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#ifdef __CUDACC__
+#define MATMUL_UNROLL _Pragma("unroll")
+#else
+#define MATMUL_UNROLL _Pragma("GCC unroll 8")
+#endif
+
+template <int BM, int BN, int BK, int TM, int TN>
+__global__ void matrixMultiplyRegisterTiled(const float * __restrict__ A, const float * __restrict__ B, float * __restrict__ C,
+                                            int m, int n, int k)
+{
+   static_assert(BM % TM == 0 && BN % TN == 0, "the block tile must be a whole number of thread tiles");
+
+   const int THREADS_X = BN / TN;
+   const int THREADS_Y = BM / TM;
+   const int THREADS = THREADS_X * THREADS_Y;
+
+   __shared__ float ds_A[BK][BM]; // transposed
+   __shared__ float ds_B[BK][BN];
+
+   int tx = threadIdx.x;
+   int ty = threadIdx.y;
+   int tid = ty * THREADS_X + tx;
+   int rowBase = blockIdx.y * BM;
+   int colBase = blockIdx.x * BN;
+
+   float acc[TM][TN];
+   MATMUL_UNROLL
+   for (int i = 0; i < TM; ++i)
+      MATMUL_UNROLL
+      for (int j = 0; j < TN; ++j)
+         acc[i][j] = 0.0f;
+
+   float a[TM];
+   float b[TN];
+
+   for (int t = 0; t < k; t += BK)
+   {
+      // Collaborative loading of the A and B tiles into shared memory
+      for (int i = tid; i < BM * BK; i += THREADS)
+      {
+         int row = rowBase + i / BK;
+         int column = t + i % BK;
+         ds_A[i % BK][i / BK] = (row < m && column < k) ? A[(long) row * k + column] : 0.0f;
+      }
+      for (int i = tid; i < BK * BN; i += THREADS)
+      {
+         int row = t + i / BN;
+         int column = colBase + i % BN;
+         ds_B[i / BN][i % BN] = (row < k && column < n) ? B[(long) row * n + column] : 0.0f;
+      }
+
+      __syncthreads();
+
+      MATMUL_UNROLL
+      for (int p = 0; p < BK; ++p)
+      {
+         MATMUL_UNROLL
+         for (int i = 0; i < TM; ++i)
+            a[i] = ds_A[p][ty + i * THREADS_Y];
+         MATMUL_UNROLL
+         for (int j = 0; j < TN; ++j)
+            b[j] = ds_B[p][tx + j * THREADS_X];
+
+         MATMUL_UNROLL
+         for (int i = 0; i < TM; ++i)
+            MATMUL_UNROLL
+            for (int j = 0; j < TN; ++j)
+               acc[i][j] += a[i] * b[j];
+      }
+
+      __syncthreads();
+   }
+
+   MATMUL_UNROLL
+   for (int i = 0; i < TM; ++i)
+   {
+      int row = rowBase + ty + i * THREADS_Y;
+      MATMUL_UNROLL
+      for (int j = 0; j < TN; ++j)
+      {
+         int column = colBase + tx + j * THREADS_X;
+         if (row < m && column < n)
+            C[(long) row * n + column] = acc[i][j];
+      }
+   }
+}
+
+// C (m x n) = A (m x k) * B (k x n), all in device memory.
+template <int BM, int BN, int BK, int TM, int TN>
+cudaError_t launchRegisterTiledMatrixMultiply(const float * A, const float * B, float * C, int m, int n, int k)
+{
+   void (*kernel)(const float *, const float *, float *, int, int, int) = matrixMultiplyRegisterTiled<BM, BN, BK, TM, TN>;
+   dim3 dimGrid((n - 1) / BN + 1, (m - 1) / BM + 1, 1);
+   dim3 dimBlock(BN / TN, BM / TM, 1);
+   launchKernel(kernel, dimGrid, dimBlock, A, B, C, m, n, k);
+   return cudaGetLastError();
+}
+
+inline cudaError_t registerTiledMatrixMultiply(const float * A, const float * B, float * C, int m, int n, int k)
+{
+   if (m >= 1024 && n >= 1024)
+      return launchRegisterTiledMatrixMultiply<128, 128, 8, 8, 8>(A, B, C, m, n, k);
+   return launchRegisterTiledMatrixMultiply<64, 64, 8, 4, 4>(A, B, C, m, n, k);
+}
+
+#endif // REGISTER_TILED_MATRIX_MULTIPLY_H
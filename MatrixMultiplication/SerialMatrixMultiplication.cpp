@@ -1,62 +1,122 @@
-#include <vector>
+#include "HostSgemm.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
 using namespace std;
-typedef vector< vector<int> > Matrix;
 
-int calculateOneOutputValue( const Matrix& A, const Matrix& B, int i, int j)
+// Row-major matrix in one contiguous allocation.
+struct Matrix
+{
+	Matrix(size_t rows, size_t columns) : rows(rows), columns(columns), values(rows * columns, 0.0f) {}
+
+	float& operator()(size_t i, size_t j) { return values[i * columns + j]; }
+	float operator()(size_t i, size_t j) const { return values[i * columns + j]; }
+
+	size_t rows;
+	size_t columns;
+	vector<float> values;
+};
+
+// Naive dot product, kept to check the blocked engine.
+float calculateOneOutputValue( const Matrix& A, const Matrix& B, size_t i, size_t j)
 {
-	size_t N = A.size();
-	int output = 0;
-	for (size_t k = 0; k < N; ++k)
+	double output = 0.0;
+	for (size_t k = 0; k < A.columns; ++k)
 	{
-		output += A[i][k] * B[k][j];
+		output += (double) A(i, k) * B(k, j);
 	}
-	return output;
+	return (float) output;
 }
 
 Matrix multipleMatrix( const Matrix& A, const Matrix& B)
 {
-	size_t N = A.size();
-	Matrix C(N, vector<int>(N, 0));
-	for (size_t i = 0; i < N; ++i)
+	Matrix C(A.rows, B.columns);
+	hostSgemm((int) A.rows, (int) B.columns, (int) A.columns,
+	          &A.values[0], (int) A.columns,
+	          &B.values[0], (int) B.columns,
+	          &C.values[0], (int) C.columns);
+	return C;
+}
+
+void debugPrint(const Matrix& M)
+{
+	for (size_t i = 0; i < M.rows; ++i)
 	{
-		for (size_t j = 0; j < N; ++j)
+		for (size_t j = 0; j < M.columns; ++j)
 		{
-			C[i][j] = calculateOneOutputValue(A, B, i, j);
+			cout << M(i, j) << " ";
 		}
+		cout << endl;
 	}
-	return C;
 }
 
-void debugPrint(const std::vector<int>& set)
+void fillRandom(Matrix& M)
 {
-	for (std::vector<int>::const_iterator i = set.begin(); i != set.end(); ++i)
+	for (size_t i = 0; i < M.values.size(); ++i)
 	{
-		cout << *i << endl;
+		M.values[i] = (float) rand() / RAND_MAX - 0.5f;
 	}
 }
 
-void debugPrint(const Matrix& M)
+// Usage: SerialMatrixMultiplication [M [N [K]]]
+// Without arguments multiplies the 2x2 example; otherwise times an M x K by
+// K x N product and checks a sample of the outputs against the naive loop.
+int main(int argc, char ** argv)
 {
-	for (Matrix::const_iterator i = M.begin(); i != M.end(); ++i)
+	if (argc < 2)
 	{
-		debugPrint(*i);
+		Matrix A(2, 2);
+		Matrix B(2, 2);
+		A(0, 0) = 2;
+		A(0, 1) = 1;
+		A(1, 0) = 1;
+		A(1, 1) = 1;
+		B(0, 0) = 1;
+		B(0, 1) = 1;
+		B(1, 0) = 1;
+		B(1, 1) = 1;
+		Matrix C = multipleMatrix(A, B);
+		debugPrint(C);
+		return 0;
 	}
-}
 
-int main()
-{
-	Matrix A(2, vector<int>(2, 0));
-	Matrix B(2, vector<int>(2, 0));
-	A[0][0] = 2;
-	A[0][1] = 1;
-	A[1][0] = 1;
-	A[1][1] = 1;
-	B[0][0] = 1;
-	B[0][1] = 1;
-	B[1][0] = 1;
-	B[1][1] = 1;
+	int rows = atoi(argv[1]);
+	int columns = argc > 2 ? atoi(argv[2]) : rows;
+	int inner = argc > 3 ? atoi(argv[3]) : rows;
+	if (rows <= 0 || columns <= 0 || inner <= 0)
+	{
+		cerr << "Usage: " << argv[0] << " [M [N [K]]], all positive" << endl;
+		return 1;
+	}
+	size_t M = rows;
+	size_t N = columns;
+	size_t K = inner;
+
+	Matrix A(M, K);
+	Matrix B(K, N);
+	fillRandom(A);
+	fillRandom(B);
+
+	multipleMatrix(A, B); // warm up the thread pool and the page tables
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	Matrix C = multipleMatrix(A, B);
-	debugPrint(C);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	float maxError = 0.0f;
+	for (int sample = 0; sample < 256; ++sample)
+	{
+		size_t i = rand() % M;
+		size_t j = rand() % N;
+		maxError = max(maxError, fabs(C(i, j) - calculateOneOutputValue(A, B, i, j)));
+	}
+
+	cout << M << " x " << K << " * " << K << " x " << N << " (" << hostSgemmKernelName() << ", "
+	     << cpuThreadCount() << " threads): " << seconds * 1e3 << " ms, "
+	     << 2.0 * M * N * K / seconds * 1e-9 << " GFLOP/s, max error " << maxError << endl;
+	return 0;
 }
@@ -1,4 +1,11 @@
 #include <wb.h>
+#include "../Profiler/WbProfiler.h"
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
+#ifdef VERIFY_WITH_HOST_SGEMM
+#include "HostSgemm.h"
+#endif
 #include <algorithm>
 
 #define wbCheck(stmt)                                                          \
@@ -91,10 +98,17 @@ int main(int argc, char **argv)
 
   wbTime_start(Compute, "Performing CUDA computation");
   //@@ Launch the GPU Kernel here
+#ifdef __CUDACC__
   matrixMultiply<<<dimGrid, dimBlock>>>(deviceA, deviceB, deviceC, 
                                         numARows, numAColumns, 
                                         numBRows, numBColumns, 
                                         numCRows, numCColumns);
+#else
+  cpuLaunch(dimGrid, dimBlock, matrixMultiply, deviceA, deviceB, deviceC,
+            numARows, numAColumns,
+            numBRows, numBColumns,
+            numCRows, numCColumns);
+#endif
 
   cudaDeviceSynchronize();
   wbTime_stop(Compute, "Performing CUDA computation");
@@ -105,6 +119,19 @@ int main(int argc, char **argv)
 
   wbTime_stop(Copy, "Copying output memory to the CPU");
 
+#ifdef VERIFY_WITH_HOST_SGEMM
+  wbTime_start(Generic, "Computing the host SGEMM reference");
+  float *referenceC = ( float * )malloc(sizeC);
+  hostSgemm(numCRows, numCColumns, numAColumns, hostA, numAColumns, hostB, numBColumns, referenceC, numCColumns);
+  wbTime_stop(Generic, "Computing the host SGEMM reference");
+
+  float maxDifference = 0.0f;
+  for (int i = 0; i < numCRows * numCColumns; ++i)
+     maxDifference = std::max(maxDifference, fabsf(hostC[i] - referenceC[i]));
+  wbLog(TRACE, "Largest difference from the host SGEMM reference (", hostSgemmKernelName(), ") is ", maxDifference);
+  free(referenceC);
+#endif
+
   wbTime_start(GPU, "Freeing GPU Memory");
   //@@ Free the GPU memory here
   wbCheck(cudaFree(deviceA));
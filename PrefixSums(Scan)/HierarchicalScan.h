@@ -0,0 +1,207 @@
+// Inclusive scan of arbitrary length, on the device and on the host.
+//
+// The single-block fix-up of SimpleScanAbitImproved (scan_sumUp) can hold only
+// BLOCK_SIZE block totals, which caps the input at about 2 * 512 * 512
+// elements. Here the block totals are scanned by the same procedure,
+// recursively, until they fit in one block, and the scanned totals are then
+// added back level by level:
+//
+//    scanBlocks       scan every 2 * SCAN_BLOCK_SIZE elements, save block totals
+//    (recursion)      scan the block totals
+//    addBlockOffsets  add the total of all previous blocks to every element
+//
+// Indices are 64-bit, so the length is limited only by memory and by
+// gridDim.x (2^31 - 1 blocks of 1024 elements).
+//
+// hierarchicalScanHost has the same interface and runs on the CPU executor
+// pool: chunk totals in parallel, a serial scan of the few chunk totals, then
+// every chunk is scanned from its offset in parallel.
+
+#ifndef HIERARCHICAL_SCAN_H
+#define HIERARCHICAL_SCAN_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <vector>
+
+#define SCAN_BLOCK_SIZE 512
+#define SCAN_ELEMENTS_PER_BLOCK (2 * SCAN_BLOCK_SIZE)
+#define HOST_SCAN_CHUNK (64 * 1024) // elements scanned by one host task
+
+// Work-efficient (Brent-Kung) scan of one block, as in WorkEfficientScan;
+// the block total goes to blockSums[blockIdx.x] unless blockSums is NULL.
+template <typename T>
+__global__ void scanBlocks(const T * input, T * output, T * blockSums, long long len)
+{
+    __shared__ T XY[SCAN_ELEMENTS_PER_BLOCK];
+
+    long long blockStart = (long long) blockIdx.x * SCAN_ELEMENTS_PER_BLOCK;
+    unsigned int firstIndexInBlock = threadIdx.x;
+    unsigned int secondIndexInBlock = threadIdx.x + blockDim.x;
+    long long firstIndexInArray = blockStart + firstIndexInBlock;
+    long long secondIndexInArray = blockStart + secondIndexInBlock;
+
+    XY[firstIndexInBlock] = firstIndexInArray < len ? input[firstIndexInArray] : T(0);
+    XY[secondIndexInBlock] = secondIndexInArray < len ? input[secondIndexInArray] : T(0);
+
+    __syncthreads();
+
+    for (int stride = 1; stride <= SCAN_BLOCK_SIZE; stride *= 2)
+    {
+       int index = (threadIdx.x + 1) * stride * 2 - 1;
+       if (index < SCAN_ELEMENTS_PER_BLOCK)
+          XY[index] += XY[index - stride];
+
+       __syncthreads();
+    }
+
+    for (int stride = SCAN_BLOCK_SIZE / 2; stride > 0; stride /= 2)
+    {
+       __syncthreads();
+       int index = (threadIdx.x + 1) * stride * 2 - 1;
+       if (index + stride < SCAN_ELEMENTS_PER_BLOCK)
+          XY[index + stride] += XY[index];
+    }
+
+    __syncthreads();
+
+    if (firstIndexInArray < len)
+       output[firstIndexInArray] = XY[firstIndexInBlock];
+    if (secondIndexInArray < len)
+       output[secondIndexInArray] = XY[secondIndexInBlock];
+
+    if (blockSums != NULL && threadIdx.x == blockDim.x - 1)
+       blockSums[blockIdx.x] = XY[SCAN_ELEMENTS_PER_BLOCK - 1];
+}
+
+// Adds the inclusive scan of the previous block totals to every element of
+// the blocks after the first.
+template <typename T>
+__global__ void addBlockOffsets(T * output, const T * scannedBlockSums, long long len)
+{
+    if (blockIdx.x == 0)
+       return;
+
+    T offset = scannedBlockSums[blockIdx.x - 1];
+    long long index = (long long) blockIdx.x * SCAN_ELEMENTS_PER_BLOCK + threadIdx.x;
+
+    if (index < len)
+       output[index] += offset;
+    if (index + blockDim.x < len)
+       output[index + blockDim.x] += offset;
+}
+
+inline long long scanBlockCount(long long len)
+{
+    return (len + SCAN_ELEMENTS_PER_BLOCK - 1) / SCAN_ELEMENTS_PER_BLOCK;
+}
+
+// Elements of device scratch memory a scan of len elements needs: the block
+// totals of every level but the last.
+inline long long hierarchicalScanScratchLength(long long len)
+{
+    long long total = 0;
+    while (len > SCAN_ELEMENTS_PER_BLOCK)
+    {
+       len = scanBlockCount(len);
+       total += len;
+    }
+    return total;
+}
+
+// Inclusive scan of deviceInput into deviceOutput (which may be the same
+// array), using hierarchicalScanScratchLength(len) elements of deviceScratch.
+template <typename T>
+cudaError_t hierarchicalScanDevice(const T * deviceInput, T * deviceOutput, long long len, T * deviceScratch)
+{
+    if (len <= 0)
+       return cudaSuccess;
+
+    long long blocks = scanBlockCount(len);
+    dim3 DimGrid((unsigned int) blocks, 1, 1);
+    dim3 DimBlock(SCAN_BLOCK_SIZE, 1, 1);
+
+    if (blocks == 1)
+    {
+       launchKernel(scanBlocks<T>, DimGrid, DimBlock, deviceInput, deviceOutput, (T *) NULL, len);
+       return cudaGetLastError();
+    }
+
+    T * blockSums = deviceScratch;
+    launchKernel(scanBlocks<T>, DimGrid, DimBlock, deviceInput, deviceOutput, blockSums, len);
+
+    cudaError_t err = hierarchicalScanDevice<T>(blockSums, blockSums, blocks, deviceScratch + blocks);
+    if (err != cudaSuccess)
+       return err;
+
+    launchKernel(addBlockOffsets<T>, DimGrid, DimBlock, deviceOutput, (const T *) blockSums, len);
+    return cudaGetLastError();
+}
+
+// Same, allocating the scratch memory.
+template <typename T>
+cudaError_t hierarchicalScanDevice(const T * deviceInput, T * deviceOutput, long long len)
+{
+    T * deviceScratch = NULL;
+    long long scratchLength = hierarchicalScanScratchLength(len);
+    if (scratchLength > 0)
+    {
+       cudaError_t err = cudaMalloc((void **) &deviceScratch, scratchLength * sizeof(T));
+       if (err != cudaSuccess)
+          return err;
+    }
+
+    cudaError_t err = hierarchicalScanDevice<T>(deviceInput, deviceOutput, len, deviceScratch);
+    cudaFree(deviceScratch);
+    return err;
+}
+
+// Inclusive scan of input into output (which may be the same array) on the
+// host threads.
+template <typename T>
+void hierarchicalScanHost(const T * input, T * output, long long len)
+{
+    if (len <= 0)
+       return;
+
+    long long chunks = (len + HOST_SCAN_CHUNK - 1) / HOST_SCAN_CHUNK;
+    std::vector<T> chunkOffsets(chunks);
+
+    cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+       for (size_t chunk = begin; chunk < end; ++chunk)
+       {
+          long long first = chunk * (long long) HOST_SCAN_CHUNK;
+          long long last = std::min(first + HOST_SCAN_CHUNK, len);
+          T sum = T(0);
+          for (long long i = first; i < last; ++i)
+             sum += input[i];
+          chunkOffsets[chunk] = sum;
+       }
+    });
+
+    // exclusive scan of the chunk totals, one per HOST_SCAN_CHUNK elements
+    T running = T(0);
+    for (long long chunk = 0; chunk < chunks; ++chunk)
+    {
+       T sum = chunkOffsets[chunk];
+       chunkOffsets[chunk] = running;
+       running += sum;
+    }
+
+    cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+       for (size_t chunk = begin; chunk < end; ++chunk)
+       {
+          long long first = chunk * (long long) HOST_SCAN_CHUNK;
+          long long last = std::min(first + HOST_SCAN_CHUNK, len);
+          T sum = chunkOffsets[chunk];
+          for (long long i = first; i < last; ++i)
+          {
+             sum += input[i];
+             output[i] = sum;
+          }
+       }
+    });
+}
+
+#endif // HIERARCHICAL_SCAN_H
@@ -0,0 +1,357 @@
+// Segmented inclusive scan and segmented reduction, on the device and on the
+// host.
+//
+// Many lists packed into one array are scanned (or summed) in one pass, the
+// running sum restarting at the first element of every segment. The segments
+// are given either by head flags, one byte per element, nonzero where a
+// segment starts,
+//
+//    segmentedScanDevice(input, headFlags, output, len, scratch);
+//
+// or by offsets as in a CSR matrix: segment s is [offsets[s], offsets[s + 1]),
+// with offsets[0] == 0 and offsets[segmentCount] == len; empty segments are
+// allowed.
+//
+//    segmentedScanDevice(input, offsets, segmentCount, output, len, scratch);
+//    segmentedReduceDevice(input, offsets, segmentCount, totals, len, scratch);
+//
+// The reduction writes one total per segment (0 for an empty one) instead of
+// the scanned array.
+//
+// This is the single-pass scan of SinglePassScan.h with the segmented sum
+//
+//    (a, headsA) + (b, headsB) = (headsB ? b : a + b, headsA || headsB)
+//
+// A tile that contains a head does not depend on its predecessors past that
+// head, so it publishes its total as an INCLUSIVE prefix right away and the
+// look-back of the tiles after it stops there; it still looks back itself for
+// the elements before its first head. Every segment, long or short, is done
+// by the same launch (or, on the host, by the same pass over the chunks), and
+// the scratch memory is that of singlePassScanScratchBytes<T>(len).
+// -DEMULATE_KERNELS runs the launch on the CPU executor instead of the pass.
+
+#ifndef SEGMENTED_SCAN_H
+#define SEGMENTED_SCAN_H
+
+#include "SinglePassScan.h"
+
+// Segments starting where headFlags is nonzero (the first element always
+// starts one). The segment index is not tracked, so these only drive scans.
+struct HeadFlagSegments
+{
+   const unsigned char * headFlags;
+   long long len;
+
+   __host__ __device__ long long cursor(long long) const
+   {
+      return 0;
+   }
+
+   __host__ __device__ bool startsAt(long long &, long long i) const
+   {
+      return headFlags[i] != 0;
+   }
+
+   __host__ __device__ bool endsAt(long long, long long i) const
+   {
+      return i + 1 == len || headFlags[i + 1] != 0;
+   }
+
+   // The first head after element i, or last.
+   __host__ __device__ long long nextHead(long long, long long i, long long last) const
+   {
+      for (++i; i < last && headFlags[i] == 0; ++i)
+         ;
+      return i;
+   }
+};
+
+// Segment s is [offsets[s], offsets[s + 1]).
+struct OffsetSegments
+{
+   const long long * offsets;
+   long long count;
+
+   // The segment holding element i - 1 (-1 for i == 0), where a walk from
+   // element i starts.
+   __host__ __device__ long long cursor(long long i) const
+   {
+      if (i == 0)
+         return -1;
+      long long low = 0;
+      long long high = count - 1;
+      while (low < high)
+      {
+         long long middle = (low + high + 1) / 2;
+         if (offsets[middle] <= i - 1)
+            low = middle;
+         else
+            high = middle - 1;
+      }
+      return low;
+   }
+
+   // Moves segment to the one holding element i, past any empty segments;
+   // true when that segment starts at i.
+   __host__ __device__ bool startsAt(long long & segment, long long i) const
+   {
+      bool head = false;
+      while (segment + 1 < count && offsets[segment + 1] <= i)
+      {
+         ++segment;
+         head = true;
+      }
+      return head;
+   }
+
+   __host__ __device__ bool endsAt(long long segment, long long i) const
+   {
+      return offsets[segment + 1] == i + 1;
+   }
+
+   // The first head after element i, which segment holds, or last.
+   __host__ __device__ long long nextHead(long long segment, long long, long long last) const
+   {
+      return offsets[segment + 1] < last ? offsets[segment + 1] : last;
+   }
+};
+
+// One tile of a segmented scan: the scanned elements go to output and, when
+// totals is not NULL, the last sum of every segment to totals[segment].
+template <typename T, typename Segments>
+__global__ void segmentedScanTiles(const T * input, T * output, T * totals, long long len, Segments segments,
+                                   SinglePassScanState<T> state)
+{
+   __shared__ T XY[SINGLE_PASS_TILE];
+   __shared__ T threadSums[SINGLE_PASS_BLOCK_SIZE];
+   __shared__ int threadHeads[SINGLE_PASS_BLOCK_SIZE];
+   __shared__ unsigned int tileIndex;
+   __shared__ T tileOffset;
+
+   if (threadIdx.x == 0)
+      tileIndex = atomicAdd(state.counter, 1u);
+   __syncthreads();
+
+   unsigned int tile = tileIndex;
+   long long tileStart = (long long) tile * SINGLE_PASS_TILE;
+
+   // coalesced load of the tile
+   for (int i = threadIdx.x; i < SINGLE_PASS_TILE; i += blockDim.x)
+      XY[i] = tileStart + i < len ? input[tileStart + i] : T(0);
+
+   __syncthreads();
+
+   // every thread scans SINGLE_PASS_ITEMS_PER_THREAD consecutive elements,
+   // restarting at heads; the items from firstHead on need no offset
+   long long first = tileStart + threadIdx.x * SINGLE_PASS_ITEMS_PER_THREAD;
+   T * items = XY + threadIdx.x * SINGLE_PASS_ITEMS_PER_THREAD;
+   long long segment = segments.cursor(first < len ? first : len);
+   int firstHead = SINGLE_PASS_ITEMS_PER_THREAD;
+   T sum = T(0);
+   for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD; ++j)
+   {
+      if (first + j < len && segments.startsAt(segment, first + j))
+      {
+         sum = T(0);
+         if (firstHead > j)
+            firstHead = j;
+      }
+      sum += items[j];
+      items[j] = sum;
+   }
+   threadSums[threadIdx.x] = sum;
+   threadHeads[threadIdx.x] = firstHead < SINGLE_PASS_ITEMS_PER_THREAD;
+
+   __syncthreads();
+
+   // Kogge-Stone scan of the (sum, heads) pairs of the threads
+   for (unsigned int stride = 1; stride < SINGLE_PASS_BLOCK_SIZE; stride *= 2)
+   {
+      T add = T(0);
+      int heads = 0;
+      if (threadIdx.x >= stride)
+      {
+         add = threadSums[threadIdx.x - stride];
+         heads = threadHeads[threadIdx.x - stride];
+      }
+      __syncthreads();
+      if (!threadHeads[threadIdx.x])
+         threadSums[threadIdx.x] += add;
+      threadHeads[threadIdx.x] |= heads;
+      __syncthreads();
+   }
+
+   if (threadIdx.x == 0)
+   {
+      T aggregate = threadSums[SINGLE_PASS_BLOCK_SIZE - 1];
+      bool independent = tile == 0 || threadHeads[SINGLE_PASS_BLOCK_SIZE - 1];
+      T exclusive = T(0);
+      publishTileState(state, tile, independent ? TILE_STATUS_INCLUSIVE : TILE_STATUS_AGGREGATE, aggregate);
+      if (tile > 0 && firstHead > 0)
+         exclusive = tileLookBack(state, tile);
+      if (!independent)
+         publishTileState(state, tile, TILE_STATUS_INCLUSIVE, exclusive + aggregate);
+      tileOffset = exclusive;
+   }
+
+   __syncthreads();
+
+   T offset = tileOffset;
+   if (threadIdx.x > 0)
+      offset = threadHeads[threadIdx.x - 1] ? threadSums[threadIdx.x - 1] : offset + threadSums[threadIdx.x - 1];
+   for (int j = 0; j < firstHead; ++j)
+      items[j] += offset;
+
+   if (totals != NULL)
+   {
+      segment = segments.cursor(first < len ? first : len);
+      for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD && first + j < len; ++j)
+      {
+         segments.startsAt(segment, first + j);
+         if (segments.endsAt(segment, first + j))
+            totals[segment] = items[j];
+      }
+   }
+
+   __syncthreads();
+
+   if (output != NULL)
+      for (int i = threadIdx.x; i < SINGLE_PASS_TILE; i += blockDim.x)
+         if (tileStart + i < len)
+            output[tileStart + i] = XY[i];
+}
+
+// The same on the host threads: every chunk is summed from its last head,
+// publishes, looks back if it has elements before its first head, and is
+// scanned again from the offset.
+template <typename T, typename Segments>
+void segmentedScanHost(const T * input, T * output, T * totals, long long len, const Segments& segments)
+{
+   if (len <= 0)
+      return;
+
+   long long chunks = (len + SINGLE_PASS_HOST_CHUNK - 1) / SINGLE_PASS_HOST_CHUNK;
+   HostTileStates<T> states(chunks);
+
+   cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+      for (size_t n = begin; n < end; ++n)
+      {
+         long long chunk = states.take();
+         long long first = chunk * (long long) SINGLE_PASS_HOST_CHUNK;
+         long long last = std::min(first + SINGLE_PASS_HOST_CHUNK, len);
+
+         // the chunk is walked run by run, a run being the elements of one
+         // segment, so the inner loops test no heads
+         long long segment = segments.cursor(first);
+         long long firstHead = segments.startsAt(segment, first) ? first : last;
+         T aggregate = T(0);
+         for (long long i = first; ; )
+         {
+            long long runEnd = segments.nextHead(segment, i, last);
+            for (; i < runEnd; ++i)
+               aggregate += input[i];
+            if (i == last)
+               break;
+            segments.startsAt(segment, i);
+            aggregate = T(0);
+            firstHead = std::min(firstHead, i);
+         }
+
+         bool independent = chunk == 0 || firstHead < last;
+         T exclusive = T(0);
+         states.publish(chunk, independent ? TILE_STATUS_INCLUSIVE : TILE_STATUS_AGGREGATE, aggregate);
+         if (chunk > 0 && firstHead > first)
+            exclusive = states.lookBack(chunk);
+         if (!independent)
+            states.publish(chunk, TILE_STATUS_INCLUSIVE, exclusive + aggregate);
+
+         segment = segments.cursor(first);
+         T sum = segments.startsAt(segment, first) ? T(0) : exclusive;
+         for (long long i = first; ; )
+         {
+            long long runEnd = segments.nextHead(segment, i, last);
+            if (output != NULL)
+               for (; i < runEnd; ++i)
+                  output[i] = sum += input[i];
+            else
+               for (; i < runEnd; ++i)
+                  sum += input[i];
+            if (totals != NULL && segments.endsAt(segment, i - 1))
+               totals[segment] = sum;
+            if (i == last)
+               break;
+            segments.startsAt(segment, i);
+            sum = T(0);
+         }
+      }
+   });
+}
+
+template <typename T, typename Segments>
+cudaError_t runSegmentedScan(const T * deviceInput, T * deviceOutput, T * deviceTotals, long long len,
+                             const Segments& segments, void * deviceScratch)
+{
+   if (len <= 0)
+      return cudaSuccess;
+
+#ifdef RUN_KERNELS
+   long long tiles = singlePassTileCount(len);
+   cudaError_t err = cudaMemset(deviceScratch, 0, (tiles + 1) * sizeof(unsigned int));
+   if (err != cudaSuccess)
+      return err;
+
+   void (*kernel)(const T *, T *, T *, long long, Segments, SinglePassScanState<T>) = segmentedScanTiles<T, Segments>;
+   dim3 DimGrid((unsigned int) tiles, 1, 1);
+   dim3 DimBlock(SINGLE_PASS_BLOCK_SIZE, 1, 1);
+   launchKernel(kernel, DimGrid, DimBlock, deviceInput, deviceOutput, deviceTotals, len, segments,
+                singlePassScanState<T>(deviceScratch, len));
+   return cudaGetLastError();
+#else
+   (void) deviceScratch;
+   segmentedScanHost<T>(deviceInput, deviceOutput, deviceTotals, len, segments);
+   return cudaSuccess;
+#endif
+}
+
+// Segmented inclusive scan of deviceInput into deviceOutput (which may be the
+// same array), with segments starting where deviceHeadFlags is nonzero.
+template <typename T>
+cudaError_t segmentedScanDevice(const T * deviceInput, const unsigned char * deviceHeadFlags, T * deviceOutput,
+                                long long len, void * deviceScratch)
+{
+   HeadFlagSegments segments = { deviceHeadFlags, len };
+   return runSegmentedScan<T>(deviceInput, deviceOutput, (T *) NULL, len, segments, deviceScratch);
+}
+
+// Same, with segmentCount segments given by segmentCount + 1 offsets;
+// cudaErrorInvalidValue when there are elements but no segments.
+template <typename T>
+cudaError_t segmentedScanDevice(const T * deviceInput, const long long * deviceOffsets, long long segmentCount,
+                                T * deviceOutput, long long len, void * deviceScratch)
+{
+   if (segmentCount <= 0 && len > 0)
+      return cudaErrorInvalidValue;
+
+   OffsetSegments segments = { deviceOffsets, segmentCount };
+   return runSegmentedScan<T>(deviceInput, deviceOutput, (T *) NULL, len, segments, deviceScratch);
+}
+
+// The sum of every segment of deviceInput into deviceTotals; nothing is
+// written without segments.
+template <typename T>
+cudaError_t segmentedReduceDevice(const T * deviceInput, const long long * deviceOffsets, long long segmentCount,
+                                  T * deviceTotals, long long len, void * deviceScratch)
+{
+   if (segmentCount <= 0)
+      return cudaSuccess;
+
+   // only the segments with elements are written
+   cudaError_t err = cudaMemset(deviceTotals, 0, segmentCount * sizeof(T));
+   if (err != cudaSuccess)
+      return err;
+
+   OffsetSegments segments = { deviceOffsets, segmentCount };
+   return runSegmentedScan<T>(deviceInput, (T *) NULL, deviceTotals, len, segments, deviceScratch);
+}
+
+#endif // SEGMENTED_SCAN_H
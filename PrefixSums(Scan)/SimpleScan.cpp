@@ -3,6 +3,10 @@
 // Output its prefix sum = {lst[0], lst[0] + lst[1], lst[0] + lst[1] + ... + lst[n-1]}
 
 #include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#ifndef __CUDACC__
+#include "../CpuExecutor/CpuExecutor.h"
+#endif
 
 #define BLOCK_SIZE 512 //@@ You can change this
 
@@ -101,7 +105,11 @@ int main(int argc, char ** argv) {
     //@@ Modify this to complete the functionality of the scan on the deivce
     wbTime_start(Compute, "Performing scan computation");
     
+#ifdef __CUDACC__
     scan<<< DimGrid_scan, DimBlock_scan >>>(deviceInput, deviceOutput, numElements);
+#else
+    cpuLaunch(DimGrid_scan, DimBlock_scan, scan, deviceInput, deviceOutput, numElements);
+#endif
 
     wbTime_stop(Compute, "Performing scan computation");
 
@@ -109,7 +117,11 @@ int main(int argc, char ** argv) {
     dim3 DimBlock_scan_sumUp(BLOCK_SIZE, 1, 1);
 
     wbTime_start(Compute, "Performing scan_sumUp computation");
+#ifdef __CUDACC__
     scan_sumUp<<< DimGrid_scan_sumUp, DimBlock_scan_sumUp >>>(deviceOutput, numElements);
+#else
+    cpuLaunch(DimGrid_scan_sumUp, DimBlock_scan_sumUp, scan_sumUp, deviceOutput, numElements);
+#endif
     wbTime_stop(Compute, "Performing scan_sumUp computation");
 
     cudaDeviceSynchronize();
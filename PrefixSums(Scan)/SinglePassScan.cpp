@@ -0,0 +1,95 @@
+// MP Scan
+// Given a list (lst) of length n
+// Output its prefix sum = {lst[0], lst[0] + lst[1], lst[0] + lst[1] + ... + lst[n-1]}
+//
+// One pass over the data: every tile takes its offset from the tiles before it
+// (decoupled look-back, see SinglePassScan.h) instead of a second kernel adding
+// the scanned block totals back, as in HierarchicalScan.
+
+#include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../BinaryDataset/BinaryDataset.h"
+#include "SinglePassScan.h"
+#ifdef VERIFY_WITH_HOST_SCAN
+#include "HierarchicalScan.h"
+#endif
+
+#define wbCheck(stmt) do {                                                    \
+        cudaError_t err = stmt;                                               \
+        if (err != cudaSuccess) {                                             \
+            wbLog(ERROR, "Failed to run stmt ", #stmt);                       \
+            wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));    \
+            return -1;                                                        \
+        }                                                                     \
+    } while(0)
+
+int main(int argc, char ** argv) {
+    wbArg_t args;
+    float * hostInput; // The input 1D list
+    float * hostOutput; // The output list
+    float * deviceInput;
+    float * deviceOutput;
+    void * deviceScratch;
+    int numElements; // number of elements in the list
+    size_t numScratchBytes; // tile counter and tile states
+
+    args = wbArg_read(argc, argv);
+
+    wbTime_start(Generic, "Importing data and creating memory on host");
+    hostInput = (float *) wbBinary_import(wbArg_getInputFile(args, 0), &numElements);
+    if (hostInput == NULL) {
+        wbLog(ERROR, "Failed to import ", wbArg_getInputFile(args, 0));
+        return -1;
+    }
+    hostOutput = (float*) malloc(numElements * sizeof(float));
+    numScratchBytes = singlePassScanScratchBytes<float>(numElements);
+    wbTime_stop(Generic, "Importing data and creating memory on host");
+
+    wbLog(TRACE, "The number of input elements in the input is ", numElements);
+    wbLog(TRACE, "The number of tiles is ", singlePassTileCount(numElements));
+
+    wbTime_start(GPU, "Allocating GPU memory.");
+    wbCheck(cudaMalloc((void**)&deviceInput, numElements*sizeof(float)));
+    wbCheck(cudaMalloc((void**)&deviceOutput, numElements*sizeof(float)));
+    wbCheck(cudaMalloc(&deviceScratch, numScratchBytes));
+    wbTime_stop(GPU, "Allocating GPU memory.");
+
+    wbTime_start(GPU, "Copying input memory to the GPU.");
+    wbCheck(cudaMemcpy(deviceInput, hostInput, numElements*sizeof(float), cudaMemcpyHostToDevice));
+    wbTime_stop(GPU, "Copying input memory to the GPU.");
+
+    wbTime_start(Compute, "Performing single-pass scan computation");
+    wbCheck(singlePassScanDevice<float>(deviceInput, deviceOutput, numElements, deviceScratch));
+    cudaDeviceSynchronize();
+    wbTime_stop(Compute, "Performing single-pass scan computation");
+
+    wbTime_start(Copy, "Copying output memory to the CPU");
+    wbCheck(cudaMemcpy(hostOutput, deviceOutput, numElements*sizeof(float), cudaMemcpyDeviceToHost));
+    wbTime_stop(Copy, "Copying output memory to the CPU");
+
+#ifdef VERIFY_WITH_HOST_SCAN
+    wbTime_start(Generic, "Performing scan on the host");
+    float * hostReference = (float*) malloc(numElements * sizeof(float));
+    hierarchicalScanHost(hostInput, hostReference, numElements);
+    wbTime_stop(Generic, "Performing scan on the host");
+
+    float maxDifference = 0.0f;
+    for (int i = 0; i < numElements; ++i)
+       maxDifference = std::max(maxDifference, fabsf(hostOutput[i] - hostReference[i]));
+    wbLog(TRACE, "Largest difference from the host scan is ", maxDifference);
+    free(hostReference);
+#endif
+
+    wbTime_start(GPU, "Freeing GPU Memory");
+    cudaFree(deviceInput);
+    cudaFree(deviceOutput);
+    cudaFree(deviceScratch);
+    wbTime_stop(GPU, "Freeing GPU Memory");
+
+    wbSolution(args, hostOutput, numElements);
+
+    wbBinary_free(hostInput);
+    free(hostOutput);
+
+    return 0;
+}
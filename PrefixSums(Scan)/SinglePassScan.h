@@ -0,0 +1,335 @@
+// Single-pass inclusive scan with decoupled look-back, on the device and on
+// the host.
+//
+// hierarchicalScanDevice reads the array and writes it in scanBlocks, then
+// reads and writes it again in addBlockOffsets: about 4N words of memory
+// traffic. Here every tile is scanned once, and the offset it needs comes
+// from its predecessors while it is still in shared memory:
+//
+//    1. take the next tile index from a counter (not blockIdx.x: a block only
+//       waits for tiles that were handed out before its own, so they belong
+//       to blocks that are already running)
+//    2. scan the tile and publish its total as AGGREGATE
+//    3. look back over the previous tiles, adding their AGGREGATEs, until one
+//       has published its INCLUSIVE prefix (waiting while a tile has neither)
+//    4. publish the tile's own INCLUSIVE prefix, add the offset, write out
+//
+// Every tile publishes the aggregate before it starts looking back, so a
+// waiting tile never waits for more than its predecessor's local scan, and in
+// the steady state the look-back ends at the previous tile. The array is read
+// once and written once, about 2N words; the tile states add three words per
+// SINGLE_PASS_TILE elements.
+//
+// singlePassScanHost is the same algorithm on the CPU executor pool, with
+// std::atomic status flags: every task takes chunks in order from an atomic
+// counter, sums its chunk, publishes, looks back, and scans the chunk again
+// from the offset while it is still in the cache.
+//
+// The status flags and the counter must be zero when a scan starts, so
+// singlePassScanDevice clears them (one memset of a few bytes per tile).
+
+#ifndef SINGLE_PASS_SCAN_H
+#define SINGLE_PASS_SCAN_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef __CUDACC__
+#define SINGLE_PASS_UNROLL _Pragma("unroll")
+#else
+#define SINGLE_PASS_UNROLL _Pragma("GCC unroll 8")
+#endif
+
+#define SINGLE_PASS_BLOCK_SIZE 256
+#define SINGLE_PASS_ITEMS_PER_THREAD 8
+#define SINGLE_PASS_TILE (SINGLE_PASS_BLOCK_SIZE * SINGLE_PASS_ITEMS_PER_THREAD)
+#define SINGLE_PASS_HOST_CHUNK (16 * 1024) // elements per host tile, small enough to stay in the cache
+
+// Tile states
+#define TILE_STATUS_INVALID   0 // nothing published yet
+#define TILE_STATUS_AGGREGATE 1 // the total of the tile alone
+#define TILE_STATUS_INCLUSIVE 2 // the total of the tile and all before it
+
+// Device scratch memory: the tile counter and the state of every tile.
+template <typename T>
+struct SinglePassScanState
+{
+   unsigned int * counter;
+   unsigned int * status;
+   T * aggregates;
+   T * inclusive;
+};
+
+inline long long singlePassTileCount(long long len)
+{
+   return (len + SINGLE_PASS_TILE - 1) / SINGLE_PASS_TILE;
+}
+
+// Bytes of device scratch memory a scan of len elements needs.
+template <typename T>
+size_t singlePassScanScratchBytes(long long len)
+{
+   size_t tiles = (size_t) singlePassTileCount(len);
+   size_t flags = (tiles + 1) * sizeof(unsigned int);
+   flags = (flags + sizeof(T) - 1) / sizeof(T) * sizeof(T);
+   return flags + 2 * tiles * sizeof(T);
+}
+
+template <typename T>
+SinglePassScanState<T> singlePassScanState(void * scratch, long long len)
+{
+   size_t tiles = (size_t) singlePassTileCount(len);
+   size_t flags = (tiles + 1) * sizeof(unsigned int);
+   flags = (flags + sizeof(T) - 1) / sizeof(T) * sizeof(T);
+
+   SinglePassScanState<T> state;
+   state.counter = (unsigned int *) scratch;
+   state.status = state.counter + 1;
+   state.aggregates = (T *) ((char *) scratch + flags);
+   state.inclusive = state.aggregates + tiles;
+   return state;
+}
+
+// The value is stored before the flag, with a fence in between, so a reader
+// that sees the flag sees the value.
+template <typename T>
+__device__ void publishTileState(SinglePassScanState<T> state, unsigned int tile, unsigned int flag, T value)
+{
+   if (flag == TILE_STATUS_AGGREGATE)
+      ((volatile T *) state.aggregates)[tile] = value;
+   else
+      ((volatile T *) state.inclusive)[tile] = value;
+   __threadfence();
+   ((volatile unsigned int *) state.status)[tile] = flag;
+}
+
+// The sum of all the tiles before tile: their aggregates, back to the first
+// tile that has published its inclusive prefix.
+template <typename T>
+__device__ T tileLookBack(SinglePassScanState<T> state, unsigned int tile)
+{
+   T exclusive = T(0);
+   for (long long previous = (long long) tile - 1; ; --previous)
+   {
+      unsigned int flag;
+      do
+         flag = ((volatile unsigned int *) state.status)[previous];
+      while (flag == TILE_STATUS_INVALID);
+      __threadfence();
+
+      if (flag == TILE_STATUS_INCLUSIVE)
+         return exclusive + ((volatile T *) state.inclusive)[previous];
+      exclusive += ((volatile T *) state.aggregates)[previous];
+   }
+}
+
+template <typename T>
+__global__ void singlePassScanTiles(const T * input, T * output, long long len, SinglePassScanState<T> state)
+{
+   __shared__ T XY[SINGLE_PASS_TILE];
+   __shared__ T threadSums[SINGLE_PASS_BLOCK_SIZE];
+   __shared__ unsigned int tileIndex;
+   __shared__ T tileOffset;
+
+   if (threadIdx.x == 0)
+      tileIndex = atomicAdd(state.counter, 1u);
+   __syncthreads();
+
+   unsigned int tile = tileIndex;
+   long long tileStart = (long long) tile * SINGLE_PASS_TILE;
+
+   // coalesced load of the tile
+   for (int i = threadIdx.x; i < SINGLE_PASS_TILE; i += blockDim.x)
+      XY[i] = tileStart + i < len ? input[tileStart + i] : T(0);
+
+   __syncthreads();
+
+   // every thread scans SINGLE_PASS_ITEMS_PER_THREAD consecutive elements
+   T * items = XY + threadIdx.x * SINGLE_PASS_ITEMS_PER_THREAD;
+   T sum = T(0);
+   SINGLE_PASS_UNROLL
+   for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD; ++j)
+   {
+      sum += items[j];
+      items[j] = sum;
+   }
+   threadSums[threadIdx.x] = sum;
+
+   __syncthreads();
+
+   // Kogge-Stone scan of the thread totals
+   for (int stride = 1; stride < SINGLE_PASS_BLOCK_SIZE; stride *= 2)
+   {
+      T add = (int) threadIdx.x >= stride ? threadSums[threadIdx.x - stride] : T(0);
+      __syncthreads();
+      threadSums[threadIdx.x] += add;
+      __syncthreads();
+   }
+
+   if (threadIdx.x == 0)
+   {
+      T aggregate = threadSums[SINGLE_PASS_BLOCK_SIZE - 1];
+      T exclusive = T(0);
+      if (tile == 0)
+         publishTileState(state, tile, TILE_STATUS_INCLUSIVE, aggregate);
+      else
+      {
+         publishTileState(state, tile, TILE_STATUS_AGGREGATE, aggregate);
+         exclusive = tileLookBack(state, tile);
+         publishTileState(state, tile, TILE_STATUS_INCLUSIVE, exclusive + aggregate);
+      }
+      tileOffset = exclusive;
+   }
+
+   __syncthreads();
+
+   T offset = tileOffset + (threadIdx.x > 0 ? threadSums[threadIdx.x - 1] : T(0));
+   SINGLE_PASS_UNROLL
+   for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD; ++j)
+      items[j] += offset;
+
+   __syncthreads();
+
+   for (int i = threadIdx.x; i < SINGLE_PASS_TILE; i += blockDim.x)
+      if (tileStart + i < len)
+         output[tileStart + i] = XY[i];
+}
+
+// The tile states of a scan on the host threads; the flags are released
+// after the values are stored and acquired before they are read.
+template <typename T>
+class HostTileStates
+{
+public:
+   explicit HostTileStates(long long tiles) : status(tiles), aggregates(tiles), inclusive(tiles), nextTile(0)
+   {
+      for (long long tile = 0; tile < tiles; ++tile)
+         status[tile].store(TILE_STATUS_INVALID, std::memory_order_relaxed);
+   }
+
+   // Tiles are handed out in order, so the tiles a thread looks back at have
+   // all been taken by threads that are running.
+   long long take()
+   {
+      return nextTile.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   void publish(long long tile, int flag, T value)
+   {
+      (flag == TILE_STATUS_AGGREGATE ? aggregates : inclusive)[tile] = value;
+      status[tile].store(flag, std::memory_order_release);
+   }
+
+   T lookBack(long long tile)
+   {
+      T exclusive = T(0);
+      for (long long previous = tile - 1; ; --previous)
+      {
+         int flag;
+         // the predecessor is being summed by another thread, which may
+         // share a core with this one
+         while ((flag = status[previous].load(std::memory_order_acquire)) == TILE_STATUS_INVALID)
+            std::this_thread::yield();
+
+         if (flag == TILE_STATUS_INCLUSIVE)
+            return exclusive + inclusive[previous];
+         exclusive += aggregates[previous];
+      }
+   }
+
+private:
+   std::vector<std::atomic<int> > status;
+   std::vector<T> aggregates;
+   std::vector<T> inclusive;
+   std::atomic<long long> nextTile;
+};
+
+// Inclusive scan of input into output (which may be the same array) on the
+// host threads.
+template <typename T>
+void singlePassScanHost(const T * input, T * output, long long len)
+{
+   if (len <= 0)
+      return;
+
+   long long chunks = (len + SINGLE_PASS_HOST_CHUNK - 1) / SINGLE_PASS_HOST_CHUNK;
+   HostTileStates<T> states(chunks);
+
+   cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+      for (size_t n = begin; n < end; ++n)
+      {
+         long long chunk = states.take();
+         long long first = chunk * (long long) SINGLE_PASS_HOST_CHUNK;
+         long long last = std::min(first + SINGLE_PASS_HOST_CHUNK, len);
+
+         T aggregate = T(0);
+         for (long long i = first; i < last; ++i)
+            aggregate += input[i];
+
+         T exclusive = T(0);
+         if (chunk == 0)
+            states.publish(chunk, TILE_STATUS_INCLUSIVE, aggregate);
+         else
+         {
+            states.publish(chunk, TILE_STATUS_AGGREGATE, aggregate);
+            exclusive = states.lookBack(chunk);
+            states.publish(chunk, TILE_STATUS_INCLUSIVE, exclusive + aggregate);
+         }
+
+         T sum = exclusive;
+         for (long long i = first; i < last; ++i)
+         {
+            sum += input[i];
+            output[i] = sum;
+         }
+      }
+   });
+}
+
+// Inclusive scan of deviceInput into deviceOutput (which may be the same
+// array), using singlePassScanScratchBytes<T>(len) bytes of deviceScratch.
+// Without nvcc device memory is host memory and the scan runs on the host
+// threads, unless built with -DEMULATE_KERNELS.
+template <typename T>
+cudaError_t singlePassScanDevice(const T * deviceInput, T * deviceOutput, long long len, void * deviceScratch)
+{
+   if (len <= 0)
+      return cudaSuccess;
+
+#ifdef RUN_KERNELS
+   long long tiles = singlePassTileCount(len);
+   cudaError_t err = cudaMemset(deviceScratch, 0, (tiles + 1) * sizeof(unsigned int));
+   if (err != cudaSuccess)
+      return err;
+
+   void (*kernel)(const T *, T *, long long, SinglePassScanState<T>) = singlePassScanTiles<T>;
+   dim3 DimGrid((unsigned int) tiles, 1, 1);
+   dim3 DimBlock(SINGLE_PASS_BLOCK_SIZE, 1, 1);
+   launchKernel(kernel, DimGrid, DimBlock, deviceInput, deviceOutput, len, singlePassScanState<T>(deviceScratch, len));
+   return cudaGetLastError();
+#else
+   (void) deviceScratch;
+   singlePassScanHost<T>(deviceInput, deviceOutput, len);
+   return cudaSuccess;
+#endif
+}
+
+// Same, allocating the scratch memory.
+template <typename T>
+cudaError_t singlePassScanDevice(const T * deviceInput, T * deviceOutput, long long len)
+{
+   void * deviceScratch = NULL;
+   cudaError_t err = cudaMalloc(&deviceScratch, singlePassScanScratchBytes<T>(len));
+   if (err != cudaSuccess)
+      return err;
+
+   err = singlePassScanDevice<T>(deviceInput, deviceOutput, len, deviceScratch);
+   cudaFree(deviceScratch);
+   return err;
+}
+
+#endif // SINGLE_PASS_SCAN_H
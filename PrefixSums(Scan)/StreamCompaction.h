@@ -0,0 +1,310 @@
+// Stream compaction (copy_if) and stable partition, on the device and on the
+// host.
+//
+// The output position of a selected element is the number of selected
+// elements before it: an exclusive scan of the predicate. That scan is the
+// single-pass look-back scan of SinglePassScan.h, run on the per-tile counts,
+// and the scatter happens in the same pass, so a compaction reads the input
+// once and writes only what it keeps:
+//
+//    copyIfDevice(input, output, len, predicate, count, scratch);
+//
+// Within a tile the selected elements are first gathered in shared memory, so
+// the writes to the output are coalesced. The rejected elements can be kept
+// too, in order, in a second array (partitionCopyDevice) or after the
+// selected ones in the same array (stablePartitionDevice; this needs the
+// number of selected elements before the scatter starts, so it is counted in
+// a first, read-only pass).
+//
+// predicate is a functor with a __host__ __device__ bool operator()(const T&).
+// count points to a long long in device memory that receives the number of
+// selected elements. The outputs must not overlap the input. The scratch
+// memory is streamCompactionScratchBytes(len) bytes.
+//
+// The host forms run on the CPU executor pool in the same way, chunk by chunk
+// with std::atomic tile states, each chunk counted and then scattered while
+// it is in the cache. -DEMULATE_KERNELS runs the kernels on the executor
+// instead.
+
+#ifndef STREAM_COMPACTION_H
+#define STREAM_COMPACTION_H
+
+#include "SinglePassScan.h"
+
+#define COUNT_IF_MAX_BLOCKS 1024
+
+inline size_t streamCompactionScratchBytes(long long len)
+{
+   return singlePassScanScratchBytes<long long>(len);
+}
+
+// One tile: selected elements to selectedOutput, rejected ones (unless
+// rejectedOutput is NULL) to rejectedOutput + *rejectedShift.
+template <typename T, typename Predicate>
+__global__ void compactTiles(const T * input, T * selectedOutput, T * rejectedOutput, const long long * rejectedShift,
+                             long long len, Predicate predicate, long long * count, SinglePassScanState<long long> state)
+{
+   __shared__ T XY[SINGLE_PASS_TILE];
+   __shared__ T gathered[SINGLE_PASS_TILE]; // selected, then rejected
+   __shared__ long long threadCounts[SINGLE_PASS_BLOCK_SIZE];
+   __shared__ unsigned int tileIndex;
+   __shared__ long long tileOffset;
+
+   if (threadIdx.x == 0)
+      tileIndex = atomicAdd(state.counter, 1u);
+   __syncthreads();
+
+   unsigned int tile = tileIndex;
+   long long tileStart = (long long) tile * SINGLE_PASS_TILE;
+   int tileLength = len - tileStart < SINGLE_PASS_TILE ? (int) (len - tileStart) : SINGLE_PASS_TILE;
+
+   for (int i = threadIdx.x; i < tileLength; i += blockDim.x)
+      XY[i] = input[tileStart + i];
+
+   __syncthreads();
+
+   // every thread tests SINGLE_PASS_ITEMS_PER_THREAD consecutive elements
+   int first = threadIdx.x * SINGLE_PASS_ITEMS_PER_THREAD;
+   unsigned int selected = 0; // bit j: item j is kept
+   long long kept = 0;
+   SINGLE_PASS_UNROLL
+   for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD; ++j)
+      if (first + j < tileLength && predicate(XY[first + j]))
+      {
+         selected |= 1u << j;
+         ++kept;
+      }
+   threadCounts[threadIdx.x] = kept;
+
+   __syncthreads();
+
+   // Kogge-Stone scan of the thread counts
+   for (int stride = 1; stride < SINGLE_PASS_BLOCK_SIZE; stride *= 2)
+   {
+      long long add = (int) threadIdx.x >= stride ? threadCounts[threadIdx.x - stride] : 0;
+      __syncthreads();
+      threadCounts[threadIdx.x] += add;
+      __syncthreads();
+   }
+
+   long long tileKept = threadCounts[SINGLE_PASS_BLOCK_SIZE - 1];
+   if (threadIdx.x == 0)
+   {
+      long long exclusive = 0;
+      if (tile == 0)
+         publishTileState(state, tile, TILE_STATUS_INCLUSIVE, tileKept);
+      else
+      {
+         publishTileState(state, tile, TILE_STATUS_AGGREGATE, tileKept);
+         exclusive = tileLookBack(state, tile);
+         publishTileState(state, tile, TILE_STATUS_INCLUSIVE, exclusive + tileKept);
+      }
+      if (count != NULL && tileStart + SINGLE_PASS_TILE >= len)
+         *count = exclusive + tileKept;
+      tileOffset = exclusive;
+   }
+
+   // gather the tile in shared memory, kept elements first
+   long long keptBefore = threadCounts[threadIdx.x] - kept;
+   for (int j = 0; j < SINGLE_PASS_ITEMS_PER_THREAD && first + j < tileLength; ++j)
+   {
+      if (selected & (1u << j))
+         gathered[keptBefore++] = XY[first + j];
+      else
+         gathered[tileKept + (first + j - keptBefore)] = XY[first + j];
+   }
+
+   __syncthreads();
+
+   long long selectedStart = tileOffset;
+   for (int i = threadIdx.x; i < tileKept; i += blockDim.x)
+      selectedOutput[selectedStart + i] = gathered[i];
+
+   if (rejectedOutput != NULL)
+   {
+      long long rejectedStart = tileStart - selectedStart + (rejectedShift != NULL ? *rejectedShift : 0);
+      for (int i = (int) tileKept + threadIdx.x; i < tileLength; i += blockDim.x)
+         rejectedOutput[rejectedStart + i - tileKept] = gathered[i];
+   }
+}
+
+// The number of elements of input that satisfy predicate, added to *count.
+template <typename T, typename Predicate>
+__global__ void countIf(const T * input, long long len, Predicate predicate, unsigned long long * count)
+{
+   __shared__ unsigned long long partialCounts[SINGLE_PASS_BLOCK_SIZE];
+
+   unsigned long long kept = 0;
+   for (long long i = blockIdx.x * (long long) blockDim.x + threadIdx.x; i < len; i += (long long) gridDim.x * blockDim.x)
+      kept += predicate(input[i]) ? 1 : 0;
+   partialCounts[threadIdx.x] = kept;
+
+   for (int stride = SINGLE_PASS_BLOCK_SIZE / 2; stride > 0; stride /= 2)
+   {
+      __syncthreads();
+      if ((int) threadIdx.x < stride)
+         partialCounts[threadIdx.x] += partialCounts[threadIdx.x + stride];
+   }
+
+   if (threadIdx.x == 0)
+      atomicAdd(count, partialCounts[0]);
+}
+
+template <typename T, typename Predicate>
+long long countIfHost(const T * input, long long len, Predicate predicate)
+{
+   std::atomic<long long> total(0);
+   cpuParallelFor(len, SINGLE_PASS_HOST_CHUNK, [&](size_t begin, size_t end) {
+      long long kept = 0;
+      for (size_t i = begin; i < end; ++i)
+         kept += predicate(input[i]) ? 1 : 0;
+      total.fetch_add(kept, std::memory_order_relaxed);
+   });
+   return total.load();
+}
+
+// Host form of compactTiles; returns the number of selected elements.
+template <typename T, typename Predicate>
+long long compactHost(const T * input, T * selectedOutput, T * rejectedOutput, long long len, Predicate predicate)
+{
+   if (len <= 0)
+      return 0;
+
+   long long chunks = (len + SINGLE_PASS_HOST_CHUNK - 1) / SINGLE_PASS_HOST_CHUNK;
+   HostTileStates<long long> states(chunks);
+   long long total = 0;
+
+   cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+      for (size_t n = begin; n < end; ++n)
+      {
+         long long chunk = states.take();
+         long long first = chunk * (long long) SINGLE_PASS_HOST_CHUNK;
+         long long last = std::min(first + SINGLE_PASS_HOST_CHUNK, len);
+
+         long long kept = 0;
+         for (long long i = first; i < last; ++i)
+            kept += predicate(input[i]) ? 1 : 0;
+
+         long long exclusive = 0;
+         if (chunk == 0)
+            states.publish(chunk, TILE_STATUS_INCLUSIVE, kept);
+         else
+         {
+            states.publish(chunk, TILE_STATUS_AGGREGATE, kept);
+            exclusive = states.lookBack(chunk);
+            states.publish(chunk, TILE_STATUS_INCLUSIVE, exclusive + kept);
+         }
+         if (chunk == chunks - 1)
+            total = exclusive + kept;
+
+         // Every element is written and the pointer advanced only if it is
+         // kept, which costs no mispredicted branches; the loops stop before
+         // the pointer would write past this chunk's share of the output.
+         T * selected = selectedOutput + exclusive;
+         T * selectedEnd = selected + kept;
+         if (rejectedOutput != NULL)
+         {
+            T * rejected = rejectedOutput + (first - exclusive);
+            T * rejectedEnd = rejected + (last - first - kept);
+            long long i = first;
+            for (; selected < selectedEnd && rejected < rejectedEnd; ++i)
+            {
+               T value = input[i];
+               bool keep = predicate(value);
+               *selected = value;
+               *rejected = value;
+               selected += keep;
+               rejected += !keep;
+            }
+            // the rest all go the same way
+            for (; i < last; ++i)
+               *(selected < selectedEnd ? selected++ : rejected++) = input[i];
+         }
+         else
+         {
+            for (long long i = first; selected < selectedEnd; ++i)
+            {
+               T value = input[i];
+               *selected = value;
+               selected += predicate(value);
+            }
+         }
+      }
+   });
+   return total;
+}
+
+template <typename T, typename Predicate>
+cudaError_t runCompaction(const T * deviceInput, T * deviceSelected, T * deviceRejected, const long long * deviceRejectedShift,
+                          long long len, Predicate predicate, long long * deviceCount, void * deviceScratch)
+{
+#ifdef RUN_KERNELS
+   if (len <= 0)
+      return deviceCount != NULL ? cudaMemset(deviceCount, 0, sizeof(long long)) : cudaSuccess;
+
+   long long tiles = singlePassTileCount(len);
+   cudaError_t err = cudaMemset(deviceScratch, 0, (tiles + 1) * sizeof(unsigned int));
+   if (err != cudaSuccess)
+      return err;
+
+   void (*kernel)(const T *, T *, T *, const long long *, long long, Predicate, long long *, SinglePassScanState<long long>)
+      = compactTiles<T, Predicate>;
+   dim3 DimGrid((unsigned int) tiles, 1, 1);
+   dim3 DimBlock(SINGLE_PASS_BLOCK_SIZE, 1, 1);
+   launchKernel(kernel, DimGrid, DimBlock, deviceInput, deviceSelected, deviceRejected, deviceRejectedShift, len, predicate,
+                deviceCount, singlePassScanState<long long>(deviceScratch, len));
+   return cudaGetLastError();
+#else
+   (void) deviceScratch;
+   T * rejected = deviceRejected != NULL && deviceRejectedShift != NULL ? deviceRejected + *deviceRejectedShift : deviceRejected;
+   long long total = compactHost(deviceInput, deviceSelected, rejected, len, predicate);
+   if (deviceCount != NULL)
+      *deviceCount = total;
+   return cudaSuccess;
+#endif
+}
+
+// The elements of deviceInput that satisfy predicate, in order, to
+// deviceOutput; their number to *deviceCount.
+template <typename T, typename Predicate>
+cudaError_t copyIfDevice(const T * deviceInput, T * deviceOutput, long long len, Predicate predicate,
+                         long long * deviceCount, void * deviceScratch)
+{
+   return runCompaction(deviceInput, deviceOutput, (T *) NULL, (const long long *) NULL, len, predicate, deviceCount, deviceScratch);
+}
+
+// Same, with the other elements, in order, to deviceRejected.
+template <typename T, typename Predicate>
+cudaError_t partitionCopyDevice(const T * deviceInput, T * deviceSelected, T * deviceRejected, long long len,
+                                Predicate predicate, long long * deviceCount, void * deviceScratch)
+{
+   return runCompaction(deviceInput, deviceSelected, deviceRejected, (const long long *) NULL, len, predicate, deviceCount,
+                        deviceScratch);
+}
+
+// The elements that satisfy predicate, then the others, each in their
+// original order, to deviceOutput; *deviceCount is where the others start.
+template <typename T, typename Predicate>
+cudaError_t stablePartitionDevice(const T * deviceInput, T * deviceOutput, long long len, Predicate predicate,
+                                  long long * deviceCount, void * deviceScratch)
+{
+#ifdef RUN_KERNELS
+   cudaError_t err = cudaMemset(deviceCount, 0, sizeof(long long));
+   if (err != cudaSuccess || len <= 0)
+      return err;
+
+   void (*kernel)(const T *, long long, Predicate, unsigned long long *) = countIf<T, Predicate>;
+   long long blocks = std::min((len - 1) / SINGLE_PASS_BLOCK_SIZE + 1, (long long) COUNT_IF_MAX_BLOCKS);
+   launchKernel(kernel, dim3((unsigned int) blocks, 1, 1), dim3(SINGLE_PASS_BLOCK_SIZE, 1, 1), deviceInput, len, predicate,
+                (unsigned long long *) deviceCount);
+   err = cudaGetLastError();
+   if (err != cudaSuccess)
+      return err;
+#else
+   *deviceCount = countIfHost(deviceInput, len, predicate);
+#endif
+   return runCompaction(deviceInput, deviceOutput, deviceOutput, (const long long *) deviceCount, len, predicate,
+                        (long long *) NULL, deviceScratch);
+}
+
+#endif // STREAM_COMPACTION_H
@@ -0,0 +1,305 @@
+// Hierarchical replacement for the libwb timers.
+//
+// Included after wb.h, this header takes over wbTime_start / wbTime_stop.
+// The labs keep their calls unchanged, but each timer becomes a scope:
+//
+//    - scopes nest: a timer started while another one is open on the same
+//      thread is its child, and the summary shows it indented below it;
+//    - every thread has its own scope stack and its own track in the trace;
+//    - a scope that runs several times (a loop, a benchmark repetition) is
+//      aggregated by its path: count, minimum, median, 99th percentile and
+//      total time.
+//
+// At exit the summary goes to stderr in the layout of the libwb table, and,
+// if the WB_TRACE environment variable names a file, every scope is written
+// there in the Chrome trace-event format (chrome://tracing, Perfetto).
+//
+// wbTime_stop closes the innermost open scope of the same kind and message,
+// so a stop that does not match the innermost scope also closes the scopes
+// opened after its start, as libwb accepts. wbProfile_scope(kind, ...) opens
+// a scope that closes at the end of the enclosing block.
+
+#ifndef WB_PROFILER_H
+#define WB_PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace wbProfiler
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct OpenScope
+{
+   const char * kind;
+   std::string message;
+   std::string path; // messages of the enclosing scopes and this one
+   const char * file;
+   int line;
+   Clock::time_point start;
+};
+
+struct Event
+{
+   const char * kind;
+   std::string message;
+   std::string path;
+   const char * file;
+   int line;
+   int depth;
+   int thread;
+   double startUs; // since the profiler was created
+   double durationUs;
+};
+
+class Profiler
+{
+public:
+   static Profiler& instance()
+   {
+      static Profiler profiler;
+      return profiler;
+   }
+
+   void start(const char * kind, const std::string& message, const char * file, int line)
+   {
+      std::vector<OpenScope>& stack = threadStack();
+      OpenScope scope;
+      scope.kind = kind;
+      scope.message = message;
+      scope.path = stack.empty() ? message : stack.back().path + " > " + message;
+      scope.file = file;
+      scope.line = line;
+      scope.start = Clock::now();
+      stack.push_back(scope);
+   }
+
+   void stop(const char * kind, const std::string& message)
+   {
+      Clock::time_point now = Clock::now();
+      std::vector<OpenScope>& stack = threadStack();
+
+      size_t match = stack.size();
+      while (match > 0 && !(stack[match - 1].message == message && std::string(stack[match - 1].kind) == kind))
+         --match;
+      if (match == 0)
+         return; // never started on this thread
+
+      std::lock_guard<std::mutex> lock(mutex);
+      while (stack.size() >= match)
+      {
+         const OpenScope& scope = stack.back();
+         Event event;
+         event.kind = scope.kind;
+         event.message = scope.message;
+         event.path = scope.path;
+         event.file = scope.file;
+         event.line = scope.line;
+         event.depth = (int) stack.size() - 1;
+         event.thread = threadNumber();
+         event.startUs = std::chrono::duration<double, std::micro>(scope.start - origin).count();
+         event.durationUs = std::chrono::duration<double, std::micro>(now - scope.start).count();
+         events.push_back(event);
+         stack.pop_back();
+      }
+   }
+
+   // Writes every closed scope as a Chrome trace-event JSON file.
+   bool writeTrace(const char * fileName)
+   {
+      FILE * out = fopen(fileName, "w");
+      if (!out)
+         return false;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+      // the separator goes before every record but the first, so the JSON
+      // stays valid with no events or no threads
+      size_t records = 0;
+      for (int thread = 0; thread < threadCount; ++thread)
+      {
+         fprintf(out, "%s\n  {\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, "
+                      "\"args\": {\"name\": \"thread %d\"}}",
+                 records++ > 0 ? "," : "", thread, thread);
+      }
+      for (size_t i = 0; i < events.size(); ++i)
+      {
+         const Event& event = events[i];
+         fprintf(out, "%s\n  {\"ph\": \"X\", \"cat\": \"%s\", \"name\": \"%s\", \"pid\": 1, \"tid\": %d, "
+                      "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"location\": \"%s::%d\"}}",
+                 records++ > 0 ? "," : "", event.kind, escape(event.message).c_str(), event.thread, event.startUs,
+                 event.durationUs, escape(event.file).c_str(), event.line);
+      }
+      fprintf(out, "\n]}\n");
+      return fclose(out) == 0;
+   }
+
+   // Prints one line per scope path, in order of first start.
+   void printSummary(FILE * out)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (events.empty())
+         return;
+
+      std::map<std::string, std::vector<const Event *> > byPath;
+      std::vector<const Event *> firsts;
+      for (size_t i = 0; i < events.size(); ++i)
+      {
+         std::vector<const Event *>& runs = byPath[events[i].path];
+         if (runs.empty())
+            firsts.push_back(&events[i]);
+         runs.push_back(&events[i]);
+      }
+      std::sort(firsts.begin(), firsts.end(), [](const Event * a, const Event * b) {
+         return a->startUs < b->startUs || (a->startUs == b->startUs && a->depth < b->depth);
+      });
+
+      fprintf(out, "Kind\tLocation\tCount\tMin (ms)\tMedian (ms)\tP99 (ms)\tTotal (ms)\tMessage\n");
+      for (size_t i = 0; i < firsts.size(); ++i)
+      {
+         const Event& first = *firsts[i];
+         std::vector<const Event *>& runs = byPath[first.path];
+         std::vector<double> times(runs.size());
+         double total = 0.0;
+         for (size_t r = 0; r < runs.size(); ++r)
+         {
+            times[r] = runs[r]->durationUs / 1000.0;
+            total += times[r];
+         }
+         std::sort(times.begin(), times.end());
+
+         fprintf(out, "%s\t%s::%d\t%zu\t%f\t%f\t%f\t%f\t%*s%s\n",
+                 first.kind, baseName(first.file), first.line, times.size(),
+                 times.front(), percentile(times, 50), percentile(times, 99), total,
+                 2 * first.depth, "", first.message.c_str());
+      }
+   }
+
+   void reset()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      events.clear();
+   }
+
+private:
+   Profiler() : origin(Clock::now()), threadCount(0) {}
+
+   ~Profiler()
+   {
+      printSummary(stderr);
+      const char * traceFile = getenv("WB_TRACE");
+      if (traceFile && *traceFile && !writeTrace(traceFile))
+         fprintf(stderr, "Cannot write the trace to %s\n", traceFile);
+   }
+
+   static std::vector<OpenScope>& threadStack()
+   {
+      static thread_local std::vector<OpenScope> stack;
+      return stack;
+   }
+
+   // Small dense thread numbers, in order of first use; called with mutex held.
+   int threadNumber()
+   {
+      static thread_local int number = -1;
+      if (number < 0)
+         number = threadCount++;
+      return number;
+   }
+
+   // Nearest-rank percentile of sorted values.
+   static double percentile(const std::vector<double>& sorted, int p)
+   {
+      size_t rank = (sorted.size() * p + 99) / 100;
+      return sorted[rank > 0 ? rank - 1 : 0];
+   }
+
+   static const char * baseName(const char * file)
+   {
+      const char * name = file;
+      for (const char * c = file; *c; ++c)
+         if (*c == '/' || *c == '\\')
+            name = c + 1;
+      return name;
+   }
+
+   static std::string escape(const std::string& text)
+   {
+      std::string escaped;
+      for (size_t i = 0; i < text.size(); ++i)
+      {
+         char c = text[i];
+         if (c == '"' || c == '\\')
+            escaped += '\\';
+         if ((unsigned char) c < 0x20)
+            c = ' ';
+         escaped += c;
+      }
+      return escaped;
+   }
+
+   std::mutex mutex;
+   std::vector<Event> events;
+   Clock::time_point origin;
+   int threadCount;
+};
+
+inline void appendMessage(std::ostringstream&) {}
+
+template <typename T, typename... Rest>
+void appendMessage(std::ostringstream& message, const T& value, const Rest&... rest)
+{
+   message << value;
+   appendMessage(message, rest...);
+}
+
+// The message of a timer: its arguments concatenated, as wbLog does.
+template <typename... Parts>
+std::string message(const Parts&... parts)
+{
+   std::ostringstream text;
+   appendMessage(text, parts...);
+   return text.str();
+}
+
+struct ScopeGuard
+{
+   ScopeGuard(const char * kind, const std::string& message, const char * file, int line)
+      : kind(kind), message(message)
+   {
+      Profiler::instance().start(kind, message, file, line);
+   }
+
+   ~ScopeGuard()
+   {
+      Profiler::instance().stop(kind, message);
+   }
+
+   const char * kind;
+   std::string message;
+};
+
+} // namespace wbProfiler
+
+#define WB_PROFILER_CONCAT_(a, b) a##b
+#define WB_PROFILER_CONCAT(a, b) WB_PROFILER_CONCAT_(a, b)
+
+#undef wbTime_start
+#undef wbTime_stop
+
+#define wbTime_start(kind, ...) \
+   wbProfiler::Profiler::instance().start(#kind, wbProfiler::message(__VA_ARGS__), __FILE__, __LINE__)
+#define wbTime_stop(kind, ...) \
+   wbProfiler::Profiler::instance().stop(#kind, wbProfiler::message(__VA_ARGS__))
+#define wbProfile_scope(kind, ...) \
+   wbProfiler::ScopeGuard WB_PROFILER_CONCAT(wbProfileScope_, __LINE__)(#kind, wbProfiler::message(__VA_ARGS__), __FILE__, __LINE__)
+
+#endif // WB_PROFILER_H
@@ -0,0 +1,75 @@
+// MP Sort
+// Given a list (lst) of length n
+// Output the list sorted in ascending order
+//
+// LSD radix sort (see RadixSort.h): four passes over the float keys, each a
+// histogram of the tiles, a scan of the digit offsets and a stable scatter.
+
+#include    <wb.h>
+#include "../Profiler/WbProfiler.h"
+#include "../BinaryDataset/BinaryDataset.h"
+#include "RadixSort.h"
+
+#define wbCheck(stmt) do {                                                    \
+        cudaError_t err = stmt;                                               \
+        if (err != cudaSuccess) {                                             \
+            wbLog(ERROR, "Failed to run stmt ", #stmt);                       \
+            wbLog(ERROR, "Got CUDA error ...  ", cudaGetErrorString(err));    \
+            return -1;                                                        \
+        }                                                                     \
+    } while(0)
+
+int main(int argc, char ** argv) {
+    wbArg_t args;
+    float * hostInput; // The input 1D list
+    float * hostOutput; // The sorted list
+    float * deviceKeys;
+    void * deviceScratch;
+    int numElements; // number of elements in the list
+    size_t numScratchBytes; // temporary keys, digit counts and their scan
+
+    args = wbArg_read(argc, argv);
+
+    wbTime_start(Generic, "Importing data and creating memory on host");
+    hostInput = (float *) wbBinary_import(wbArg_getInputFile(args, 0), &numElements);
+    if (hostInput == NULL) {
+        wbLog(ERROR, "Failed to import ", wbArg_getInputFile(args, 0));
+        return -1;
+    }
+    hostOutput = (float*) malloc(numElements * sizeof(float));
+    numScratchBytes = radixSortScratchBytes<float, unsigned int>(numElements);
+    wbTime_stop(Generic, "Importing data and creating memory on host");
+
+    wbLog(TRACE, "The number of input elements in the input is ", numElements);
+    wbLog(TRACE, "The number of tiles is ", radixTileCount(numElements));
+
+    wbTime_start(GPU, "Allocating GPU memory.");
+    wbCheck(cudaMalloc((void**)&deviceKeys, numElements*sizeof(float)));
+    wbCheck(cudaMalloc(&deviceScratch, numScratchBytes));
+    wbTime_stop(GPU, "Allocating GPU memory.");
+
+    wbTime_start(GPU, "Copying input memory to the GPU.");
+    wbCheck(cudaMemcpy(deviceKeys, hostInput, numElements*sizeof(float), cudaMemcpyHostToDevice));
+    wbTime_stop(GPU, "Copying input memory to the GPU.");
+
+    wbTime_start(Compute, "Performing radix sort computation");
+    wbCheck(radixSortDevice<float>(deviceKeys, numElements, deviceScratch));
+    cudaDeviceSynchronize();
+    wbTime_stop(Compute, "Performing radix sort computation");
+
+    wbTime_start(Copy, "Copying output memory to the CPU");
+    wbCheck(cudaMemcpy(hostOutput, deviceKeys, numElements*sizeof(float), cudaMemcpyDeviceToHost));
+    wbTime_stop(Copy, "Copying output memory to the CPU");
+
+    wbTime_start(GPU, "Freeing GPU Memory");
+    cudaFree(deviceKeys);
+    cudaFree(deviceScratch);
+    wbTime_stop(GPU, "Freeing GPU Memory");
+
+    wbSolution(args, hostOutput, numElements);
+
+    wbBinary_free(hostInput);
+    free(hostOutput);
+
+    return 0;
+}
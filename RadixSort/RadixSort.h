@@ -0,0 +1,370 @@
+// Least-significant-digit radix sort of uint32_t, uint64_t and float keys,
+// with or without values, on the device and on the host.
+//
+// Every pass sorts stably by the next RADIX_BITS bits of the keys, lowest
+// first, so after all the passes the keys are in order:
+//
+//    radixHistograms   digit histogram of every tile, privatized in shared
+//                      memory as in histo_kernel; stored digit-major, so
+//                      counts[digit * tiles + tile]
+//    (scan)            singlePassScanDevice of the counts: for every digit
+//                      and tile, where its keys go in the output
+//    radixScatter      every tile sorts itself by the digit in shared memory
+//                      (RADIX_BITS stable one-bit splits, each a block scan
+//                      of the zero bits) and writes its runs of equal digits
+//                      to their offsets
+//
+// Floats are sorted by their bits with the sign bit flipped, and all the bits
+// flipped for negative values, which orders them as numbers (-0 before +0,
+// NaNs at the ends). The keys are converted as they are read, so the arrays
+// are never rewritten.
+//
+// The passes ping-pong between the arrays and the temporary arrays in the
+// scratch memory; 32- and 64-bit keys take an even number of passes, so the
+// result ends up in the input arrays:
+//
+//    radixSortDevice(keys, values, len, scratch);  // values may be NULL
+//
+// radixSortHost does the same with the CPU executor pool: per-chunk digit
+// histograms in parallel, a serial scan of the chunk-by-digit counts, and a
+// parallel scatter, every chunk writing its keys in order from its own
+// offsets. A pass whose digit is the same in every key is skipped. Building
+// with -DEMULATE_KERNELS makes radixSortDevice run the kernels on the
+// executor instead.
+
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+#include "../PrefixSums(Scan)/SinglePassScan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define RADIX_BITS 8
+#define RADIX_DIGITS (1 << RADIX_BITS)
+#define RADIX_BLOCK_SIZE RADIX_DIGITS // one thread per digit in the tile histograms
+#define RADIX_ITEMS_PER_THREAD 4
+#define RADIX_TILE (RADIX_BLOCK_SIZE * RADIX_ITEMS_PER_THREAD)
+#define RADIX_HOST_CHUNK (64 * 1024) // keys per host task
+#define RADIX_SCRATCH_ALIGNMENT 256
+
+// The bits of a key, ordered as the keys are.
+template <typename K>
+struct RadixKey;
+
+template <>
+struct RadixKey<uint32_t>
+{
+   typedef uint32_t Bits;
+   __host__ __device__ static Bits bits(uint32_t key) { return key; }
+};
+
+template <>
+struct RadixKey<uint64_t>
+{
+   typedef uint64_t Bits;
+   __host__ __device__ static Bits bits(uint64_t key) { return key; }
+};
+
+template <>
+struct RadixKey<float>
+{
+   typedef uint32_t Bits;
+   __host__ __device__ static Bits bits(float key)
+   {
+      uint32_t bits;
+      memcpy(&bits, &key, sizeof(bits));
+      return bits ^ ((uint32_t) -(int32_t) (bits >> 31) | 0x80000000u);
+   }
+};
+
+template <typename K>
+__host__ __device__ unsigned int radixDigit(K key, int shift)
+{
+   return (unsigned int) (RadixKey<K>::bits(key) >> shift) & (RADIX_DIGITS - 1);
+}
+
+template <typename K>
+int radixPasses()
+{
+   return (int) (sizeof(typename RadixKey<K>::Bits) * 8 / RADIX_BITS);
+}
+
+template <typename K>
+__global__ void radixHistograms(const K * keys, long long len, int shift, unsigned int * counts)
+{
+   __shared__ unsigned int histogram[RADIX_DIGITS];
+
+   histogram[threadIdx.x] = 0;
+
+   __syncthreads();
+
+   long long tileStart = (long long) blockIdx.x * RADIX_TILE;
+   for (int i = threadIdx.x; i < RADIX_TILE; i += blockDim.x)
+      if (tileStart + i < len)
+         atomicAdd(&histogram[radixDigit(keys[tileStart + i], shift)], 1u);
+
+   __syncthreads();
+
+   counts[threadIdx.x * gridDim.x + blockIdx.x] = histogram[threadIdx.x];
+}
+
+// offsets is the inclusive scan of the counts of radixHistograms. values may
+// be NULL.
+template <typename K, typename V>
+__global__ void radixScatter(const K * keysIn, const V * valuesIn, K * keysOut, V * valuesOut, long long len, int shift,
+                             const unsigned int * offsets)
+{
+   __shared__ K tileKeys[2][RADIX_TILE];
+   __shared__ V tileValues[2][RADIX_TILE];
+   __shared__ unsigned int threadZeros[RADIX_BLOCK_SIZE];
+   __shared__ unsigned int digitStart[RADIX_DIGITS];
+
+   long long tileStart = (long long) blockIdx.x * RADIX_TILE;
+   int tileLength = len - tileStart < RADIX_TILE ? (int) (len - tileStart) : RADIX_TILE;
+
+   for (int i = threadIdx.x; i < tileLength; i += blockDim.x)
+   {
+      tileKeys[0][i] = keysIn[tileStart + i];
+      if (valuesIn != NULL)
+         tileValues[0][i] = valuesIn[tileStart + i];
+   }
+
+   // Stable split on every bit of the digit, lowest first. The positions
+   // past tileLength count as ones, so they stay at the end.
+   int first = threadIdx.x * RADIX_ITEMS_PER_THREAD;
+   for (int bit = 0; bit < RADIX_BITS; ++bit)
+   {
+      int source = bit & 1;
+
+      __syncthreads();
+
+      unsigned int ones = 0; // bit j: item j has a one
+      unsigned int zeros = 0;
+      for (int j = 0; j < RADIX_ITEMS_PER_THREAD; ++j)
+      {
+         int p = first + j;
+         if (p >= tileLength || (radixDigit(tileKeys[source][p], shift) >> bit & 1))
+            ones |= 1u << j;
+         else
+            ++zeros;
+      }
+      threadZeros[threadIdx.x] = zeros;
+
+      __syncthreads();
+
+      // Kogge-Stone scan of the zero counts
+      for (int stride = 1; stride < RADIX_BLOCK_SIZE; stride *= 2)
+      {
+         unsigned int add = (int) threadIdx.x >= stride ? threadZeros[threadIdx.x - stride] : 0;
+         __syncthreads();
+         threadZeros[threadIdx.x] += add;
+         __syncthreads();
+      }
+
+      unsigned int totalZeros = threadZeros[RADIX_BLOCK_SIZE - 1];
+      unsigned int zerosBefore = threadZeros[threadIdx.x] - zeros;
+      for (int j = 0; j < RADIX_ITEMS_PER_THREAD; ++j)
+      {
+         int p = first + j;
+         int target = (ones >> j & 1) ? (int) (totalZeros + p - zerosBefore) : (int) zerosBefore++;
+         tileKeys[source ^ 1][target] = tileKeys[source][p];
+         if (valuesIn != NULL)
+            tileValues[source ^ 1][target] = tileValues[source][p];
+      }
+   }
+
+   __syncthreads();
+
+   // RADIX_BITS is even, so the sorted tile is back in buffer 0
+   for (int p = threadIdx.x; p < tileLength; p += blockDim.x)
+   {
+      unsigned int digit = radixDigit(tileKeys[0][p], shift);
+      if (p == 0 || radixDigit(tileKeys[0][p - 1], shift) != digit)
+         digitStart[digit] = p;
+   }
+
+   __syncthreads();
+
+   for (int p = threadIdx.x; p < tileLength; p += blockDim.x)
+   {
+      unsigned int digit = radixDigit(tileKeys[0][p], shift);
+      unsigned int index = digit * gridDim.x + blockIdx.x;
+      long long target = (index > 0 ? offsets[index - 1] : 0) + (p - digitStart[digit]);
+      keysOut[target] = tileKeys[0][p];
+      if (valuesOut != NULL)
+         valuesOut[target] = tileValues[0][p];
+   }
+}
+
+inline size_t radixScratchAlign(size_t bytes)
+{
+   return (bytes + RADIX_SCRATCH_ALIGNMENT - 1) / RADIX_SCRATCH_ALIGNMENT * RADIX_SCRATCH_ALIGNMENT;
+}
+
+inline long long radixTileCount(long long len)
+{
+   return (len + RADIX_TILE - 1) / RADIX_TILE;
+}
+
+// Bytes of device scratch memory a sort of len keys (and values of type V)
+// needs: the temporary arrays, the digit counts and their scan.
+template <typename K, typename V>
+size_t radixSortScratchBytes(long long len)
+{
+   long long countsLength = RADIX_DIGITS * radixTileCount(len);
+   return radixScratchAlign(len * sizeof(K)) + radixScratchAlign(len * sizeof(V)) +
+          radixScratchAlign(countsLength * sizeof(unsigned int)) + singlePassScanScratchBytes<unsigned int>(countsLength);
+}
+
+// Sorts keys[0, len) and moves values (unless NULL) with them, with
+// temporaryKeys and temporaryValues of the same length.
+template <typename K, typename V>
+void radixSortHost(K * keys, V * values, long long len, K * temporaryKeys, V * temporaryValues)
+{
+   if (len <= 1)
+      return;
+
+   long long chunks = (len + RADIX_HOST_CHUNK - 1) / RADIX_HOST_CHUNK;
+   std::vector<long long> offsets(chunks * RADIX_DIGITS); // [chunk][digit]
+   K * sourceKeys = keys;
+   V * sourceValues = values;
+   K * targetKeys = temporaryKeys;
+   V * targetValues = temporaryValues;
+
+   for (int pass = 0; pass < radixPasses<K>(); ++pass)
+   {
+      int shift = pass * RADIX_BITS;
+
+      cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+         for (size_t chunk = begin; chunk < end; ++chunk)
+         {
+            long long * histogram = &offsets[chunk * RADIX_DIGITS];
+            std::fill(histogram, histogram + RADIX_DIGITS, 0);
+            long long last = std::min((long long) (chunk + 1) * RADIX_HOST_CHUNK, len);
+            for (long long i = chunk * (long long) RADIX_HOST_CHUNK; i < last; ++i)
+               ++histogram[radixDigit(sourceKeys[i], shift)];
+         }
+      });
+
+      // exclusive scan of the counts, digit by digit and within a digit
+      // chunk by chunk; a digit holding every key leaves the order as it is
+      long long running = 0;
+      bool trivial = false;
+      for (int digit = 0; digit < RADIX_DIGITS && !trivial; ++digit)
+      {
+         long long digitStart = running;
+         for (long long chunk = 0; chunk < chunks; ++chunk)
+         {
+            long long count = offsets[chunk * RADIX_DIGITS + digit];
+            offsets[chunk * RADIX_DIGITS + digit] = running;
+            running += count;
+         }
+         trivial = running - digitStart == len;
+      }
+      if (trivial)
+         continue;
+
+      cpuParallelFor(chunks, 1, [&](size_t begin, size_t end) {
+         for (size_t chunk = begin; chunk < end; ++chunk)
+         {
+            long long target[RADIX_DIGITS];
+            std::copy(&offsets[chunk * RADIX_DIGITS], &offsets[chunk * RADIX_DIGITS] + RADIX_DIGITS, target);
+            long long last = std::min((long long) (chunk + 1) * RADIX_HOST_CHUNK, len);
+            for (long long i = chunk * (long long) RADIX_HOST_CHUNK; i < last; ++i)
+            {
+               long long position = target[radixDigit(sourceKeys[i], shift)]++;
+               targetKeys[position] = sourceKeys[i];
+               if (values != NULL)
+                  targetValues[position] = sourceValues[i];
+            }
+         }
+      });
+
+      std::swap(sourceKeys, targetKeys);
+      std::swap(sourceValues, targetValues);
+   }
+
+   if (sourceKeys != keys)
+   {
+      cpuParallelFor(len, RADIX_HOST_CHUNK, [&](size_t begin, size_t end) {
+         std::copy(sourceKeys + begin, sourceKeys + end, keys + begin);
+         if (values != NULL)
+            std::copy(sourceValues + begin, sourceValues + end, values + begin);
+      });
+   }
+}
+
+// Same, allocating the temporary arrays.
+template <typename K, typename V>
+void radixSortHost(K * keys, V * values, long long len)
+{
+   std::vector<K> temporaryKeys(len);
+   std::vector<V> temporaryValues(values != NULL ? len : 0);
+   radixSortHost(keys, values, len, temporaryKeys.data(), values != NULL ? temporaryValues.data() : (V *) NULL);
+}
+
+template <typename K>
+void radixSortHost(K * keys, long long len)
+{
+   radixSortHost(keys, (unsigned int *) NULL, len);
+}
+
+// Sorts deviceKeys[0, len) and moves deviceValues (unless NULL) with them,
+// using radixSortScratchBytes<K, V>(len) bytes of deviceScratch.
+template <typename K, typename V>
+cudaError_t radixSortDevice(K * deviceKeys, V * deviceValues, long long len, void * deviceScratch)
+{
+   if (len <= 1)
+      return cudaSuccess;
+
+   char * scratch = (char *) deviceScratch;
+   K * temporaryKeys = (K *) scratch;
+   scratch += radixScratchAlign(len * sizeof(K));
+   V * temporaryValues = deviceValues != NULL ? (V *) scratch : NULL;
+   scratch += radixScratchAlign(len * sizeof(V));
+
+#ifdef RUN_KERNELS
+   long long tiles = radixTileCount(len);
+   long long countsLength = RADIX_DIGITS * tiles;
+   unsigned int * counts = (unsigned int *) scratch;
+   scratch += radixScratchAlign(countsLength * sizeof(unsigned int));
+
+   K * sourceKeys = deviceKeys;
+   V * sourceValues = deviceValues;
+   K * targetKeys = temporaryKeys;
+   V * targetValues = temporaryValues;
+   void (*histograms)(const K *, long long, int, unsigned int *) = radixHistograms<K>;
+   void (*scatter)(const K *, const V *, K *, V *, long long, int, const unsigned int *) = radixScatter<K, V>;
+   dim3 DimGrid((unsigned int) tiles, 1, 1);
+   dim3 DimBlock(RADIX_BLOCK_SIZE, 1, 1);
+
+   for (int pass = 0; pass < radixPasses<K>(); ++pass)
+   {
+      int shift = pass * RADIX_BITS;
+      launchKernel(histograms, DimGrid, DimBlock, (const K *) sourceKeys, len, shift, counts);
+      cudaError_t err = singlePassScanDevice<unsigned int>(counts, counts, countsLength, scratch);
+      if (err != cudaSuccess)
+         return err;
+      launchKernel(scatter, DimGrid, DimBlock, (const K *) sourceKeys, (const V *) sourceValues, targetKeys, targetValues,
+                   len, shift, (const unsigned int *) counts);
+      std::swap(sourceKeys, targetKeys);
+      std::swap(sourceValues, targetValues);
+   }
+   return cudaGetLastError();
+#else
+   radixSortHost(deviceKeys, deviceValues, len, temporaryKeys, temporaryValues);
+   return cudaSuccess;
+#endif
+}
+
+template <typename K>
+cudaError_t radixSortDevice(K * deviceKeys, long long len, void * deviceScratch)
+{
+   return radixSortDevice(deviceKeys, (unsigned int *) NULL, len, deviceScratch);
+}
+
+#endif // RADIX_SORT_H
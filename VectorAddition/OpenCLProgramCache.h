@@ -0,0 +1,215 @@
+// On-disk cache of OpenCL program binaries.
+//
+// clBuildProgram from source runs the whole compiler every time; with a CPU
+// runtime such as pocl that takes far longer than the kernels themselves.
+// buildProgramCached() keeps the binary of every program it builds and, on
+// the next run, creates the program with clCreateProgramWithBinary instead,
+// so a cold start is a file read:
+//
+//    bool fromCache;
+//    cl_program program = buildProgramCached(context, device, source, "-cl-mad-enable", &fromCache, &clerr);
+//
+// The cache key is a 64-bit FNV-1a hash of the source, the build flags and
+// the device (name, vendor, driver and platform version), so editing the
+// kernel, changing a flag or updating the driver compiles again. A binary
+// that the runtime rejects is thrown away and rebuilt from source.
+//
+// The files go to $OPENCL_PROGRAM_CACHE_DIR, or $XDG_CACHE_HOME/wb-opencl, or
+// ~/.cache/wb-opencl. Setting OPENCL_PROGRAM_CACHE_DIR to an empty string
+// turns the cache off.
+
+#ifndef OPENCL_PROGRAM_CACHE_H
+#define OPENCL_PROGRAM_CACHE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+inline uint64_t fnv1aHash(const void * data, size_t bytes, uint64_t hash = 14695981039346656037ULL)
+{
+   const unsigned char * p = (const unsigned char *) data;
+   for (size_t i = 0; i < bytes; ++i)
+   {
+      hash ^= p[i];
+      hash *= 1099511628211ULL;
+   }
+   return hash;
+}
+
+inline std::string openclDeviceString(cl_device_id device, cl_device_info param)
+{
+   size_t size = 0;
+   if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+      return std::string();
+   std::vector<char> value(size);
+   clGetDeviceInfo(device, param, size, &value[0], NULL);
+   return std::string(&value[0]);
+}
+
+// Directory of the cache, created if needed; empty when the cache is off.
+inline std::string openclProgramCacheDirectory()
+{
+   std::string directory;
+   if (const char * configured = getenv("OPENCL_PROGRAM_CACHE_DIR"))
+      directory = configured;
+   else if (const char * cache = getenv("XDG_CACHE_HOME"))
+      directory = std::string(cache) + "/wb-opencl";
+   else if (const char * home = getenv("HOME"))
+      directory = std::string(home) + "/.cache/wb-opencl";
+   if (directory.empty())
+      return directory;
+
+   // mkdir -p
+   for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1))
+   {
+      mkdir(directory.substr(0, slash).c_str(), 0755);
+      if (slash == std::string::npos)
+         break;
+   }
+   return directory;
+}
+
+inline std::string openclProgramCachePath(cl_device_id device, const char * source, const char * flags)
+{
+   std::string directory = openclProgramCacheDirectory();
+   if (directory.empty())
+      return directory;
+
+   cl_platform_id platform = NULL;
+   clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+   std::string platformVersion;
+   size_t size = 0;
+   if (platform != NULL && clGetPlatformInfo(platform, CL_PLATFORM_VERSION, 0, NULL, &size) == CL_SUCCESS && size > 0)
+   {
+      std::vector<char> value(size);
+      clGetPlatformInfo(platform, CL_PLATFORM_VERSION, size, &value[0], NULL);
+      platformVersion = &value[0];
+   }
+
+   // fields are hashed with their terminating NUL so that "ab" + "c" != "a" + "bc"
+   const std::string fields[] = {
+      source, flags ? flags : "",
+      openclDeviceString(device, CL_DEVICE_NAME), openclDeviceString(device, CL_DEVICE_VENDOR),
+      openclDeviceString(device, CL_DRIVER_VERSION), platformVersion
+   };
+   uint64_t hash = fnv1aHash(NULL, 0);
+   for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+      hash = fnv1aHash(fields[i].c_str(), fields[i].size() + 1, hash);
+
+   char name[32];
+   snprintf(name, sizeof(name), "/%016llx.clbin", (unsigned long long) hash);
+   return directory + name;
+}
+
+inline bool readOpenclBinary(const std::string& path, std::vector<unsigned char>& binary)
+{
+   FILE * file = fopen(path.c_str(), "rb");
+   if (file == NULL)
+      return false;
+   fseek(file, 0, SEEK_END);
+   long size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   binary.resize(size > 0 ? size : 0);
+   bool ok = size > 0 && fread(&binary[0], 1, binary.size(), file) == binary.size();
+   fclose(file);
+   return ok;
+}
+
+// The binary of device, written to a temporary file and renamed, so that a
+// concurrent run never reads half a binary. The program may have been created
+// for every device of its context (clCreateProgramWithSource attaches them
+// all), so the sizes and binaries are queried for each and only device's is
+// kept.
+inline void writeOpenclBinary(const std::string& path, cl_program program, cl_device_id device)
+{
+   cl_uint deviceCount = 0;
+   if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(deviceCount), &deviceCount, NULL) != CL_SUCCESS ||
+       deviceCount == 0)
+      return;
+   std::vector<cl_device_id> devices(deviceCount);
+   if (clGetProgramInfo(program, CL_PROGRAM_DEVICES, deviceCount * sizeof(cl_device_id), &devices[0], NULL) != CL_SUCCESS)
+      return;
+   size_t index = 0;
+   while (index < deviceCount && devices[index] != device)
+      ++index;
+   if (index == deviceCount)
+      return;
+
+   std::vector<size_t> sizes(deviceCount);
+   if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, deviceCount * sizeof(size_t), &sizes[0], NULL) != CL_SUCCESS ||
+       sizes[index] == 0)
+      return;
+   size_t size = sizes[index];
+   std::vector<unsigned char> binary(size);
+   std::vector<unsigned char *> binaries(deviceCount, (unsigned char *) NULL); // NULL entries are skipped
+   binaries[index] = &binary[0];
+   if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, deviceCount * sizeof(unsigned char *), &binaries[0], NULL) != CL_SUCCESS)
+      return;
+
+   char suffix[32];
+   snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+   std::string temporary = path + suffix;
+   FILE * file = fopen(temporary.c_str(), "wb");
+   if (file == NULL)
+      return;
+   bool ok = fwrite(&binary[0], 1, size, file) == size;
+   ok = fclose(file) == 0 && ok;
+   if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+      remove(temporary.c_str());
+}
+
+// A program built for device, from the cache when possible. *fromCache tells
+// which way it went; *err is set like the clCreateProgram* functions do.
+inline cl_program buildProgramCached(cl_context context, cl_device_id device, const char * source, const char * flags,
+                                     bool * fromCache, cl_int * err)
+{
+   std::string path = openclProgramCachePath(device, source, flags);
+   *fromCache = false;
+
+   std::vector<unsigned char> binary;
+   if (!path.empty() && readOpenclBinary(path, binary))
+   {
+      const unsigned char * binaries[] = { &binary[0] };
+      size_t size = binary.size();
+      cl_int binaryStatus = CL_SUCCESS;
+      cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, binaries, &binaryStatus, err);
+      if (*err == CL_SUCCESS && binaryStatus == CL_SUCCESS)
+      {
+         *err = clBuildProgram(program, 1, &device, flags, NULL, NULL);
+         if (*err == CL_SUCCESS)
+         {
+            *fromCache = true;
+            return program;
+         }
+      }
+      if (program != NULL)
+         clReleaseProgram(program);
+      remove(path.c_str()); // stale or foreign binary
+   }
+
+   cl_program program = clCreateProgramWithSource(context, 1, &source, NULL, err);
+   if (*err != CL_SUCCESS)
+      return NULL;
+   *err = clBuildProgram(program, 1, &device, flags, NULL, NULL);
+   if (*err != CL_SUCCESS)
+   {
+      clReleaseProgram(program);
+      return NULL;
+   }
+   if (!path.empty())
+      writeOpenclBinary(path, program, device);
+   return program;
+}
+
+#endif // OPENCL_PROGRAM_CACHE_H
@@ -0,0 +1,280 @@
+// Chunked multi-stream pipeline for element-wise vector operations.
+//
+// The vectors are cut into chunks. Chunk c goes to stream c % streams, which
+// owns one set of device buffers (one per input, one for the output). On that
+// stream the inputs are copied in, the kernel runs and the result is copied
+// out, all asynchronously. Up to `streams` chunks are in flight, so the copy
+// engines and the multiprocessors work on different chunks at the same time.
+// A stream reuses its buffers only after its previous chunk is done with them,
+// because work on one stream runs in order.
+//
+//    StreamPipeline pipeline(2);                  // two inputs, one output
+//    const float * inputs[] = { a, b };
+//    wbCheck(pipeline.run(inputs, c, length, VectorAdditionChunk()));
+//
+// The chunk functor has two overloads:
+//
+//    // enqueue the kernel for one chunk of device buffers on the stream
+//    void operator()(const float * const * in, float * out, size_t count, cudaStream_t stream) const;
+//    // compute one chunk of host memory
+//    void operator()(const float * const * in, float * out, size_t count) const;
+//
+// The first is only called, and only needs to exist, under nvcc.
+//
+// Chunk size: every cudaMemcpyAsync pays a fixed latency on top of
+// bytes / bandwidth. Unless a chunk size is given, the pipeline times
+// host-to-device copies of two sizes (once per process), fits latency and
+// bandwidth, and uses the smallest chunk that spends at most
+// STREAM_PIPELINE_OVERHEAD of its copy time on latency. The chunk is then
+// capped so that every stream gets a chunk.
+//
+// The host arrays are page-locked with cudaHostRegister for the duration of
+// run(): copies from pageable memory would be staged and not overlap.
+//
+// Without a GPU (the CPU executor build, or no CUDA device) device memory is
+// host memory and there is nothing to copy: the chunks are computed in place
+// by the host overload, on all the threads of the CPU executor pool.
+
+#ifndef STREAM_PIPELINE_H
+#define STREAM_PIPELINE_H
+
+#include "../CpuExecutor/CpuExecutor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#define STREAM_PIPELINE_DEFAULT_STREAMS 4
+#define STREAM_PIPELINE_OVERHEAD 0.05            // share of a copy spent on per-call latency
+#define STREAM_PIPELINE_MIN_CHUNK (16 * 1024)    // elements
+#define STREAM_PIPELINE_HOST_CHUNK (64 * 1024)   // elements per host task
+
+// Host-to-device copy time of n bytes: latencyMs + n / bytesPerMs.
+struct TransferModel
+{
+   double latencyMs;
+   double bytesPerMs;
+};
+
+inline bool streamPipelineHasDevice()
+{
+#ifdef __CUDACC__
+   int count = 0;
+   if (cudaGetDeviceCount(&count) != cudaSuccess)
+   {
+      cudaGetLastError();
+      return false;
+   }
+   return count > 0;
+#else
+   return false;
+#endif
+}
+
+#ifdef __CUDACC__
+
+// Best of a few timed copies of bytes bytes, in milliseconds.
+inline double timeHostToDeviceCopy(void * device, const void * host, size_t bytes)
+{
+   double best = 1e30;
+   for (int repetition = 0; repetition < 3; ++repetition)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      cudaMemcpy(device, host, bytes, cudaMemcpyHostToDevice);
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+   }
+   return best;
+}
+
+// Measured the first time it is called, from page-locked memory.
+inline TransferModel measureTransferModel()
+{
+   static TransferModel model = []()
+   {
+      const size_t smallBytes = 64 * 1024;
+      const size_t largeBytes = 16 * 1024 * 1024;
+
+      // defaults for when the measurement cannot be made: 10 us, 10 GB/s
+      TransferModel measured = { 0.01, 1e7 };
+
+      void * host = NULL;
+      void * device = NULL;
+      if (cudaMallocHost(&host, largeBytes) == cudaSuccess && cudaMalloc(&device, largeBytes) == cudaSuccess)
+      {
+         timeHostToDeviceCopy(device, host, smallBytes); // warm up
+         double smallMs = timeHostToDeviceCopy(device, host, smallBytes);
+         double largeMs = timeHostToDeviceCopy(device, host, largeBytes);
+         if (largeMs > smallMs)
+         {
+            measured.bytesPerMs = (largeBytes - smallBytes) / (largeMs - smallMs);
+            measured.latencyMs = std::max(smallMs - smallBytes / measured.bytesPerMs, 0.0);
+         }
+      }
+      cudaGetLastError();
+      cudaFree(device);
+      cudaFreeHost(host);
+      return measured;
+   }();
+   return model;
+}
+
+#endif // __CUDACC__
+
+class StreamPipeline
+{
+public:
+   struct Stats
+   {
+      bool onDevice;        // false: computed on host threads
+      int streams;
+      size_t chunkElements;
+      size_t chunks;
+      double bytesPerMs;    // measured copy bandwidth (0 when not measured)
+   };
+
+   // chunkElements = 0 picks the chunk size from the measured bandwidth.
+   explicit StreamPipeline(int numInputs, int streams = STREAM_PIPELINE_DEFAULT_STREAMS, size_t chunkElements = 0)
+      : numInputs(numInputs), streams(std::max(streams, 1)), chunkElements(chunkElements)
+   {
+      stats.onDevice = false;
+      stats.streams = 0;
+      stats.chunkElements = 0;
+      stats.chunks = 0;
+      stats.bytesPerMs = 0.0;
+   }
+
+   // output[i] = chunk(inputs[0][i], ..., inputs[numInputs - 1][i]) for i < length.
+   template <typename Chunk>
+   cudaError_t run(const float * const * inputs, float * output, size_t length, const Chunk& chunk)
+   {
+      if (length == 0)
+         return cudaSuccess;
+#ifdef __CUDACC__
+      if (streamPipelineHasDevice())
+         return runOnDevice(inputs, output, length, chunk);
+#endif
+      return runOnHost(inputs, output, length, chunk);
+   }
+
+   const Stats& getStats() const
+   {
+      return stats;
+   }
+
+private:
+   template <typename Chunk>
+   cudaError_t runOnHost(const float * const * inputs, float * output, size_t length, const Chunk& chunk)
+   {
+      size_t elements = chunkElements ? chunkElements : STREAM_PIPELINE_HOST_CHUNK;
+      size_t chunks = (length + elements - 1) / elements;
+
+      stats.onDevice = false;
+      stats.streams = (int) cpuThreadCount();
+      stats.chunkElements = elements;
+      stats.chunks = chunks;
+      stats.bytesPerMs = 0.0;
+
+      int numInputs = this->numInputs;
+      cpuParallelFor(chunks, 1, [&](size_t first, size_t last)
+      {
+         std::vector<const float *> in(numInputs);
+         for (size_t c = first; c < last; ++c)
+         {
+            size_t begin = c * elements;
+            for (int k = 0; k < numInputs; ++k)
+               in[k] = inputs[k] + begin;
+            chunk(&in[0], output + begin, std::min(elements, length - begin));
+         }
+      });
+      return cudaSuccess;
+   }
+
+#ifdef __CUDACC__
+   // Smallest multiple of 1024 elements whose copies are latency bound for at
+   // most STREAM_PIPELINE_OVERHEAD of their time, capped at length / streams.
+   size_t deviceChunkElements(size_t length, const TransferModel& model) const
+   {
+      double bytes = model.latencyMs * model.bytesPerMs * (1.0 - STREAM_PIPELINE_OVERHEAD) / STREAM_PIPELINE_OVERHEAD;
+      size_t elements = std::max((size_t) (bytes / sizeof(float)), (size_t) STREAM_PIPELINE_MIN_CHUNK);
+      elements = std::min(elements, (length + streams - 1) / streams);
+      return (elements + 1023) / 1024 * 1024;
+   }
+
+   template <typename Chunk>
+   cudaError_t runOnDevice(const float * const * inputs, float * output, size_t length, const Chunk& chunk)
+   {
+      TransferModel model = measureTransferModel();
+      size_t elements = chunkElements ? chunkElements : deviceChunkElements(length, model);
+      size_t chunks = (length + elements - 1) / elements;
+      int used = (int) std::min((size_t) streams, chunks);
+      int buffersPerStream = numInputs + 1;
+
+      stats.onDevice = true;
+      stats.streams = used;
+      stats.chunkElements = elements;
+      stats.chunks = chunks;
+      stats.bytesPerMs = model.bytesPerMs;
+
+      // page-lock the host arrays; already pinned memory is left as it is
+      std::vector<void *> registered;
+      for (int k = 0; k <= numInputs; ++k)
+      {
+         void * host = k < numInputs ? (void *) inputs[k] : (void *) output;
+         if (cudaHostRegister(host, length * sizeof(float), cudaHostRegisterDefault) == cudaSuccess)
+            registered.push_back(host);
+         else
+            cudaGetLastError();
+      }
+
+      cudaError_t err = cudaSuccess;
+      std::vector<cudaStream_t> stream(used, (cudaStream_t) 0);
+      std::vector<float *> buffers(used * buffersPerStream, (float *) NULL);
+      for (int s = 0; s < used && err == cudaSuccess; ++s)
+      {
+         err = cudaStreamCreate(&stream[s]);
+         for (int b = 0; b < buffersPerStream && err == cudaSuccess; ++b)
+            err = cudaMalloc((void **) &buffers[s * buffersPerStream + b], elements * sizeof(float));
+      }
+
+      for (size_t c = 0; c < chunks && err == cudaSuccess; ++c)
+      {
+         int s = (int) (c % used);
+         float ** slot = &buffers[s * buffersPerStream];
+         size_t begin = c * elements;
+         size_t count = std::min(elements, length - begin);
+
+         for (int k = 0; k < numInputs && err == cudaSuccess; ++k)
+            err = cudaMemcpyAsync(slot[k], inputs[k] + begin, count * sizeof(float), cudaMemcpyHostToDevice, stream[s]);
+         if (err == cudaSuccess)
+         {
+            chunk(slot, slot[numInputs], count, stream[s]);
+            err = cudaGetLastError();
+         }
+         if (err == cudaSuccess)
+            err = cudaMemcpyAsync(output + begin, slot[numInputs], count * sizeof(float), cudaMemcpyDeviceToHost, stream[s]);
+      }
+
+      cudaError_t syncErr = cudaDeviceSynchronize();
+      if (err == cudaSuccess)
+         err = syncErr;
+
+      for (size_t b = 0; b < buffers.size(); ++b)
+         cudaFree(buffers[b]);
+      for (int s = 0; s < used; ++s)
+         if (stream[s])
+            cudaStreamDestroy(stream[s]);
+      for (size_t r = 0; r < registered.size(); ++r)
+         cudaHostUnregister(registered[r]);
+      return err;
+   }
+#endif // __CUDACC__
+
+   int numInputs;
+   int streams;
+   size_t chunkElements;
+   Stats stats;
+};
+
+#endif // STREAM_PIPELINE_H
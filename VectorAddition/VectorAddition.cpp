@@ -1,4 +1,5 @@
 #include <wb.h>
+#include "../Profiler/WbProfiler.h"
 
 void cudaLog(cudaError_t err)
 {
@@ -1,4 +1,5 @@
 #include <wb.h> 
+#include "../Profiler/WbProfiler.h"
 
 int main(int argc, char **argv) 
 {
@@ -1,4 +1,6 @@
 #include <wb.h> //@@ wb include opencl.h for you
+#include "../Profiler/WbProfiler.h"
+#include "OpenCLProgramCache.h"
 #include <sstream>
 
 #define wbCheck(stmt) do {                                                    \
@@ -79,14 +81,16 @@ int main(int argc, char **argv)
   clerr = clGetContextInfo(clctx, CL_CONTEXT_DEVICES, parmsz, cldevs, NULL); wbCheck(clerr);
   cl_command_queue clcmdq = clCreateCommandQueue(clctx, cldevs[0], 0, &clerr); wbCheck(clerr);
 
-  cl_program clpgm;
-  clpgm = clCreateProgramWithSource(clctx, 1, &vaddsrc, NULL, &clerr); wbCheck(clerr);
-
   char clcompileflags[4096];
   sprintf(clcompileflags, "-cl-mad-enable");
-  
-  clerr = clBuildProgram(clpgm, 0, NULL, clcompileflags, NULL, NULL); wbCheck(clerr);
-  
+
+  //@@ A cold start reads the binary of a previous run instead of compiling
+  wbTime_start(Generic, "Building the OpenCL program");
+  bool fromCache;
+  cl_program clpgm = buildProgramCached(clctx, cldevs[0], vaddsrc, clcompileflags, &fromCache, &clerr); wbCheck(clerr);
+  wbTime_stop(Generic, "Building the OpenCL program");
+  wbLog(TRACE, "The OpenCL program was ", fromCache ? "loaded from the binary cache" : "compiled from source");
+
   cl_kernel clkern = clCreateKernel(clpgm, "vadd", &clerr); wbCheck(clerr);
 
   wbTime_start(GPU, "Allocating GPU memory.");
@@ -107,18 +111,16 @@ int main(int argc, char **argv)
 
   wbTime_start(Compute, "Performing CUDA computation");
   //@@ Launch the GPU Kernel here
-  clkern = clCreateKernel(clpgm, "vadd", NULL); 
-
   wbCheck(clSetKernelArg(clkern, 0, sizeof(cl_mem),(void *)&deviceInput1));
   wbCheck(clSetKernelArg(clkern, 1, sizeof(cl_mem),(void *)&deviceInput2));
   wbCheck(clSetKernelArg(clkern, 2, sizeof(cl_mem),(void *)&deviceOutput));
   wbCheck(clSetKernelArg(clkern, 3, sizeof(int), &inputLength));
   
   cl_event event = NULL;
-  size_t globalWorkSize[3] = { inputLength, 1, 1 };
-  size_t localWorkSize[3]  = { 1, 1, 1 };
-  clerr = clEnqueueNDRangeKernel(clcmdq, clkern, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, &event);
-  clerr = clWaitForEvents(1, &event);
+  size_t globalWorkSize[1] = { (size_t) inputLength };
+  clerr = clEnqueueNDRangeKernel(clcmdq, clkern, 1, NULL, globalWorkSize, NULL, 0, NULL, &event); wbCheck(clerr);
+  clerr = clWaitForEvents(1, &event); wbCheck(clerr);
+  clReleaseEvent(event);
   clEnqueueReadBuffer(clcmdq, deviceOutput, CL_TRUE, 0, inputLength * sizeof(float), hostOutput, 0, NULL, NULL);
   
   //cudaDeviceSynchronize();
@@ -136,6 +138,12 @@ int main(int argc, char **argv)
   clReleaseMemObject(deviceOutput);
   wbTime_stop(GPU, "Freeing GPU Memory");
 
+  clReleaseKernel(clkern);
+  clReleaseProgram(clpgm);
+  clReleaseCommandQueue(clcmdq);
+  clReleaseContext(clctx);
+  free(cldevs);
+
   /*
   std::stringstream strActual;
   for (int i = 0; i < 10; ++i)
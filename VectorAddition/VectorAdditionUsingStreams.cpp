@@ -1,6 +1,11 @@
 #include <wb.h>
+#include "../Profiler/WbProfiler.h"
 
-#define SEGMENT_SIZE 512
+#include "StreamPipeline.h"
+
+#define BLOCK_SIZE 256
+#define PIPELINE_STREAMS STREAM_PIPELINE_DEFAULT_STREAMS //@@ You can change this
+#define PIPELINE_CHUNK_ELEMENTS 0 //@@ 0: chosen from the measured copy bandwidth
 
 #define wbCheck(stmt) do {                                                    \
         cudaError_t err = stmt;                                               \
@@ -11,13 +16,32 @@
         }                                                                     \
     } while(0)
 
-__global__ void vecAdd(float *in1, float *in2, float *out, int len) 
+__global__ void vecAdd(const float *in1, const float *in2, float *out, int len) 
 {
    int i = blockIdx.x * blockDim.x + threadIdx.x;
    if (i < len)
            out[i] = in1[i] + in2[i];
 }
 
+// One chunk of the pipeline: out = in[0] + in[1]
+struct VectorAdditionChunk
+{
+#ifdef __CUDACC__
+   void operator()(const float * const * in, float * out, size_t count, cudaStream_t stream) const
+   {
+      vecAdd<<< (unsigned) ((count - 1) / BLOCK_SIZE + 1), BLOCK_SIZE, 0, stream >>>(in[0], in[1], out, (int) count);
+   }
+#endif
+
+   void operator()(const float * const * in, float * out, size_t count) const
+   {
+      const float * __restrict__ in1 = in[0];
+      const float * __restrict__ in2 = in[1];
+      for (size_t i = 0; i < count; ++i)
+         out[i] = in1[i] + in2[i];
+   }
+};
+
 int main(int argc, char **argv) 
 {
   wbArg_t args;
@@ -36,108 +60,20 @@ int main(int argc, char **argv)
 
   wbLog(TRACE, "The input length is ", inputLength);
 
-  wbTime_start(GPU, "Allocating GPU memory.");
-
-        int segSize = SEGMENT_SIZE * sizeof(float);
-        float *device_A0, *device_B0, *device_C0; 
-        float *device_A1, *device_B1, *device_C1;
-        /*
-        wbCheck(cudaMalloc((void**)&device_A0, segSize));
-        wbCheck(cudaMalloc((void**)&device_A1, segSize));
-        wbCheck(cudaMalloc((void**)&device_B0, segSize));
-        wbCheck(cudaMalloc((void**)&device_B1, segSize));
-        wbCheck(cudaMalloc((void**)&device_C0, segSize));
-        wbCheck(cudaMalloc((void**)&device_C1, segSize));
-        */
-        
-        wbCheck(cudaHostAlloc((void**) &device_A0, segSize, cudaHostAllocDefault));
-        wbCheck(cudaHostAlloc((void**) &device_A1, segSize, cudaHostAllocDefault));
-        wbCheck(cudaHostAlloc((void**) &device_B0, segSize, cudaHostAllocDefault));
-        wbCheck(cudaHostAlloc((void**) &device_B1, segSize, cudaHostAllocDefault));
-        wbCheck(cudaHostAlloc((void**) &device_C0, segSize, cudaHostAllocDefault));
-        wbCheck(cudaHostAlloc((void**) &device_C1, segSize, cudaHostAllocDefault));
-        
-  
-  wbTime_stop(GPU, "Allocating GPU memory.");
-
   wbTime_start(GPU, "Performing computation.");
 
-        cudaStream_t stream0;
-        cudaStream_t stream1;
-        cudaStreamCreate(&stream0);
-        cudaStreamCreate(&stream1);
-        int ElementsNumber0 = 0;
-        int ElementsNumber1 = 0;
-        int ElementsSize0 = 0;
-        int ElementsSize1 = 0;
-
-        for (int i = 0; i < inputLength; i += SEGMENT_SIZE * 2) 
-        {
-             if (inputLength - i >= SEGMENT_SIZE)
-                ElementsNumber0 = SEGMENT_SIZE;
-             else
-                ElementsNumber0 = inputLength - i;
-
-             ElementsSize0 = ElementsNumber0 * sizeof(float);
-
-             if (inputLength - i >= 2 * SEGMENT_SIZE)
-                ElementsNumber1 = SEGMENT_SIZE;
-             else
-                ElementsNumber1 = inputLength - i - SEGMENT_SIZE;
-
-             ElementsSize1 = ElementsNumber1 * sizeof(float);
-
-             wbLog(TRACE, i);
-             wbLog(TRACE, ElementsNumber0);
-             wbLog(TRACE, ElementsNumber1);
-
-             if (ElementsNumber0 > 0)
-             {
-                wbCheck(cudaMemcpyAsync(device_A0, hostInputA + i, ElementsSize0, cudaMemcpyHostToDevice, stream0));
-                wbCheck(cudaMemcpyAsync(device_B0, hostInputB + i, ElementsSize0, cudaMemcpyHostToDevice, stream0));
-             }
-             if (ElementsNumber1 > 0)
-             {
-                wbCheck(cudaMemcpyAsync(device_A1, hostInputA + i + SEGMENT_SIZE, ElementsSize1, cudaMemcpyHostToDevice, stream1));
-                wbCheck(cudaMemcpyAsync(device_B1, hostInputB + i + SEGMENT_SIZE, ElementsSize1, cudaMemcpyHostToDevice, stream1));
-             }
-
-             if (ElementsNumber0 > 0)
-                vecAdd<<< 1, SEGMENT_SIZE, 0, stream0 >>>(device_A0, device_B0, device_C0, ElementsNumber0);
-             if (ElementsNumber1 > 0)
-                vecAdd<<< 1, SEGMENT_SIZE, 0, stream1 >>>(device_A1, device_B1, device_C1, ElementsNumber1);
-             
-             if (ElementsNumber0 > 0)
-                wbCheck(cudaMemcpyAsync(hostOutput + i, device_C0, ElementsSize0, cudaMemcpyDeviceToHost, stream0));
-             if (ElementsNumber1 > 0)
-                wbCheck(cudaMemcpyAsync(hostOutput + i + SEGMENT_SIZE, device_C1, ElementsSize1, cudaMemcpyDeviceToHost, stream1));
-        }
-
-  cudaDeviceSynchronize();
+  //@@ Copy-in, compute and copy-out of PIPELINE_STREAMS chunks overlap
+  StreamPipeline pipeline(2, PIPELINE_STREAMS, PIPELINE_CHUNK_ELEMENTS);
+  const float *inputs[] = { hostInputA, hostInputB };
+  wbCheck(pipeline.run(inputs, hostOutput, inputLength, VectorAdditionChunk()));
 
   wbTime_stop(GPU, "Performing computation.");
 
-  wbSolution(args, hostOutput, inputLength);
+  const StreamPipeline::Stats& stats = pipeline.getStats();
+  wbLog(TRACE, "Streamed ", stats.chunks, " chunks of ", stats.chunkElements, " elements through ",
+        stats.streams, stats.onDevice ? " streams" : " host threads");
 
-  wbTime_start(GPU, "Freeing GPU Memory");
-    
-        /*
-        wbCheck(cudaFree(device_A0));
-        wbCheck(cudaFree(device_A1));
-        wbCheck(cudaFree(device_B0));
-        wbCheck(cudaFree(device_B1));
-        wbCheck(cudaFree(device_C0));
-        wbCheck(cudaFree(device_C1));
-        */
-        wbCheck(cudaFreeHost(device_A0));
-        wbCheck(cudaFreeHost(device_A1));
-        wbCheck(cudaFreeHost(device_B0));
-        wbCheck(cudaFreeHost(device_B1));
-        wbCheck(cudaFreeHost(device_C0));
-        wbCheck(cudaFreeHost(device_C1));
-        
-
-  wbTime_stop(GPU, "Freeing GPU Memory");
+  wbSolution(args, hostOutput, inputLength);
 
   free(hostInputA);
   free(hostInputB);